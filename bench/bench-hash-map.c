@@ -0,0 +1,100 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  Benchmark of the hash map (hash-map.c), which caches table descriptors by variable ID, with 1M keys
+ *  that look like SMA-X variable IDs. It also checks that every key maps to its value after puts and
+ *  after removing half the keys.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "smax-postgres.h"
+#include "hash-map.h"
+
+#define BENCH_KEYS            1000000     ///< Number of keys in the map
+#define BENCH_KEY_LEN         64          ///< (bytes) Maximum length of keys
+
+/**
+ * Returns a monotonic time in seconds, for timing.
+ *
+ * @return    (s) Monotonic time.
+ */
+static double getSeconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/**
+ * Prints the time per operation.
+ *
+ * @param name    Name of the operation
+ * @param dt      (s) Time it took to perform the operation on all keys
+ */
+static void report(const char *name, double dt) {
+  printf("  %-24s %8.1f ns/key\n", name, 1e9 * dt / BENCH_KEYS);
+}
+
+int main() {
+  char *keys = (char *) malloc((size_t) BENCH_KEYS * BENCH_KEY_LEN);
+  HashMap *map = hashMapCreate(16);
+  double t0;
+  long sum = 0;
+  int i, nFailed = 0;
+
+  if(!keys || !map) {
+    perror("ERROR! alloc");
+    return 1;
+  }
+
+  for(i = 0; i < BENCH_KEYS; i++)
+    snprintf(&keys[(size_t) i * BENCH_KEY_LEN], BENCH_KEY_LEN, "antenna%d:rx:channel%d:power", i % 10, i);
+
+  printf("Hash map with %d keys:\n", BENCH_KEYS);
+
+  // Values are the (1-based) key indices, so that they are never NULL.
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_KEYS; i++) if(hashMapPut(map, &keys[(size_t) i * BENCH_KEY_LEN], (void *) (intptr_t) (i + 1), NULL) != 1) nFailed++;
+  report("hashMapPut() (growing)", getSeconds() - t0);
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_KEYS; i++) sum += (intptr_t) hashMapGet(map, &keys[(size_t) i * BENCH_KEY_LEN]);
+  report("hashMapGet()", getSeconds() - t0);
+
+  if(sum != (long) BENCH_KEYS * (BENCH_KEYS + 1) / 2) nFailed++;
+
+  for(i = 0; i < BENCH_KEYS; i++) if(hashMapGet(map, &keys[(size_t) i * BENCH_KEY_LEN]) != (void *) (intptr_t) (i + 1)) nFailed++;
+  if(hashMapSize(map) != BENCH_KEYS) nFailed++;
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_KEYS; i++) if(hashMapGet(map, "antenna0:rx:channel:missing") != NULL) nFailed++;
+  report("hashMapGet() (missing)", getSeconds() - t0);
+
+  // Remove every other key, and check that the backward shifts kept the others in reach.
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_KEYS; i += 2) if(hashMapRemove(map, &keys[(size_t) i * BENCH_KEY_LEN]) != (void *) (intptr_t) (i + 1)) nFailed++;
+  report("hashMapRemove()", 2.0 * (getSeconds() - t0));
+
+  for(i = 0; i < BENCH_KEYS; i++) {
+    void *expected = (i & 1) ? (void *) (intptr_t) (i + 1) : NULL;
+    if(hashMapGet(map, &keys[(size_t) i * BENCH_KEY_LEN]) != expected) nFailed++;
+  }
+  if(hashMapSize(map) != BENCH_KEYS / 2) nFailed++;
+
+  hashMapDestroy(map, NULL);
+  free(keys);
+
+  if(nFailed) {
+    fprintf(stderr, "FAILED: %d hash map checks failed.\n", nFailed);
+    return 1;
+  }
+
+  printf("OK: all keys map to their values.\n");
+  return 0;
+}
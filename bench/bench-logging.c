@@ -0,0 +1,140 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  Benchmark of isLogging() (logger-config.c) over 500k distinct variable IDs, which is enough for the
+ *  lookup of logging properties to grow several times. It checks that the properties cached before the
+ *  lookup grew are the very same ones returned after, and that the configured rules are applied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "smax-postgres.h"
+
+#define BENCH_IDS             500000      ///< Number of distinct variable IDs
+#define BENCH_CACHED          1000        ///< Number of IDs whose properties are kept from before the lookup grows
+#define BENCH_ID_LEN          48          ///< (bytes) Maximum length of variable IDs
+
+/// Rules for the variable IDs of the benchmark
+#define BENCH_CONFIG \
+  "exclude *:debug:*\n" \
+  "always *:debug:heartbeat:*\n" \
+  "sample 10 *:spectrum:*\n"
+
+/**
+ * Returns a monotonic time in seconds, for timing.
+ *
+ * @return    (s) Monotonic time.
+ */
+static double getSeconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/**
+ * Prints the time per variable ID.
+ *
+ * @param name    Name of the operation
+ * @param dt      (s) Time it took to perform the operation for all IDs
+ */
+static void report(const char *name, double dt) {
+  printf("  %-24s %8.1f ns/id\n", name, 1e9 * dt / BENCH_IDS);
+}
+
+/**
+ * Prints the ID of a benchmark variable. Every fourth variable is excluded by the rules, unless it is a
+ * heartbeat, and every fourth variable is downsampled.
+ *
+ * @param i       Index of the variable
+ * @param dst     Buffer for the ID (at least BENCH_ID_LEN bytes)
+ */
+static void printId(int i, char *dst) {
+  static const char *kinds[] = { "debug:value", "debug:heartbeat", "rx:power", "spectrum" };
+  snprintf(dst, BENCH_ID_LEN, "antenna%d:%s:%d", i % 10, kinds[i & 3], i);
+}
+
+/**
+ * Checks that the properties of a benchmark variable follow the configured rules.
+ *
+ * @param i       Index of the variable
+ * @param p       The logging properties of the variable
+ * @return        TRUE (1) if the properties are as expected, or else FALSE (0).
+ */
+static boolean isExpected(int i, const logger_properties *p) {
+  if(!p) return FALSE;
+  if(isLoggingWith(p, (double) time(NULL), time(NULL)) != ((i & 3) != 0)) return FALSE;
+  return p->sampling == ((i & 3) == 3 ? 10 : 1);
+}
+
+int main() {
+  char *ids = (char *) malloc((size_t) BENCH_IDS * BENCH_ID_LEN);
+  logger_properties *cached[BENCH_CACHED];
+  char config[] = "/tmp/bench-logging-XXXXXX";
+  double t0, now = (double) time(NULL);
+  int i, fd, n = 0, nFailed = 0;
+
+  if(!ids) {
+    perror("ERROR! alloc");
+    return 1;
+  }
+
+  fd = mkstemp(config);
+  if(fd < 0 || write(fd, BENCH_CONFIG, sizeof(BENCH_CONFIG) - 1) != sizeof(BENCH_CONFIG) - 1) {
+    perror("ERROR! writing configuration");
+    return 1;
+  }
+  close(fd);
+
+  i = parseConfig(config);
+  unlink(config);
+  if(i != 0) return 1;
+
+  for(i = 0; i < BENCH_IDS; i++) printId(i, &ids[(size_t) i * BENCH_ID_LEN]);
+
+  // Properties cached while the lookup is still small...
+  for(i = 0; i < BENCH_CACHED; i++) cached[i] = getLogProperties(&ids[(size_t) i * BENCH_ID_LEN]);
+
+  printf("isLogging() with %d distinct IDs:\n", BENCH_IDS);
+
+  // ... then the lookup grows for the rest.
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_IDS; i++) n += isLogging(&ids[(size_t) i * BENCH_ID_LEN], now);
+  report("first call (evaluating)", getSeconds() - t0);
+
+  if(n != BENCH_IDS - BENCH_IDS / 4) nFailed++;
+
+  n = 0;
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_IDS; i++) n += isLogging(&ids[(size_t) i * BENCH_ID_LEN], now);
+  report("repeat call (cached)", getSeconds() - t0);
+
+  if(n != BENCH_IDS - BENCH_IDS / 4) nFailed++;
+
+  for(i = 0; i < BENCH_CACHED; i++) {
+    if(getLogProperties(&ids[(size_t) i * BENCH_ID_LEN]) != cached[i]) {
+      if(nFailed++ < 10) fprintf(stderr, "ERROR! properties of %s changed after the lookup grew\n", &ids[(size_t) i * BENCH_ID_LEN]);
+    }
+  }
+
+  for(i = 0; i < BENCH_IDS; i++) {
+    if(!isExpected(i, getLogProperties(&ids[(size_t) i * BENCH_ID_LEN]))) {
+      if(nFailed++ < 10) fprintf(stderr, "ERROR! unexpected properties for %s\n", &ids[(size_t) i * BENCH_ID_LEN]);
+    }
+  }
+
+  free(ids);
+
+  if(nFailed) {
+    fprintf(stderr, "FAILED: %d logging property checks failed.\n", nFailed);
+    return 1;
+  }
+
+  printf("OK: cached properties survived the lookup growing.\n");
+  return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  Benchmark of the floating-point formatting in sql-numbers.c, against the `sprintf()` formats that
+ *  were used before (`%.16lg` and `%.7g`). It also checks that the printed values round-trip exactly,
+ *  via `strtod()` and `strtof()`, over random bit patterns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "smax-postgres.h"
+
+#define BENCH_VALUES          1000000     ///< Number of random values to format
+#define BENCH_SEED            0x5eed5eed5eed5eedULL ///< Seed for the random bit patterns
+
+static uint64_t state = BENCH_SEED;   ///< State of the random generator
+
+/**
+ * Returns the next random 64-bit pattern (xorshift64*).
+ *
+ * @return    A pseudo-random 64-bit value.
+ */
+static uint64_t nextRandom() {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Returns a monotonic time in seconds, for timing.
+ *
+ * @return    (s) Monotonic time.
+ */
+static double getSeconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/**
+ * Prints the time per value for a formatting method.
+ *
+ * @param name    Name of the formatting method
+ * @param dt      (s) Time it took to format all values
+ * @param ref     (s) Reference time to compare to, or 0.0 for none.
+ */
+static void report(const char *name, double dt, double ref) {
+  printf("  %-24s %8.1f ns/value", name, 1e9 * dt / BENCH_VALUES);
+  if(ref > 0.0) printf("  (%.2fx faster)", ref / dt);
+  printf("\n");
+}
+
+/**
+ * Checks that double-precision values round-trip exactly through printDouble() and strtod().
+ *
+ * @param values  The values to check
+ * @return        The number of values that did not round-trip.
+ */
+static int checkDoubles(const double *values) {
+  char buf[40];
+  int i, n = 0;
+
+  for(i = 0; i < BENCH_VALUES; i++) {
+    double d;
+
+    printDouble(values[i], buf);
+    d = strtod(buf, NULL);
+
+    if(memcmp(&d, &values[i], sizeof(d)) != 0) {
+      if(n++ < 10) fprintf(stderr, "ERROR! double %.17lg printed as %s\n", values[i], buf);
+    }
+  }
+
+  return n;
+}
+
+/**
+ * Checks that single-precision values round-trip exactly through printFloat() and strtof().
+ *
+ * @param values  The values to check
+ * @return        The number of values that did not round-trip.
+ */
+static int checkFloats(const float *values) {
+  char buf[40];
+  int i, n = 0;
+
+  for(i = 0; i < BENCH_VALUES; i++) {
+    float f;
+
+    printFloat(values[i], buf);
+    f = strtof(buf, NULL);
+
+    if(memcmp(&f, &values[i], sizeof(f)) != 0) {
+      if(n++ < 10) fprintf(stderr, "ERROR! float %.9g printed as %s\n", values[i], buf);
+    }
+  }
+
+  return n;
+}
+
+int main() {
+  double *d = (double *) malloc(BENCH_VALUES * sizeof(double));
+  float *f = (float *) malloc(BENCH_VALUES * sizeof(float));
+  char buf[40];
+  double t0, ref;
+  int i, nFailed;
+
+  if(!d || !f) {
+    perror("ERROR! alloc");
+    return 1;
+  }
+
+  // Random bit patterns, skipping infinities and NaN (which the caller handles).
+  for(i = 0; i < BENCH_VALUES;) {
+    uint64_t bits = nextRandom();
+    memcpy(&d[i], &bits, sizeof(double));
+    if(isfinite(d[i])) i++;
+  }
+
+  for(i = 0; i < BENCH_VALUES;) {
+    uint32_t bits = (uint32_t) (nextRandom() >> 32);
+    memcpy(&f[i], &bits, sizeof(float));
+    if(isfinite(f[i])) i++;
+  }
+
+  nFailed = checkDoubles(d) + checkFloats(f);
+
+  printf("Formatting %d random values:\n", BENCH_VALUES);
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_VALUES; i++) sprintf(buf, "%.16lg", d[i]);
+  ref = getSeconds() - t0;
+  report("sprintf(\"%.16lg\")", ref, 0.0);
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_VALUES; i++) printDouble(d[i], buf);
+  report("printDouble()", getSeconds() - t0, ref);
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_VALUES; i++) sprintf(buf, "%.7g", f[i]);
+  ref = getSeconds() - t0;
+  report("sprintf(\"%.7g\")", ref, 0.0);
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_VALUES; i++) printFloat(f[i], buf);
+  report("printFloat()", getSeconds() - t0, ref);
+
+  free(d);
+  free(f);
+
+  if(nFailed) {
+    fprintf(stderr, "FAILED: %d values did not round-trip.\n", nFailed);
+    return 1;
+  }
+
+  printf("OK: all values round-trip exactly.\n");
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  Benchmark of the lock-free writer queue (writer-queue.c), with several producer threads and one
+ *  consumer (writer), 100k variables per cycle. It checks that the consumer receives the variables of
+ *  each producer in the order they were pushed, i.e. that the queue order of the stack is restored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define __XCHANGE_INTERNAL_API__                          ///< Use internal definitions
+#include "smax-postgres.h"
+#include "writer-queue.h"
+
+#define BENCH_PRODUCERS       4           ///< Number of producer threads
+#define BENCH_ITEMS           100000      ///< Number of variables queued per cycle (by all producers)
+#define BENCH_CYCLES          20          ///< Number of cycles to run
+
+#define BENCH_PER_PRODUCER    (BENCH_ITEMS / BENCH_PRODUCERS) ///< Number of variables queued per producer per cycle
+
+static Variable pool[BENCH_ITEMS];      ///< The variables, with the ones of each producer in a contiguous block
+static WriterQueue queue;               ///< The queue under test
+
+/**
+ * Returns a monotonic time in seconds, for timing.
+ *
+ * @return    (s) Monotonic time.
+ */
+static double getSeconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/**
+ * A producer thread, which pushes its block of variables onto the queue, in order.
+ *
+ * @param arg     Pointer to the first variable of the producer's block.
+ * @return        NULL
+ */
+static void *ProducerThread(void *arg) {
+  Variable *u = (Variable *) arg;
+  int i;
+
+  for(i = 0; i < BENCH_PER_PRODUCER; i++) pushWriterQueue(&queue, &u[i]);
+
+  return NULL;
+}
+
+/**
+ * Runs one cycle of the benchmark: the producers push all variables while the calling thread (as the
+ * writer) pulls them, checking that the variables of each producer arrive in order.
+ *
+ * @return    The number of variables received out of order.
+ */
+static int runCycle() {
+  pthread_t producers[BENCH_PRODUCERS];
+  int next[BENCH_PRODUCERS] = {0};
+  int i, nFailed = 0;
+
+  for(i = 0; i < BENCH_PRODUCERS; i++) if(pthread_create(&producers[i], NULL, ProducerThread, &pool[i * BENCH_PER_PRODUCER]) != 0) {
+    perror("ERROR! could not start producer");
+    exit(1);
+  }
+
+  for(i = 0; i < BENCH_ITEMS; i++) {
+    Variable *u;
+    int k, p;
+
+    while(!(u = takeWriterQueue(&queue))) waitWriterQueue(&queue, NULL);
+
+    k = (int) (u - pool);
+    p = k / BENCH_PER_PRODUCER;
+
+    if(k % BENCH_PER_PRODUCER != next[p]) nFailed++;
+    next[p] = k % BENCH_PER_PRODUCER + 1;
+  }
+
+  for(i = 0; i < BENCH_PRODUCERS; i++) pthread_join(producers[i], NULL);
+
+  // Nothing should be left over.
+  if(!isWriterQueueEmpty(&queue)) nFailed++;
+
+  return nFailed;
+}
+
+int main() {
+  double t0, dt;
+  int i, nFailed = 0;
+
+  initWriterQueue(&queue);
+
+  for(i = 0; i < BENCH_ITEMS; i++) pool[i].id = "bench:queue";
+
+  printf("Writer queue with %d producers, %d variables per cycle:\n", BENCH_PRODUCERS, BENCH_ITEMS);
+
+  t0 = getSeconds();
+  for(i = 0; i < BENCH_CYCLES; i++) nFailed += runCycle();
+  dt = getSeconds() - t0;
+
+  printf("  %-24s %8.1f ns/variable\n", "push / take", 1e9 * dt / ((double) BENCH_CYCLES * BENCH_ITEMS));
+
+  if(nFailed) {
+    fprintf(stderr, "FAILED: %d variables were received out of order.\n", nFailed);
+    return 1;
+  }
+
+  printf("OK: the variables of each producer were received in order.\n");
+  return 0;
+}
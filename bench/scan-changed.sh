@@ -0,0 +1,144 @@
+#!/bin/sh
+#
+# Benchmark of selecting the changed SMA-X timestamps on the Redis server, with the Lua script of
+# ScanChanged() (smax-collector.c), against the plain HSCAN of the '<timestamps>' table, which sends
+# every timestamp to the client for filtering.
+#
+# It runs a throw-away redis-server on a local port (REDIS_PORT, 16379 by default), with 200k synthetic
+# timestamps, 1% of which are recent. It reports the server time, number of calls, and the data sent to
+# the client for each approach, and checks that the Lua script selects exactly the recent timestamps.
+# It is skipped if redis-server or redis-cli is not available.
+#
+# Author: agent
+
+TIMESTAMPS=200000
+CHANGED_EVERY=100
+LUA_SCAN_COUNT=1000
+REDIS_SCAN_COUNT=100
+PORT=${REDIS_PORT:-16379}
+
+if ! command -v redis-server >/dev/null 2>&1 || ! command -v redis-cli >/dev/null 2>&1 ; then
+  echo "SKIPPED: scan-changed benchmark needs redis-server and redis-cli."
+  exit 0
+fi
+
+DIR=`dirname "$0"`
+
+redis() {
+  redis-cli -p $PORT "$@"
+}
+
+# Do not touch a Redis server that is not ours.
+if [ "`redis ping 2>/dev/null`" = "PONG" ] ; then
+  echo "ERROR! Port $PORT is already used by a Redis server. Set REDIS_PORT to a free port."
+  exit 1
+fi
+
+TMP=`mktemp -d`
+
+cleanup() {
+  redis shutdown nosave >/dev/null 2>&1
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+# Extract the Lua script from the C source, so we always benchmark the one the collector uses.
+sed -n '/^#define TIMESTAMP_SCAN_SCRIPT/,/return result/p' "$DIR/../src/smax-collector.c" \
+  | sed -n 's/^ *"\(.*\)\\n" *\\\{0,1\}$/\1/p' > "$TMP/scan.lua"
+
+if [ ! -s "$TMP/scan.lua" ] ; then
+  echo "ERROR! Could not find the timestamp scan script in smax-collector.c"
+  exit 1
+fi
+
+redis-server --port $PORT --save "" --appendonly no --daemonize yes --dir "$TMP" --pidfile "$TMP/redis.pid" >/dev/null
+
+for i in 1 2 3 4 5 6 7 8 9 10 ; do
+  [ "`redis ping 2>/dev/null`" = "PONG" ] && break
+  sleep 0.5
+done
+
+if [ "`redis ping 2>/dev/null`" != "PONG" ] ; then
+  echo "ERROR! Could not start redis-server on port $PORT"
+  exit 1
+fi
+
+NOW=`date +%s`
+CUTOFF=$((NOW - 60))
+
+# Populate the timestamps via the Redis protocol (RESP), with every CHANGED_EVERY-th one recent.
+awk -v n=$TIMESTAMPS -v every=$CHANGED_EVERY -v now=$NOW 'BEGIN {
+  for(i = 0; i < n; i++) {
+    field = sprintf("antenna%d:rx:var%d", i % 10, i)
+    value = sprintf("%d.%06d", (i % every) ? now - 3600 : now, i % 1000000)
+    printf("*4\r\n$4\r\nHSET\r\n$12\r\n<timestamps>\r\n$%d\r\n%s\r\n$%d\r\n%s\r\n", length(field), field, length(value), value)
+  }
+}' | redis-cli -p $PORT --pipe >/dev/null
+
+SHA=`redis script load "\`cat "$TMP/scan.lua"\`"`
+
+# Prints the calls and total time (us) of a command from the Redis server's command statistics.
+stats() {
+  redis info commandstats | tr -d '\r' | sed -n "s/^cmdstat_$1:calls=\([0-9]*\),usec=\([0-9]*\),.*/\1 \2/p"
+}
+
+echo "Selecting changed timestamps out of $TIMESTAMPS:"
+
+# ScanChanged(): the Lua script on the server
+redis config resetstat >/dev/null
+START=`date +%s.%N`
+CURSOR_ARG=0
+: > "$TMP/lua"
+while : ; do
+  redis evalsha $SHA 1 "<timestamps>" $CURSOR_ARG $CUTOFF "*" $LUA_SCAN_COUNT > "$TMP/reply"
+  CURSOR_ARG=`head -1 "$TMP/reply"`
+  tail -n +2 "$TMP/reply" >> "$TMP/lua"
+  [ "$CURSOR_ARG" = "0" ] && break
+done
+END=`date +%s.%N`
+set -- `stats evalsha`
+LUA_CALLS=$1
+LUA_USEC=$2
+LUA_WALL=`echo "$START $END" | awk '{ printf("%.3f", $2 - $1) }'`
+LUA_BYTES=`wc -c < "$TMP/lua"`
+LUA_N=$((`wc -l < "$TMP/lua"` / 2))
+
+# redisxScanTable(): HSCAN, with the filtering on the client
+redis config resetstat >/dev/null
+START=`date +%s.%N`
+CURSOR_ARG=0
+: > "$TMP/hscan"
+while : ; do
+  redis hscan "<timestamps>" $CURSOR_ARG match "*" count $REDIS_SCAN_COUNT > "$TMP/reply"
+  CURSOR_ARG=`head -1 "$TMP/reply"`
+  tail -n +2 "$TMP/reply" >> "$TMP/hscan"
+  [ "$CURSOR_ARG" = "0" ] && break
+done
+END=`date +%s.%N`
+set -- `stats hscan`
+HSCAN_CALLS=$1
+HSCAN_USEC=$2
+HSCAN_WALL=`echo "$START $END" | awk '{ printf("%.3f", $2 - $1) }'`
+HSCAN_BYTES=`wc -c < "$TMP/hscan"`
+HSCAN_N=$((`wc -l < "$TMP/hscan"` / 2))
+
+printf "  %-10s %6s calls, %8s us on server, %8s s wall, %7s entries (%9s bytes) sent\n" \
+  "Lua" "$LUA_CALLS" "$LUA_USEC" "$LUA_WALL" "$LUA_N" "$LUA_BYTES"
+printf "  %-10s %6s calls, %8s us on server, %8s s wall, %7s entries (%9s bytes) sent\n" \
+  "HSCAN" "$HSCAN_CALLS" "$HSCAN_USEC" "$HSCAN_WALL" "$HSCAN_N" "$HSCAN_BYTES"
+echo "  (wall times include starting one redis-cli per call)"
+
+# The Lua script must select exactly the timestamps that the client would select from HSCAN.
+paste - - < "$TMP/lua" | awk -v cutoff=$CUTOFF '$2 >= cutoff { print $1 }' | sort -u > "$TMP/lua.sel"
+paste - - < "$TMP/lua" | awk '{ print $1 }' | sort -u > "$TMP/lua.all"
+paste - - < "$TMP/hscan" | awk -v cutoff=$CUTOFF '$2 >= cutoff { print $1 }' | sort -u > "$TMP/hscan.sel"
+
+EXPECTED=$(((TIMESTAMPS + CHANGED_EVERY - 1) / CHANGED_EVERY))
+
+if ! cmp -s "$TMP/lua.all" "$TMP/lua.sel" || ! cmp -s "$TMP/lua.sel" "$TMP/hscan.sel" || [ `wc -l < "$TMP/lua.sel"` -ne $EXPECTED ] ; then
+  echo "FAILED: the Lua script did not select exactly the $EXPECTED changed timestamps."
+  exit 1
+fi
+
+echo "OK: the Lua script selected exactly the $EXPECTED changed timestamps."
+exit 0
@@ -0,0 +1,36 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A reference-counted bump allocator (arena), for objects that share a lifetime, such as the variables
+ *  grabbed in the same update cycle. Allocations are not thread-safe, but arenas may be retained and
+ *  released from any thread. All memory is freed in bulk when the last reference is released.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+/**
+ * Statistics on the arenas in use.
+ */
+typedef struct {
+  long arenas;                  ///< Number of arenas currently in use
+  long blocks;                  ///< Number of memory blocks currently held by arenas
+  long bytes;                   ///< (bytes) Memory currently held by arenas
+  long allocs;                  ///< Total number of allocations from arenas
+} arena_stats;
+
+Arena *arenaCreate(size_t blockSize);
+void *arenaAlloc(Arena *a, size_t size);
+char *arenaStrdup(Arena *a, const char *str);
+void arenaRetain(Arena *a);
+void arenaRelease(Arena *a);
+void getArenaStats(arena_stats *stats);
+
+#endif /* ARENA_H_ */
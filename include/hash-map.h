@@ -0,0 +1,33 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A simple string-keyed hash map, with open addressing. It is not thread-safe: callers that share a map
+ *  between threads must serialize access to it.
+ */
+
+#ifndef HASH_MAP_H_
+#define HASH_MAP_H_
+
+#include <stdint.h>
+#include <xchange.h>
+
+typedef struct HashMap HashMap;
+
+HashMap *hashMapCreate(int capacity);
+void hashMapDestroy(HashMap *map, void (*destroyValue)(void *));
+void hashMapClear(HashMap *map, void (*destroyValue)(void *));
+
+int hashMapPut(HashMap *map, const char *key, void *value, void **old);
+void *hashMapGet(const HashMap *map, const char *key);
+boolean hashMapContains(const HashMap *map, const char *key);
+void *hashMapRemove(HashMap *map, const char *key);
+
+int hashMapSize(const HashMap *map);
+int hashMapNext(const HashMap *map, int pos, const char **key, void **value);
+
+uint32_t hashString(const char *str);
+
+#endif /* HASH_MAP_H_ */
@@ -0,0 +1,30 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A global, thread-safe table of interned SMA-X variable IDs. Each distinct ID is stored only once, with its
+ *  hash precomputed, and a dense index that can be used to look up per-variable data in plain arrays. Interned
+ *  IDs are never freed, so references to them remain valid for the lifetime of the program.
+ */
+
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <stdint.h>
+
+/**
+ * An interned SMA-X variable ID.
+ */
+typedef struct InternedId {
+  const char *name;             ///< The interned ID string
+  uint32_t hash;                ///< The precomputed hash of the ID
+  int index;                    ///< Dense index of the ID (0-based, in the order of interning)
+} InternedId;
+
+const InternedId *internId(const char *id);
+const InternedId *findInternedId(const char *id);
+int getInternedCount();
+
+#endif /* INTERN_H_ */
@@ -10,6 +10,8 @@
 #ifndef SMAXLOGGER_H_
 #define SMAXLOGGER_H_
 
+#include <stdint.h>
+#include <time.h>
 #include <xchange.h>
 
 #define DEFAULT_SQL_SERVER    "localhost"     ///< The default host name / IP of the SQL server
@@ -36,8 +38,6 @@
 
 #define IDLE_STATE              "IDLE"    ///< systemd state to report when idle.
 
-#define CACHE_SIZE              200000    ///< Maximum number of cached table ids.
-
 #define CONNECT_RETRY_SECONDS   60        ///< Seconds between trying to reconnect to server
 #define CONNECT_RETRY_ATTEMPTS  60        ///< Number of retry attempts before giving up....
 
@@ -55,6 +55,15 @@
 #define DEFAULT_MAX_AGE     ( 90 * DAY )  ///< (s) Default value for the max age of variables to log
 #define DEFAULT_MAX_SIZE    1024      ///< (bytes) Default maximum binary data size of variables to log
 
+#define DEFAULT_BATCH_BYTES ( 16 * 1024 * 1024 )  ///< (bytes) Default maximum SQL command volume per batch transaction
+#define DEFAULT_BATCH_TIME  1.0       ///< (s) Default maximum time to keep a batch transaction open
+#define DEFAULT_COPY_MIN_ROWS 2       ///< Default minimum number of rows per table in a batch to insert via COPY
+#define DEFAULT_COALESCE_THRESHOLD 10000  ///< Default number of queued rows, above which to coalesce data
+#define DEFAULT_MAX_PREPARED  20000   ///< Default maximum number of prepared INSERT statements on the connection
+#define MAX_WRITER_THREADS    64      ///< Maximum number of SQL writer threads (and connections)
+#define MAX_GRAB_THREADS      64      ///< Maximum number of SMA-X grabber threads (and connections)
+#define DEFAULT_SPILL_FILE    "/var/tmp/smax-postgres.spill"  ///< Default file for spilling queued data to disk
+
 #ifndef TRUE
 #  define TRUE              1         ///< Boolean TRUE (1) if not already defined
 #endif
@@ -110,18 +119,78 @@ typedef struct {
   boolean force;                  ///< Whether the variable should be logged no matter what other settings.
   boolean exclude;                ///< Whether to exclude this variable from logging
   int sampling;                   ///< sampling step for array data (sampling every n values only)
+  boolean coalesce;               ///< Whether to keep only the latest queued data when the queue is backlogged
 } logger_properties;
 
+/**
+ * A configured group of SMA-X variables, which are grabbed on their own schedule.
+ */
+typedef struct group_config {
+  char *name;                     ///< Name of the group (for reporting)
+  char *pattern;                  ///< Pattern of the SMA-X variable IDs in the group
+  int updateInterval;             ///< (s) Interval of incremental updates, or -1 for snapshots only
+  int snapshotInterval;           ///< (s) Interval of snapshots, or -1 if no periodic snapshots
+  int priority;                   ///< Groups of higher priority are grabbed first when due at the same time
+  struct group_config *next;      ///< The next group in the list, or NULL
+} group_config;
+
+/**
+ * The method by which rows are inserted into the PostgreSQL database.
+ */
+typedef enum {
+  INSERT_SQL = 0,                 ///< Each row via an INSERT statement
+  INSERT_PREPARED,                ///< Rows via per-table prepared statements, with binary parameters
+  INSERT_COPY                     ///< Rows in batches, grouped by table, via binary COPY
+} insert_method;
+
+/**
+ * What to do with new data when the queue of data waiting to be inserted is full.
+ */
+typedef enum {
+  QUEUE_BLOCK = 0,                ///< Block the grabber until there is space in the queue
+  QUEUE_DROP_OLDEST,              ///< Drop the oldest data in the queue
+  QUEUE_DROP_OPTIONAL,            ///< Drop data for variables that are not logged always, and block for the rest
+  QUEUE_SPILL                     ///< Spill data to disk, and queue it again once the queue has drained
+} queue_overflow;
+
+/**
+ * How the logger finds the SMA-X variables that changed since the last update.
+ */
+typedef enum {
+  CAPTURE_SCAN = 0,               ///< Scan all SMA-X timestamps for changes in every update cycle
+  CAPTURE_NOTIFY,                 ///< Collect the variables that changed from SMA-X update notifications
+  CAPTURE_LUA                     ///< Select the variables that changed with a Lua script on the Redis server
+} change_capture;
+
+/**
+ * Statistics on the data queued for insertion into the PostgreSQL database.
+ */
+typedef struct {
+  long rows;                      ///< Number of variables currently queued
+  long bytes;                     ///< (bytes) Approximate memory used by the queued variables
+  long dropped;                   ///< Total number of variables dropped because the queue was full
+  long spilled;                   ///< Total number of variables spilled to disk because the queue was full
+  long spillRows;                 ///< Number of variables currently in the spill file
+  long coalesced;                 ///< Total number of variables replaced by newer data while queued
+} queue_stats;
+
 /**
  * Data for an SMA-X variable that is to be inserted into the PostgreSQL database
  */
 typedef struct Variable {
-  char *id;                       ///< SMA-X variable id
+  char *id;                       ///< SMA-X variable id (the interned string, which must not be freed)
+  const struct InternedId *interned; ///< The interned SMA-X variable id
   XField field;                   ///< SMA-X field data
   time_t updateTime;              ///< (s) UNIX time when variable was last updated in SMA-X
   time_t grabTime;                ///< (s) UNIX time when data was grabbed / or scheduled to be grabbed
   int sampling;                   ///< sampling step for array data (sampling every n values only)
   char *unit;                     ///< Physical unit name (if any)
+  boolean force;                  ///< Whether the variable is to be logged always
+  long queueBytes;                ///< (bytes) Memory counted against the queue limit while queued
+  boolean coalesce;               ///< Whether newer data may replace this data while queued, under backlog
+  void *pending;                  ///< Slot for newer data replacing this variable while queued, or NULL
+  boolean isRetried;              ///< Whether the variable is being inserted again, after its pipeline segment failed
+  struct Arena *arena;            ///< Arena holding the variable and its field name, or NULL if on the heap
   struct Variable *next;          ///< Pointer to the next Variable in the linked lisr, or NULL if no more
 } Variable;
 
@@ -130,12 +199,15 @@ typedef struct Variable {
 int initCollector();
 int setupDB(const char *name, const char *passwd);
 void destroyVariable(Variable *u);
+void deserializeVariable(Variable *u);
 void *SQLThread();
 
 int insertQueue(Variable *u);
+void getQueueStats(queue_stats *stats);
 
 int parseConfig(const char *filename);
 int isLogging(const char *id, double updateTime);
+boolean isLoggingWith(const logger_properties *p, double updateTime, time_t now);
 int getSampleCount(const Variable *u);
 
 const char *getSMAXServerAddress();
@@ -152,13 +224,38 @@ int setSQLAuth(const char *passwd);
 
 boolean isUseHyperTables();
 void setUseHyperTables(boolean value);
+boolean isTextPassThrough();
 
 int getUpdateInterval();
 int getSnapshotInterval();
 int getMaxLogSize();
 
+int getBatchRows();
+int getBatchBytes();
+double getBatchTime();
+insert_method getInsertMethod();
+int getCopyMinRows();
+int getMaxPrepared();
+int getPipelineDepth();
+int getWriterThreads();
+long getMaxQueueRows();
+long getMaxQueueBytes();
+queue_overflow getQueueOverflow();
+const char *getSpillFile();
+const char *getStatsTable();
+long getCoalesceThreshold();
+change_capture getChangeCapture();
+int getUnitsRefreshInterval();
+const group_config *getGroups();
+int getGrabThreads();
+const char *getSchemaCacheFile();
+
 logger_properties *getLogProperties(const char *id);
 
+char *printDouble(double value, char *dst);
+char *printFloat(float value, char *dst);
+char *printLong(int64_t value, char *dst);
+
 int deleteVars(const char *pattern);
 
 #if USE_SYSTEMD
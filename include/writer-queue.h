@@ -0,0 +1,37 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A lock-free, multi-producer, single-consumer queue of variables, for feeding an SQL writer. Producers
+ *  push onto a stack via an atomic compare-and-swap, and the consumer takes the entire stack in one atomic
+ *  swap, restoring the queue order before handing out the variables one by one.
+ */
+
+#ifndef WRITER_QUEUE_H_
+#define WRITER_QUEUE_H_
+
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include "smax-postgres.h"
+
+/**
+ * A queue of variables with multiple producers and a single consumer.
+ */
+typedef struct {
+  _Atomic(Variable *) incoming;   ///< Lock-free stack of queued variables, the most recently queued first
+  sem_t qAvailable;               ///< Posted when variables are pushed to an empty incoming stack
+  Variable *taken;                ///< Variables taken from the incoming stack, in queue order (consumer only)
+} WriterQueue;
+
+void initWriterQueue(WriterQueue *q);
+void pushWriterQueue(WriterQueue *q, Variable *u);
+Variable *takeWriterQueue(WriterQueue *q);
+int waitWriterQueue(WriterQueue *q, const struct timespec *deadline);
+void wakeWriterQueue(WriterQueue *q);
+boolean isWriterQueueEmpty(WriterQueue *q);
+
+#endif /* WRITER_QUEUE_H_ */
@@ -0,0 +1,206 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A reference-counted bump allocator (arena). Memory is handed out from large blocks, and freed only
+ *  when the last reference to the arena is released, so that many small objects with a common lifetime
+ *  cost a handful of malloc() / free() calls in total, instead of a pair each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#define __XCHANGE_INTERNAL_API__                          ///< Use internal definitions
+#include "smax-postgres.h"
+#include "arena.h"
+
+#define ARENA_ALIGN     alignof(max_align_t)              ///< Alignment of allocations from arenas
+
+/**
+ * A block of memory in an arena.
+ */
+typedef struct Block {
+  struct Block *next;           ///< The previously filled block, or NULL
+  size_t size;                  ///< (bytes) Usable size of the block
+  size_t used;                  ///< (bytes) Number of bytes used in the block
+  alignas(ARENA_ALIGN) char data[];  ///< The memory in the block
+} Block;
+
+/**
+ * A reference-counted bump allocator.
+ */
+struct Arena {
+  Block *current;               ///< The block currently being filled
+  size_t blockSize;             ///< (bytes) Usable size of regular blocks
+  atomic_int refs;              ///< Number of references to the arena
+};
+
+static atomic_long nArenas;     ///< Number of arenas in use
+static atomic_long nBlocks;     ///< Number of blocks held by arenas
+static atomic_long nBytes;      ///< (bytes) Memory held by arenas
+static atomic_long nAllocs;     ///< Total number of allocations from arenas
+
+
+/**
+ * Adds a new block to an arena, which becomes the block currently being filled.
+ *
+ * @param a       The arena
+ * @param size    (bytes) Minimum usable size of the block
+ */
+static void addBlock(Arena *a, size_t size) {
+  Block *b;
+
+  if(size < a->blockSize) size = a->blockSize;
+
+  b = (Block *) malloc(sizeof(Block) + size);
+  x_check_alloc(b);
+
+  b->size = size;
+  b->used = 0;
+  b->next = a->current;
+  a->current = b;
+
+  atomic_fetch_add(&nBlocks, 1);
+  atomic_fetch_add(&nBytes, (long) (sizeof(Block) + size));
+}
+
+
+/**
+ * Creates a new arena, with a single reference held by the caller.
+ *
+ * @param blockSize   (bytes) Usable size of the blocks from which memory is handed out.
+ * @return            The new arena.
+ *
+ * @sa arenaRelease()
+ */
+Arena *arenaCreate(size_t blockSize) {
+  Arena *a = (Arena *) calloc(1, sizeof(Arena));
+  x_check_alloc(a);
+
+  a->blockSize = blockSize;
+  atomic_init(&a->refs, 1);
+
+  addBlock(a, blockSize);
+
+  atomic_fetch_add(&nArenas, 1);
+
+  return a;
+}
+
+
+/**
+ * Allocates zeroed memory from an arena. The memory remains valid until the last reference to the
+ * arena is released. It is not thread-safe: only one thread should allocate from an arena at a time.
+ *
+ * @param a       The arena
+ * @param size    (bytes) Number of bytes to allocate
+ * @return        Pointer to the allocated memory, or NULL if the arena is NULL (errno is set to EINVAL).
+ */
+void *arenaAlloc(Arena *a, size_t size) {
+  Block *b;
+  void *ptr;
+
+  if(!a) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  b = a->current;
+  if(b->used + size > b->size) {
+    addBlock(a, size);
+    b = a->current;
+  }
+
+  ptr = &b->data[b->used];
+  b->used += size;
+
+  memset(ptr, 0, size);
+
+  atomic_fetch_add_explicit(&nAllocs, 1, memory_order_relaxed);
+
+  return ptr;
+}
+
+
+/**
+ * Copies a string into an arena.
+ *
+ * @param a       The arena
+ * @param str     The string to copy, or NULL.
+ * @return        The copy in the arena, or NULL if the string or the arena is NULL.
+ */
+char *arenaStrdup(Arena *a, const char *str) {
+  size_t n;
+  char *copy;
+
+  if(!str) return NULL;
+
+  n = strlen(str) + 1;
+  copy = (char *) arenaAlloc(a, n);
+  if(copy) memcpy(copy, str, n);
+  return copy;
+}
+
+
+/**
+ * Adds a reference to an arena, e.g. for each object allocated from it that has to be released
+ * separately.
+ *
+ * @param a       The arena
+ *
+ * @sa arenaRelease()
+ */
+void arenaRetain(Arena *a) {
+  if(a) atomic_fetch_add_explicit(&a->refs, 1, memory_order_relaxed);
+}
+
+
+/**
+ * Releases a reference to an arena. When the last reference is released, all the memory in the
+ * arena is freed.
+ *
+ * @param a       The arena
+ *
+ * @sa arenaRetain()
+ */
+void arenaRelease(Arena *a) {
+  Block *b;
+
+  if(!a) return;
+  if(atomic_fetch_sub_explicit(&a->refs, 1, memory_order_acq_rel) > 1) return;
+
+  for(b = a->current; b != NULL; ) {
+    Block *next = b->next;
+    atomic_fetch_sub(&nBlocks, 1);
+    atomic_fetch_sub(&nBytes, (long) (sizeof(Block) + b->size));
+    free(b);
+    b = next;
+  }
+
+  free(a);
+
+  atomic_fetch_sub(&nArenas, 1);
+}
+
+
+/**
+ * Returns statistics on the arenas in use.
+ *
+ * @param[out] stats    Pointer to the structure to populate.
+ */
+void getArenaStats(arena_stats *stats) {
+  if(!stats) return;
+
+  stats->arenas = atomic_load(&nArenas);
+  stats->blocks = atomic_load(&nBlocks);
+  stats->bytes = atomic_load(&nBytes);
+  stats->allocs = atomic_load(&nAllocs);
+}
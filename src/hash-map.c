@@ -0,0 +1,373 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A simple string-keyed hash map, with open addressing (linear probing), and backward-shift deletion
+ *  so that lookups never have to skip over deleted entries. Keys are copied into the map, while values
+ *  are stored by reference.
+ *
+ *  The slots are stored as separate arrays of hashes, keys, and values, so that probing scans a compact
+ *  array of hashes, and touches the keys only when the hashes match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define __XCHANGE_INTERNAL_API__                          ///< Use internal definitions
+#include "smax-postgres.h"
+#include "hash-map.h"
+
+#define HASH_MAP_MIN_CAPACITY   16        ///< Smallest number of slots in a hash map
+#define HASH_MAP_MAX_LOAD       0.7       ///< Maximum fraction of used slots before growing the map
+
+#define HASH_EMPTY              0         ///< The hash of empty slots, which no key hashes to
+
+/**
+ * A string-keyed hash map.
+ */
+struct HashMap {
+  uint32_t *hashes;             ///< The hashes of the keys in the slots, or HASH_EMPTY for empty slots
+  char **keys;                  ///< The keys (owned by the map) in the slots
+  void **values;                ///< The values stored in the slots
+  int capacity;                 ///< Number of slots (a power of 2)
+  int size;                     ///< Number of keys stored
+};
+
+
+/**
+ * Returns the 32-bit FNV-1a hash of a string.
+ *
+ * @param str     The string
+ * @return        The hash of the string.
+ */
+uint32_t hashString(const char *str) {
+  uint32_t hash = 2166136261U;
+
+  for(; *str; str++) {
+    hash ^= (unsigned char) *str;
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+
+/**
+ * Returns the hash under which a key is stored in a hash map, which is never HASH_EMPTY.
+ *
+ * @param key     The key
+ * @return        The hash of the key in the map.
+ */
+static uint32_t hashKey(const char *key) {
+  uint32_t hash = hashString(key);
+  return hash == HASH_EMPTY ? 1 : hash;
+}
+
+
+/**
+ * Allocates the slots of a hash map, all empty.
+ *
+ * @param map     The hash map
+ * @param n       The number of slots (a power of 2).
+ */
+static void allocSlots(HashMap *map, int n) {
+  map->hashes = (uint32_t *) calloc(n, sizeof(uint32_t));
+  x_check_alloc(map->hashes);
+
+  map->keys = (char **) calloc(n, sizeof(char *));
+  x_check_alloc(map->keys);
+
+  map->values = (void **) calloc(n, sizeof(void *));
+  x_check_alloc(map->values);
+
+  map->capacity = n;
+}
+
+
+/**
+ * Creates a new empty hash map.
+ *
+ * @param capacity    The number of keys the map should hold without having to grow.
+ * @return            A new hash map. It exits the program if it cannot allocate memory.
+ *
+ * @sa hashMapDestroy()
+ */
+HashMap *hashMapCreate(int capacity) {
+  HashMap *map = (HashMap *) calloc(1, sizeof(HashMap));
+  int n = HASH_MAP_MIN_CAPACITY;
+
+  x_check_alloc(map);
+
+  while(n * HASH_MAP_MAX_LOAD < capacity) n <<= 1;
+
+  allocSlots(map, n);
+  return map;
+}
+
+
+/**
+ * Removes all keys from a hash map.
+ *
+ * @param map           The hash map
+ * @param destroyValue  Function to call on each stored value (e.g. free), or NULL.
+ */
+void hashMapClear(HashMap *map, void (*destroyValue)(void *)) {
+  int i;
+
+  if(!map) return;
+
+  for(i = 0; i < map->capacity; i++) {
+    if(map->hashes[i] == HASH_EMPTY) continue;
+    if(destroyValue && map->values[i]) destroyValue(map->values[i]);
+    free(map->keys[i]);
+    map->hashes[i] = HASH_EMPTY;
+    map->keys[i] = NULL;
+    map->values[i] = NULL;
+  }
+
+  map->size = 0;
+}
+
+
+/**
+ * Destroys a hash map, freeing up all the resources it uses.
+ *
+ * @param map           The hash map
+ * @param destroyValue  Function to call on each stored value (e.g. free), or NULL.
+ *
+ * @sa hashMapCreate()
+ */
+void hashMapDestroy(HashMap *map, void (*destroyValue)(void *)) {
+  if(!map) return;
+
+  hashMapClear(map, destroyValue);
+  free(map->hashes);
+  free(map->keys);
+  free(map->values);
+  free(map);
+}
+
+
+/**
+ * Returns the slot in which a key is stored, or else the empty slot where it would be stored.
+ *
+ * @param map     The hash map
+ * @param key     The key
+ * @param hash    The hash of the key in the map
+ * @return        The index of the slot for the key.
+ *
+ * @sa hashKey()
+ */
+static int findSlot(const HashMap *map, const char *key, uint32_t hash) {
+  const int mask = map->capacity - 1;
+  int i;
+
+  for(i = hash & mask; map->hashes[i] != HASH_EMPTY; i = (i + 1) & mask)
+    if(map->hashes[i] == hash) if(strcmp(map->keys[i], key) == 0) break;
+
+  return i;
+}
+
+
+/**
+ * Doubles the number of slots in a hash map, placing all stored keys into the new slots.
+ *
+ * @param map     The hash map
+ */
+static void grow(HashMap *map) {
+  uint32_t *hashes = map->hashes;
+  char **keys = map->keys;
+  void **values = map->values;
+  int i, n = map->capacity;
+
+  allocSlots(map, n << 1);
+
+  for(i = 0; i < n; i++) if(hashes[i] != HASH_EMPTY) {
+    int k = findSlot(map, keys[i], hashes[i]);
+    map->hashes[k] = hashes[i];
+    map->keys[k] = keys[i];
+    map->values[k] = values[i];
+  }
+
+  free(hashes);
+  free(keys);
+  free(values);
+}
+
+
+/**
+ * Stores a value under a key in the hash map, replacing the prior value (if any).
+ *
+ * @param map           The hash map
+ * @param key           The key, which is copied into the map.
+ * @param value         The value to store under the key.
+ * @param[out] old      Optional pointer to where to return the prior value under the key (or NULL if
+ *                      the key is new). It may be NULL if not needed.
+ * @return              1 if the key was added, 0 if the value of an existing key was replaced, or else
+ *                      ERROR_RETURN (-1; errno will indicate the type of error).
+ */
+int hashMapPut(HashMap *map, const char *key, void *value, void **old) {
+  uint32_t hash;
+  int i;
+
+  if(old) *old = NULL;
+
+  if(!map || !key) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  hash = hashKey(key);
+  i = findSlot(map, key, hash);
+
+  if(map->hashes[i] != HASH_EMPTY) {
+    if(old) *old = map->values[i];
+    map->values[i] = value;
+    return 0;
+  }
+
+  if(map->size + 1 > map->capacity * HASH_MAP_MAX_LOAD) {
+    grow(map);
+    i = findSlot(map, key, hash);
+  }
+
+  map->keys[i] = strdup(key);
+  x_check_alloc(map->keys[i]);
+  map->values[i] = value;
+  map->hashes[i] = hash;
+  map->size++;
+
+  return 1;
+}
+
+
+/**
+ * Returns the value stored under a key in the hash map.
+ *
+ * @param map     The hash map
+ * @param key     The key
+ * @return        The value stored under the key, or NULL if the key is not in the map.
+ *
+ * @sa hashMapContains()
+ */
+void *hashMapGet(const HashMap *map, const char *key) {
+  if(!map || !key) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return map->values[findSlot(map, key, hashKey(key))];
+}
+
+
+/**
+ * Checks if a key is stored in the hash map.
+ *
+ * @param map     The hash map
+ * @param key     The key
+ * @return        TRUE (1) if the key is in the map, or else FALSE (0).
+ */
+boolean hashMapContains(const HashMap *map, const char *key) {
+  if(!map || !key) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  return map->hashes[findSlot(map, key, hashKey(key))] != HASH_EMPTY;
+}
+
+
+/**
+ * Removes a key from the hash map. The entries that follow in the same probing sequence are shifted
+ * back, so that no lookup has to skip over deleted entries.
+ *
+ * @param map     The hash map
+ * @param key     The key
+ * @return        The value that was stored under the key, or NULL if the key was not in the map.
+ */
+void *hashMapRemove(HashMap *map, const char *key) {
+  const int mask = map ? map->capacity - 1 : 0;
+  void *value;
+  int i, j;
+
+  if(!map || !key) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  i = findSlot(map, key, hashKey(key));
+  if(map->hashes[i] == HASH_EMPTY) return NULL;
+
+  value = map->values[i];
+  free(map->keys[i]);
+  map->size--;
+
+  for(j = (i + 1) & mask; map->hashes[j] != HASH_EMPTY; j = (j + 1) & mask) {
+    const int home = map->hashes[j] & mask;
+
+    // Move the entry back into the hole, unless its home slot lies (cyclically) within (i, j].
+    if(((j - home) & mask) >= ((j - i) & mask)) {
+      map->hashes[i] = map->hashes[j];
+      map->keys[i] = map->keys[j];
+      map->values[i] = map->values[j];
+      i = j;
+    }
+  }
+
+  map->hashes[i] = HASH_EMPTY;
+  map->keys[i] = NULL;
+  map->values[i] = NULL;
+
+  return value;
+}
+
+
+/**
+ * Returns the number of keys stored in the hash map.
+ *
+ * @param map     The hash map
+ * @return        The number of keys in the map, or 0 if the map is NULL.
+ */
+int hashMapSize(const HashMap *map) {
+  return map ? map->size : 0;
+}
+
+
+/**
+ * Iterates over the entries of the hash map, in no particular order. For example:
+ *
+ * ```c
+ *   const char *key;
+ *   void *value;
+ *   int pos = 0;
+ *
+ *   while((pos = hashMapNext(map, pos, &key, &value)) >= 0) {
+ *     ...
+ *   }
+ * ```
+ *
+ * The map must not be modified while iterating over it.
+ *
+ * @param map           The hash map
+ * @param pos           The iteration position, 0 for the first entry, or the value returned by the
+ *                      previous call.
+ * @param[out] key      Where to return the key of the next entry (it may be NULL if not needed).
+ * @param[out] value    Where to return the value of the next entry (it may be NULL if not needed).
+ * @return              The position from which to continue iterating, or -1 if there are no more entries.
+ */
+int hashMapNext(const HashMap *map, int pos, const char **key, void **value) {
+  if(!map || pos < 0) return -1;
+
+  for(; pos < map->capacity; pos++) {
+    if(map->hashes[pos] == HASH_EMPTY) continue;
+    if(key) *key = map->keys[pos];
+    if(value) *value = map->values[pos];
+    return pos + 1;
+  }
+
+  return -1;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A global, thread-safe table of interned SMA-X variable IDs, with open addressing (linear probing). Each
+ *  entry is allocated together with its string, and is never moved or freed, while the table of slots grows
+ *  as needed. Lookups of existing IDs take a shared lock only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define __XCHANGE_INTERNAL_API__                          ///< Use internal definitions
+#include "smax-postgres.h"
+#include "hash-map.h"
+#include "intern.h"
+
+#define INTERN_INITIAL_CAPACITY   65536   ///< Initial number of slots in the table (power of 2)
+#define INTERN_MAX_LOAD           0.7     ///< Maximum fraction of used slots before growing the table
+
+static InternedId **slots;      ///< {lock} The slots of the table, pointing to the interned IDs, or NULL if empty
+static int capacity;            ///< {lock} Number of slots in the table (power of 2)
+static int count;               ///< {lock} Number of interned IDs
+
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;  ///< Lock for accessing the table
+
+
+/**
+ * Returns the slot in which an ID is stored, or else the empty slot where it would be stored. The caller
+ * should hold the lock.
+ *
+ * @param id      The ID
+ * @param hash    The hash of the ID
+ * @return        The index of the slot for the ID.
+ */
+static int findSlot(const char *id, uint32_t hash) {
+  const int mask = capacity - 1;
+  int i;
+
+  for(i = hash & mask; slots[i]; i = (i + 1) & mask) {
+    const InternedId *e = slots[i];
+    if(e->hash == hash) if(strcmp(e->name, id) == 0) break;
+  }
+
+  return i;
+}
+
+
+/**
+ * Doubles the number of slots in the table (or creates it, if it does not exist yet). The caller should hold
+ * the write lock.
+ */
+static void grow() {
+  InternedId **old = slots;
+  int i, n = capacity;
+
+  capacity = n ? n << 1 : INTERN_INITIAL_CAPACITY;
+  slots = (InternedId **) calloc(capacity, sizeof(InternedId *));
+  x_check_alloc(slots);
+
+  for(i = 0; i < n; i++) if(old[i]) slots[findSlot(old[i]->name, old[i]->hash)] = old[i];
+
+  if(old) free(old);
+}
+
+
+/**
+ * Returns the interned ID, if the ID has been interned already.
+ *
+ * @param id      The SMA-X variable ID
+ * @return        The interned ID, or NULL if the ID has not been interned (or if it is NULL, in which case errno
+ *                is set to EINVAL).
+ *
+ * @sa internId()
+ */
+const InternedId *findInternedId(const char *id) {
+  const InternedId *e = NULL;
+
+  if(!id) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pthread_rwlock_rdlock(&lock);
+  if(slots) e = slots[findSlot(id, hashString(id))];
+  pthread_rwlock_unlock(&lock);
+
+  return e;
+}
+
+
+/**
+ * Interns an SMA-X variable ID, returning the single stable copy of it, which is shared by all callers.
+ *
+ * @param id      The SMA-X variable ID
+ * @return        The interned ID, or NULL if the ID is NULL (errno is set to EINVAL).
+ *
+ * @sa findInternedId()
+ */
+const InternedId *internId(const char *id) {
+  InternedId *e = NULL;
+  uint32_t hash;
+  size_t len;
+  int i;
+
+  if(!id) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  hash = hashString(id);
+
+  pthread_rwlock_rdlock(&lock);
+  if(slots) e = slots[findSlot(id, hash)];
+  pthread_rwlock_unlock(&lock);
+
+  if(e) return e;
+
+  pthread_rwlock_wrlock(&lock);
+
+  if(count + 1 > capacity * INTERN_MAX_LOAD) grow();
+
+  // Another thread may have interned it in the meantime.
+  i = findSlot(id, hash);
+  if(!slots[i]) {
+    len = strlen(id) + 1;
+
+    // The ID string is stored right after the entry.
+    e = (InternedId *) malloc(sizeof(InternedId) + len);
+    x_check_alloc(e);
+
+    memcpy((char *) (e + 1), id, len);
+    e->name = (const char *) (e + 1);
+    e->hash = hash;
+    e->index = count++;
+
+    slots[i] = e;
+  }
+  else e = slots[i];
+
+  pthread_rwlock_unlock(&lock);
+
+  return e;
+}
+
+
+/**
+ * Returns the number of interned IDs. Interned IDs have indices from 0 to one less than this number.
+ *
+ * @return    The number of interned IDs.
+ */
+int getInternedCount() {
+  int n;
+
+  pthread_rwlock_rdlock(&lock);
+  n = count;
+  pthread_rwlock_unlock(&lock);
+
+  return n;
+}
@@ -16,13 +16,13 @@
 #include <errno.h>
 #include <pthread.h>
 #include <fnmatch.h>
-#include <search.h>
 #include <ctype.h>
 
 #include "smax.h"
 #include "smax-postgres.h"
+#include "intern.h"
 
-#define LOOKUP_INITIAL_CAPACITY   65536   ///< Initial hashtable capacity
+#define LOOKUP_INITIAL_CAPACITY   65536   ///< Initial capacity of the logging properties by interned ID index
 
 #define MIN_AGE     ( 1 * DAY )   ///< (s) Provide slow updates for unchanging variable at least this long
 #define MIN_SIZE    8             ///< (bytes) Always log variable up to this size, no matter
@@ -37,11 +37,13 @@ typedef struct pattern_rule {
 static pattern_rule *excludes;
 static pattern_rule *force;
 static pattern_rule *samplings;
+static pattern_rule *coalesce;
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static struct hsearch_data lookup;
-static int capacity = 0, nVars = 0;
+static pthread_rwlock_t lookupLock = PTHREAD_RWLOCK_INITIALIZER; ///< Lock for the logging properties lookup
+static logger_properties **lookup;  ///< {lookupLock} Logging properties, by the index of the interned variable ID
+static int capacity = 0;            ///< {lookupLock} Capacity of the logging properties lookup
 
 static char *smaxServer;
 static char *sqlServer;
@@ -49,12 +51,33 @@ static char *dbName;
 static char *dbUser;
 static char *dbAuth;
 static boolean use_hyper_tables = FALSE;
+static boolean text_pass_through = FALSE;   ///< Whether to insert numerical values as SMA-X text, without parsing
 
 static int update_interval = MINUTE;    ///< (s) The rate of fast updates for changing variables (min. 1m).
 static int snapshot_interval = MINUTE;  ///< (s) The rate of snapshotting all variables (min. 1m).
 static int max_age = DEFAULT_MAX_AGE;   ///< (s) Maximum age of variable to log if not changing.
 static int max_size = DEFAULT_MAX_SIZE; ///< (bytes) Maximum byte size of variable to log
 
+static int batch_rows = 1;                      ///< Maximum number of rows to commit in a single transaction.
+static int batch_bytes = DEFAULT_BATCH_BYTES;   ///< (bytes) Maximum SQL command volume per batch transaction.
+static double batch_time = DEFAULT_BATCH_TIME;  ///< (s) Maximum time to keep a batch transaction open.
+static insert_method insert_with = INSERT_SQL;  ///< The method by which rows are inserted into the database.
+static int copy_min_rows = DEFAULT_COPY_MIN_ROWS; ///< Minimum number of rows for a table to insert via COPY.
+static int max_prepared = DEFAULT_MAX_PREPARED;   ///< Maximum number of prepared INSERT statements.
+static int pipeline_depth = 0;                    ///< Maximum number of rows in flight in pipeline mode (0: no pipeline).
+static int writer_threads = 1;                    ///< Number of SQL writer threads, each with its own connection.
+static long queue_rows = 0;                       ///< Maximum number of queued variables (0: unlimited).
+static long queue_bytes = 0;                      ///< (bytes) Maximum memory used by queued variables (0: unlimited).
+static queue_overflow overflow = QUEUE_BLOCK;     ///< What to do with new data when the queue is full.
+static char *spillFile;                           ///< File to which to spill queued data when the queue is full.
+static char *schemaCache;                         ///< File in which to cache the SQL table layouts between runs, or NULL.
+static char *statsTable;                          ///< SMA-X table in which to publish logger statistics.
+static long coalesce_threshold = DEFAULT_COALESCE_THRESHOLD; ///< Queued rows above which to coalesce data.
+static change_capture capture = CAPTURE_SCAN;     ///< How to find the variables that changed between updates.
+static group_config *groups;                      ///< Variable groups with their own schedules, in config order.
+static int grab_threads = 1;                      ///< Number of SMA-X grabber threads, each with its own connection.
+static int units_refresh = -1;                    ///< (s) Interval for refreshing cached physical units (<0: snapshots only).
+
 
 static void discardList(pattern_rule **list) {
   pattern_rule *r;
@@ -112,6 +135,55 @@ static pattern_rule *get_last_rule_for(const char *name, pattern_rule *list) {
   return NULL;
 }
 
+static void discardGroups() {
+  group_config *g = groups;
+
+  groups = NULL;
+
+  while(g) {
+    group_config *next = g->next;
+    free(g->name);
+    free(g->pattern);
+    free(g);
+    g = next;
+  }
+}
+
+static int add_group(const char *name, const char *pattern, double update, double snapshot, int priority) {
+  group_config *g, **last = &groups;
+
+  if(isnan(update) || isnan(snapshot)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  g = (group_config *) calloc(1, sizeof(group_config));
+  if(!g) {
+    perror("ERROR! alloc of new variable group");
+    exit(errno);
+  }
+
+  g->name = strdup(name);
+  g->pattern = strdup(pattern);
+  g->updateInterval = update >= 1.0 ? (int) round(update) : -1;
+  g->snapshotInterval = snapshot >= 1.0 ? (int) round(snapshot) : -1;
+  g->priority = priority;
+
+  if(g->updateInterval < 0 && g->snapshotInterval < 0) {
+    free(g->name);
+    free(g->pattern);
+    free(g);
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Keep groups in config order.
+  while(*last) last = &(*last)->next;
+  *last = g;
+
+  return 0;
+}
+
 static void lc(char *value) {
   if(!value) return;
 
@@ -168,6 +240,7 @@ int parseConfig(const char *filename) {
   }
 
   discardList(&excludes);
+  discardGroups();
 
   // Always exclude all temp tables and fields
   add_rule(&excludes, "_*", TRUE);
@@ -226,6 +299,14 @@ int parseConfig(const char *filename) {
       continue;
     }
 
+    if(strcmp("text_passthrough", option) == 0) {
+      lc(arg);
+      if(strcmp(arg, "true") == 0 || strcmp(arg, "1") == 0) text_pass_through = TRUE;
+      else if(strcmp(arg, "false") == 0 || strcmp(arg, "0") == 0) text_pass_through = FALSE;
+      else fprintf(stderr, "WARNING! [%s:%d] expected boolean, got: %s\n", filename, l, arg);
+      continue;
+    }
+
     if(strcmp("update_interval", option) == 0) {
       double t = parseTimeSpec(arg);
       if(isnan(t)) {
@@ -256,6 +337,41 @@ int parseConfig(const char *filename) {
       continue;
     }
 
+    if(strcmp("group", option) == 0) {
+      char name[64], pattern[1024], update[32], snapshot[32];
+      int priority = 0;
+
+      if(sscanf(arg, "%63s %1023s %31s %31s %d", name, pattern, update, snapshot, &priority) < 4) {
+        fprintf(stderr, "WARNING! [%s:%d] group: too few arguments\n", filename, l);
+        continue;
+      }
+
+      if(add_group(name, pattern, parseTimeSpec(update), parseTimeSpec(snapshot), priority) != 0)
+        fprintf(stderr, "WARNING! [%s:%d] group: invalid intervals: %s %s\n", filename, l, update, snapshot);
+      continue;
+    }
+
+    if(strcmp("grab_threads", option) == 0) {
+      int n;
+      if(sscanf(arg, "%d", &n) < 1 || n < 1 || n > MAX_GRAB_THREADS) {
+        fprintf(stderr, "WARNING! [%s:%d] grab_threads: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      grab_threads = n;
+      continue;
+    }
+
+    if(strcmp("units_refresh", option) == 0) {
+      double t = parseTimeSpec(arg);
+      if(isnan(t)) {
+        fprintf(stderr, "WARNING! [%s:%d] units_refresh: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+
+      units_refresh = t > 0.0 ? (int) round(t) : -1;
+      continue;
+    }
+
     if(strcmp("max_size", option) == 0) {
       int bytes;
       if(sscanf(arg, "%d", &bytes) < 1) {
@@ -285,6 +401,163 @@ int parseConfig(const char *filename) {
       continue;
     }
 
+    if(strcmp("batch_rows", option) == 0) {
+      int rows;
+      if(sscanf(arg, "%d", &rows) < 1 || rows < 1) {
+        fprintf(stderr, "WARNING! [%s:%d] batch_rows: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      batch_rows = rows;
+      continue;
+    }
+
+    if(strcmp("batch_bytes", option) == 0) {
+      int bytes;
+      if(sscanf(arg, "%d", &bytes) < 1 || bytes < 1) {
+        fprintf(stderr, "WARNING! [%s:%d] batch_bytes: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      batch_bytes = bytes;
+      continue;
+    }
+
+    if(strcmp("batch_time", option) == 0) {
+      double t = parseTimeSpec(arg);
+      if(isnan(t) || t <= 0.0) {
+        fprintf(stderr, "WARNING! [%s:%d] batch_time: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      batch_time = t;
+      continue;
+    }
+
+    if(strcmp("insert_method", option) == 0) {
+      char method[20] = {'\0'};
+      sscanf(arg, "%19s", method);
+      lc(method);
+      if(strcmp(method, "insert") == 0) insert_with = INSERT_SQL;
+      else if(strcmp(method, "prepared") == 0) insert_with = INSERT_PREPARED;
+      else if(strcmp(method, "copy") == 0) insert_with = INSERT_COPY;
+      else fprintf(stderr, "WARNING! [%s:%d] insert_method: invalid argument: %s\n", filename, l, arg);
+      continue;
+    }
+
+    if(strcmp("copy_min_rows", option) == 0) {
+      int rows;
+      if(sscanf(arg, "%d", &rows) < 1 || rows < 1) {
+        fprintf(stderr, "WARNING! [%s:%d] copy_min_rows: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      copy_min_rows = rows;
+      continue;
+    }
+
+    if(strcmp("max_prepared", option) == 0) {
+      int n;
+      if(sscanf(arg, "%d", &n) < 1 || n < 0) {
+        fprintf(stderr, "WARNING! [%s:%d] max_prepared: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      max_prepared = n;
+      continue;
+    }
+
+    if(strcmp("pipeline_depth", option) == 0) {
+      int n;
+      if(sscanf(arg, "%d", &n) < 1 || n < 0) {
+        fprintf(stderr, "WARNING! [%s:%d] pipeline_depth: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      pipeline_depth = n;
+      continue;
+    }
+
+    if(strcmp("writer_threads", option) == 0) {
+      int n;
+      if(sscanf(arg, "%d", &n) < 1 || n < 1 || n > MAX_WRITER_THREADS) {
+        fprintf(stderr, "WARNING! [%s:%d] writer_threads: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      writer_threads = n;
+      continue;
+    }
+
+    if(strcmp("queue_rows", option) == 0) {
+      long n;
+      if(sscanf(arg, "%ld", &n) < 1 || n < 0) {
+        fprintf(stderr, "WARNING! [%s:%d] queue_rows: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      queue_rows = n;
+      continue;
+    }
+
+    if(strcmp("queue_bytes", option) == 0) {
+      long bytes;
+      if(sscanf(arg, "%ld", &bytes) < 1 || bytes < 0) {
+        fprintf(stderr, "WARNING! [%s:%d] queue_bytes: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      queue_bytes = bytes;
+      continue;
+    }
+
+    if(strcmp("queue_overflow", option) == 0) {
+      char policy[20] = {'\0'};
+      sscanf(arg, "%19s", policy);
+      lc(policy);
+      if(strcmp(policy, "block") == 0) overflow = QUEUE_BLOCK;
+      else if(strcmp(policy, "drop-oldest") == 0) overflow = QUEUE_DROP_OLDEST;
+      else if(strcmp(policy, "drop-optional") == 0) overflow = QUEUE_DROP_OPTIONAL;
+      else if(strcmp(policy, "spill") == 0) overflow = QUEUE_SPILL;
+      else fprintf(stderr, "WARNING! [%s:%d] queue_overflow: invalid argument: %s\n", filename, l, arg);
+      continue;
+    }
+
+    if(strcmp("change_capture", option) == 0) {
+      char mode[20] = {'\0'};
+      sscanf(arg, "%19s", mode);
+      lc(mode);
+      if(strcmp(mode, "scan") == 0) capture = CAPTURE_SCAN;
+      else if(strcmp(mode, "notify") == 0) capture = CAPTURE_NOTIFY;
+      else if(strcmp(mode, "lua") == 0) capture = CAPTURE_LUA;
+      else fprintf(stderr, "WARNING! [%s:%d] change_capture: invalid argument: %s\n", filename, l, arg);
+      continue;
+    }
+
+    if(strcmp("spill_file", option) == 0) {
+      char path[1024] = {'\0'};
+      if(sscanf(arg, "%1023s", path) < 1) {
+        fprintf(stderr, "WARNING! [%s:%d] spill_file: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      if(spillFile) free(spillFile);
+      spillFile = strdup(path);
+      continue;
+    }
+
+    if(strcmp("schema_cache", option) == 0) {
+      char path[1024] = {'\0'};
+      if(sscanf(arg, "%1023s", path) < 1) {
+        fprintf(stderr, "WARNING! [%s:%d] schema_cache: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      if(schemaCache) free(schemaCache);
+      schemaCache = strcmp(path, "none") ? strdup(path) : NULL;
+      continue;
+    }
+
+    if(strcmp("stats_table", option) == 0) {
+      char table[256] = {'\0'};
+      if(sscanf(arg, "%255s", table) < 1) {
+        fprintf(stderr, "WARNING! [%s:%d] stats_table: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      if(statsTable) free(statsTable);
+      statsTable = strdup(table);
+      continue;
+    }
+
     if(strcmp("exclude", option) == 0) {
       add_rule(&excludes, arg, TRUE);
       continue;
@@ -300,6 +573,21 @@ int parseConfig(const char *filename) {
       continue;
     }
 
+    if(strcmp("coalesce", option) == 0) {
+      add_rule(&coalesce, arg, TRUE);
+      continue;
+    }
+
+    if(strcmp("coalesce_threshold", option) == 0) {
+      long n;
+      if(sscanf(arg, "%ld", &n) < 1 || n < 0) {
+        fprintf(stderr, "WARNING! [%s:%d] coalesce_threshold: invalid argument: %s\n", filename, l, arg);
+        continue;
+      }
+      coalesce_threshold = n;
+      continue;
+    }
+
     if(strcmp("sample", option) == 0) {
       char pattern[1024];
       int step;
@@ -321,7 +609,7 @@ int parseConfig(const char *filename) {
 
   fclose(f);
 
-  if(update_interval < 0 && snapshot_interval < 0) {
+  if(!groups && update_interval < 0 && snapshot_interval < 0) {
     fprintf(stderr, "ERROR! Both updates and snapshots are disabled. Nothing to do.\n");
     exit(1);
   }
@@ -350,53 +638,67 @@ int getSampleCount(const Variable *u) {
   return (n + u->sampling - 1) / u->sampling;
 }
 
-static logger_properties *add_properties_for(const char *id) {
-  ENTRY e, *found = NULL;
-  logger_properties *p;
+/**
+ * Evaluates the configured rules for a variable, and adds the resulting logging properties to the
+ * lookup. The lookup is indexed by the interned variable IDs, so it grows simply by extending it,
+ * keeping all properties that were cached before.
+ *
+ * @param id    The interned SMA-X variable ID
+ * @return      The logging properties for the variable.
+ */
+static logger_properties *add_properties_for(const InternedId *id) {
+  logger_properties *p, *added;
   const pattern_rule *r;
 
-  if(!id) {
-    errno = EINVAL;
-    return NULL;
-  }
-
   p = (logger_properties *) calloc(1, sizeof(*p));
   if(!p) {
     perror("ERROR! alloc of logger properties");
     exit(errno);
   }
 
-  r = get_last_rule_for(id, samplings);
+  r = get_last_rule_for(id->name, samplings);
   if(r) p->sampling = r->ival;
   else p->sampling = 1;
 
-  r = get_last_rule_for(id, force);
+  r = get_last_rule_for(id->name, force);
   if(r) p->force = r->ival ? TRUE : FALSE;
 
+  r = get_last_rule_for(id->name, coalesce);
+  if(r) p->coalesce = r->ival ? TRUE : FALSE;
+
   if(!p->force) {
-    r = get_last_rule_for(id, excludes);
+    r = get_last_rule_for(id->name, excludes);
     if(r) p->exclude = r->ival;
   }
 
-  if(++nVars >= capacity) {
-    hdestroy_r(&lookup);
-    capacity <<= 1;
-    if(!hcreate_r(capacity, &lookup)) {
+  pthread_rwlock_wrlock(&lookupLock);
+
+  if(id->index >= capacity) {
+    int n = capacity ? capacity : LOOKUP_INITIAL_CAPACITY;
+    logger_properties **old = lookup;
+
+    while(n <= id->index) n <<= 1;
+
+    lookup = (logger_properties **) realloc(lookup, n * sizeof(logger_properties *));
+    if(!lookup) {
       perror("ERROR! realloc variable properties dictionary");
+      free(old);
       exit(errno);
     }
+
+    memset(&lookup[capacity], 0, (n - capacity) * sizeof(logger_properties *));
+    capacity = n;
   }
 
-  e.key = strdup(id);
-  e.data = p;
+  // Another thread may have added the same variable in the meantime.
+  added = lookup[id->index];
+  if(!added) added = lookup[id->index] = p;
 
-  if(!hsearch_r(e, ENTER, &found, &lookup)) {
-    perror("WARNING! could not add properties to lookup");
-  }
+  pthread_rwlock_unlock(&lookupLock);
 
-  hsearch_r(e, FIND, &found, &lookup);
+  if(added != p) free(p);
 
-  return (logger_properties *) found->data;
+  return added;
 }
 
 /**
@@ -407,15 +709,45 @@ static logger_properties *add_properties_for(const char *id) {
  *              or if the id was NULL (errno will be set to EINVAL in case of the latter).
  */
 logger_properties *getLogProperties(const char *id) {
-  ENTRY e = {}, *found = NULL;
+  const InternedId *iid;
+  logger_properties *p;
 
   if(!id) {
     errno = EINVAL;
     return NULL;
   }
 
-  e.key = (char *) id;
-  return hsearch_r(e, FIND, &found, &lookup) ? (logger_properties *) found->data : add_properties_for(id);
+  iid = internId(id);
+
+  pthread_rwlock_rdlock(&lookupLock);
+  p = iid->index < capacity ? lookup[iid->index] : NULL;
+  pthread_rwlock_unlock(&lookupLock);
+
+  return p ? p : add_properties_for(iid);
+}
+
+
+/**
+ * Checks if a variable with the given logging properties is to be logged into the SQL database. Callers that
+ * keep the properties of variables between updates can use it to avoid looking up the properties by name.
+ *
+ * @param p           The logging properties of the SMA-X variable.
+ * @param updateTime  (s) UNIX timestamp when the variable was last updated in the SMA-X database.
+ * @param now         (s) The current UNIX time.
+ * @return            TRUE (1) if the variable should be logged into the SQL database, or else FALSE (0)
+ *
+ * @sa isLogging()
+ * @sa getLogProperties()
+ */
+boolean isLoggingWith(const logger_properties *p, double updateTime, time_t now) {
+  if(!p) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  if(p->force) return TRUE;
+  if(updateTime + max_age < now) return FALSE;
+  return !p->exclude;
 }
 
 
@@ -425,29 +757,16 @@ logger_properties *getLogProperties(const char *id) {
  * @param id          The aggregate name/ID of the SMA-X variable
  * @param updateTime  (s) UNIX timestamp when the variable was last updated in the SMA-X database.
  * @return            TRUE (1) if the variable should be logged into the SQL database, or else FALSE (0)
+ *
+ * @sa isLoggingWith()
  */
 boolean isLogging(const char *id, double updateTime) {
-  const logger_properties *p;
-  const time_t now = time(NULL);
-
   if(!id) {
     errno = EINVAL;
     return FALSE;
   }
 
-  if(!capacity) {
-    if(!hcreate_r(LOOKUP_INITIAL_CAPACITY, &lookup)) {
-      perror("ERROR! alloc variable properties dictionary");
-      exit(errno);
-    }
-    capacity = LOOKUP_INITIAL_CAPACITY;
-  }
-
-  p = getLogProperties(id);
-
-  if(p->force) return TRUE;
-  if(updateTime + max_age < now) return FALSE;
-  return !p->exclude;
+  return isLoggingWith(getLogProperties(id), updateTime, time(NULL));
 }
 
 /**
@@ -664,3 +983,246 @@ int getUpdateInterval() {
 int getSnapshotInterval() {
   return snapshot_interval;
 }
+
+/**
+ * Returns the maximum number of rows that may be committed to the SQL database in a single transaction.
+ * Rows from the same grab cycle are committed together, up to this many rows at a time. A value of 1
+ * means that every row is committed in its own transaction.
+ *
+ * @return    the maximum number of rows per batch transaction (&gt;= 1).
+ *
+ * @sa getBatchBytes()
+ * @sa getBatchTime()
+ */
+int getBatchRows() {
+  return batch_rows;
+}
+
+/**
+ * Returns the maximum SQL command volume that may be sent in a single batch transaction, before it
+ * is committed.
+ *
+ * @return    (bytes) the maximum SQL command volume per batch transaction.
+ *
+ * @sa getBatchRows()
+ */
+int getBatchBytes() {
+  return batch_bytes;
+}
+
+/**
+ * Returns the maximum time for which a batch transaction may be kept open, including the time spent
+ * waiting for more rows from the same grab cycle.
+ *
+ * @return    (s) the maximum time a batch transaction is kept open.
+ *
+ * @sa getBatchRows()
+ */
+double getBatchTime() {
+  return batch_time;
+}
+
+/**
+ * Returns the method by which rows are inserted into the SQL database.
+ *
+ * @return    the configured insert method, e.g. INSERT_COPY.
+ *
+ * @sa getCopyMinRows()
+ * @sa getMaxPrepared()
+ */
+insert_method getInsertMethod() {
+  return insert_with;
+}
+
+/**
+ * Returns the minimum number of rows that a table must have in a batch for these to be inserted via a
+ * single COPY, when rows are inserted via the INSERT_COPY method. Tables with fewer rows in the batch
+ * are inserted via regular INSERT statements.
+ *
+ * @return    the minimum number of rows in a batch to insert into a table via COPY.
+ *
+ * @sa getInsertMethod()
+ */
+int getCopyMinRows() {
+  return copy_min_rows;
+}
+
+/**
+ * Returns the maximum number of prepared INSERT statements that may be kept on the database connection,
+ * when rows are inserted via the INSERT_PREPARED or INSERT_COPY methods. Tables beyond that limit are
+ * inserted via unnamed parametrized statements, which have to be parsed each time.
+ *
+ * @return    the maximum number of prepared INSERT statements.
+ *
+ * @sa getInsertMethod()
+ */
+int getMaxPrepared() {
+  return max_prepared;
+}
+
+/**
+ * Returns the maximum number of rows that may be sent to the database in pipeline mode before waiting
+ * for their results. Pipeline mode is not used when the value is 0, or when rows are inserted via the
+ * INSERT_COPY method.
+ *
+ * @return    the maximum number of rows in flight in pipeline mode, or 0 if pipeline mode is disabled.
+ *
+ * @sa getBatchRows()
+ */
+int getPipelineDepth() {
+  return pipeline_depth;
+}
+
+/**
+ * Returns the number of SQL writer threads, each with its own database connection. The data for any
+ * one variable is always inserted by the same writer.
+ *
+ * @return    the number of SQL writer threads (1 or more).
+ */
+int getWriterThreads() {
+  return writer_threads;
+}
+
+/**
+ * Returns the maximum number of variables that may be queued for insertion into the database, before
+ * the overflow policy applies.
+ *
+ * @return    the maximum number of queued variables, or 0 if unlimited.
+ *
+ * @sa getMaxQueueBytes()
+ * @sa getQueueOverflow()
+ */
+long getMaxQueueRows() {
+  return queue_rows;
+}
+
+/**
+ * Returns the maximum memory that variables queued for insertion into the database may use, before
+ * the overflow policy applies.
+ *
+ * @return    (bytes) the maximum memory used by queued variables, or 0 if unlimited.
+ *
+ * @sa getMaxQueueRows()
+ * @sa getQueueOverflow()
+ */
+long getMaxQueueBytes() {
+  return queue_bytes;
+}
+
+/**
+ * Returns what is done with new data when the queue of data waiting to be inserted into the database
+ * is full.
+ *
+ * @return    the queue overflow policy, e.g. QUEUE_BLOCK.
+ *
+ * @sa getMaxQueueRows()
+ * @sa getMaxQueueBytes()
+ * @sa getSpillFile()
+ */
+queue_overflow getQueueOverflow() {
+  return overflow;
+}
+
+/**
+ * Returns the file to which queued data is spilled when the queue is full, with the QUEUE_SPILL overflow
+ * policy.
+ *
+ * @return    the path to the spill file.
+ *
+ * @sa getQueueOverflow()
+ */
+const char *getSpillFile() {
+  return spillFile ? spillFile : DEFAULT_SPILL_FILE;
+}
+
+/**
+ * Returns the SMA-X table, in which the logger publishes its statistics (such as the queue depth), if
+ * any.
+ *
+ * @return    the SMA-X table name for publishing statistics, or NULL if not publishing statistics.
+ */
+const char *getStatsTable() {
+  return statsTable;
+}
+
+/**
+ * Returns the number of queued variables, above which new data for variables selected by `coalesce`
+ * patterns replaces the data for the same variable that is still waiting in the queue.
+ *
+ * @return    the number of queued variables above which to coalesce data.
+ *
+ * @sa getMaxQueueRows()
+ */
+long getCoalesceThreshold() {
+  return coalesce_threshold;
+}
+
+/**
+ * Checks whether numerical values are inserted into the database as the text that SMA-X serialized them
+ * to (after validation), rather than parsing them into binary first and printing them back to text. It
+ * applies to `insert_method insert` only, since the other methods send binary values.
+ *
+ * @return    TRUE (1) if numerical values are passed through as text, or else FALSE (0).
+ */
+boolean isTextPassThrough() {
+  return text_pass_through && insert_with == INSERT_SQL;
+}
+
+/**
+ * Returns how the logger finds the SMA-X variables that changed between incremental updates.
+ *
+ * @return    CAPTURE_SCAN if scanning all SMA-X timestamps in every update cycle, CAPTURE_NOTIFY
+ *            if collecting changed variables from SMA-X update notifications, or CAPTURE_LUA if
+ *            selecting changed variables with a Lua script on the Redis server.
+ */
+change_capture getChangeCapture() {
+  return capture;
+}
+
+/**
+ * Returns the interval at which the cached physical units of variables are refreshed from SMA-X, in
+ * addition to refreshing them with every snapshot.
+ *
+ * @return    (s) the units refresh interval, or -1 if units are refreshed with snapshots only.
+ *
+ * @sa getSnapshotInterval()
+ */
+int getUnitsRefreshInterval() {
+  return units_refresh;
+}
+
+/**
+ * Returns the configured variable groups, each of which is grabbed on its own schedule. If no groups are
+ * configured, all variables are grabbed together, at the global update and snapshot intervals.
+ *
+ * @return    the list of configured variable groups, in config order, or NULL if none were configured.
+ *
+ * @sa getUpdateInterval()
+ * @sa getSnapshotInterval()
+ */
+const group_config *getGroups() {
+  return groups;
+}
+
+/**
+ * Returns the number of SMA-X grabber threads, each with its own Redis connection. The data for the
+ * variables of any one SMA-X table is always pulled by the same grabber.
+ *
+ * @return    the number of SMA-X grabber threads (1 or more).
+ *
+ * @sa getWriterThreads()
+ */
+int getGrabThreads() {
+  return grab_threads;
+}
+
+/**
+ * Returns the file in which the layouts and last metadata of the SQL tables are cached between runs, if
+ * any. When the cache file matches the database at startup, the tables are not queried from the database
+ * at all.
+ *
+ * @return    the path to the schema cache file, or NULL if the schema is not cached.
+ */
+const char *getSchemaCacheFile() {
+  return schemaCache;
+}
@@ -15,14 +15,18 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
+#include <endian.h>
 #include <ctype.h>
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <semaphore.h>
-#include <search.h>
 #include <fnmatch.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <popt.h>
 #include <libpq-fe.h>
 
@@ -32,6 +36,9 @@
 
 #define __XCHANGE_INTERNAL_API__                          ///< Use internal definitions
 #include "smax-postgres.h"
+#include "hash-map.h"
+#include "intern.h"
+#include "writer-queue.h"
 
 #ifndef FIX_SCALAR_DIMS
 #  define FIX_SCALAR_DIMS       0                         ///< Whether singled-element 1D data should be stored as scalars
@@ -41,6 +48,8 @@
 #include "sql-types.h"
 
 #define MIN_CMD_SIZE            16384                     ///< (bytes) Initial size of the command buffer
+#define MIN_INDEXED             65536                     ///< Initial capacity of the table descriptors by index
+#define MIN_CACHED              65536                     ///< Initial capacity of the table descriptors by variable ID
 
 #define MASTER_TABLE            "titles"                  ///< table name in which to store variable name -> id pairings
 #define VARNAME_ID              "name"                    ///< column name/id for variable names
@@ -54,6 +63,35 @@
 
 #define COL_NAME_STEM           "c"                       ///< prefix for array data columns
 
+/// SQL expression for the data table name of the table index `tid`, consistent with TABLE_NAME_PATTERN
+#define SQL_TABLE_NAME(tid)     "'var_' || repeat('0', 6 - length(" tid "::text)) || " tid
+
+/// Query for the data column layout of tables, one row per table: variable ID, table index, space-separated column
+/// names starting with the first data column, the SQL type of the first data column (NULL if none), and whether
+/// there is a metadata table. It may be followed by a WHERE clause on the table index (t.tid), and should be
+/// completed by SQL_TABLE_LAYOUT_GROUPING.
+#define SQL_TABLE_LAYOUT \
+  "SELECT t." VARNAME_ID ", t.tid, " \
+  "string_agg(a.attname::text, ' ' ORDER BY a.attnum) FILTER (WHERE a.attnum >= d.attnum), " \
+  "format_type(d.atttypid, -1), m.oid IS NOT NULL " \
+  "FROM " MASTER_TABLE " t " \
+  "JOIN pg_class c ON c.relname = " SQL_TABLE_NAME("t.tid") " AND c.relkind IN ('r', 'p') AND pg_table_is_visible(c.oid) " \
+  "JOIN pg_attribute a ON a.attrelid = c.oid AND a.attnum > 0 AND NOT a.attisdropped " \
+  "LEFT JOIN LATERAL (SELECT attnum, atttypid FROM pg_attribute WHERE attrelid = c.oid AND attnum > 0 " \
+  "AND NOT attisdropped AND attname LIKE '" COL_NAME_STEM "0%' ORDER BY attnum LIMIT 1) d ON TRUE " \
+  "LEFT JOIN pg_class m ON m.relname = c.relname || '_meta' AND m.relnamespace = c.relnamespace "
+
+/// Grouping and ordering (by table index) of the table layout query.
+#define SQL_TABLE_LAYOUT_GROUPING \
+  "GROUP BY t." VARNAME_ID ", t.tid, d.attnum, d.atttypid, m.oid ORDER BY t.tid"
+
+#define SCHEMA_COUNTER          "schema_changes"          ///< SQL sequence advanced before tables layouts or metadata change
+#define SCHEMA_CACHE_MAGIC      "SMAXPGS1"                ///< Identifies schema cache files (and their format version)
+
+#define LOADER_CURSOR           "layouts"                 ///< Name of the cursor for streaming the table layouts in the background
+#define LOADER_FETCH_SIZE       1000                      ///< Number of tables the background loader fetches at a time
+#define SHUTDOWN_TIMEOUT        10.0                      ///< (s) Maximum time to wait for writers to close their connections at exit
+
 #define SQL_TYPE_LEN            64                        ///< (bytes) Maximum length of SQL data type names
 #define SQL_TABLE_NAME_LEN      32                        ///< (bytes) Maximum length for table names
 #define SQL_COL_NAME_LEN        32                        ///< (bytes) Maximum length for column names
@@ -61,6 +99,25 @@
 
 #define SQL_SEP                 ", "                      ///< List separator
 
+#define POSTGRES_EPOCH          946684800                 ///< (s) UNIX time of the PostgreSQL epoch (2000-01-01 00:00:00 UTC)
+
+#define INSERT_STMT_PATTERN     "ins_%06d"                ///< pattern for the names of prepared INSERT statements
+
+#define PG_BOOL_OID             16                        ///< PostgreSQL type OID for BOOLEAN
+#define PG_INT8_OID             20                        ///< PostgreSQL type OID for BIGINT
+#define PG_INT2_OID             21                        ///< PostgreSQL type OID for SMALLINT
+#define PG_INT4_OID             23                        ///< PostgreSQL type OID for INTEGER
+#define PG_TEXT_OID             25                        ///< PostgreSQL type OID for TEXT
+#define PG_FLOAT4_OID           700                       ///< PostgreSQL type OID for REAL
+#define PG_FLOAT8_OID           701                       ///< PostgreSQL type OID for DOUBLE PRECISION
+#define PG_TIMESTAMPTZ_OID      1184                      ///< PostgreSQL type OID for TIMESTAMPTZ
+
+#define ROW_SAVEPOINT           "row"                     ///< Savepoint name for isolating rows inside batch transactions
+#define FIX_SAVEPOINT           "fix"                     ///< Savepoint name for isolating column name fixes at startup
+#define SMAX_SEPARATORS         " \t\r\n,"                ///< Separators between serialized SMA-X array elements
+
+#define PENDING_QUEUED          ((uintptr_t) 1)           ///< Tag bit for pending data that is itself in the queue
+
 /**
  * Locally cached information of the current set of SQL variables stored
  *
@@ -77,14 +134,217 @@ typedef struct {
   int ndim;                     ///< array dimensions (may be 0 for scalars)
   int sizes[X_MAX_DIMS];        ///< array sizes along each dimension
   char unit[META_UNIT_LEN];     ///< physical unit in which data is expressed
+
+  boolean isPrepared;           ///< Whether there is a prepared INSERT statement for the table
+
+  atomic_int isLoaded;          ///< Whether the column layout and metadata above are loaded (else, only id and index)
+  atomic_int isRequested;       ///< Whether the background loader was asked to load the table ahead of others
+
+  atomic_uintptr_t pending;     ///< Latest data for the table awaiting insertion when coalescing (tagged with
+                                ///< PENDING_QUEUED if it is the variable in the queue), or 0.
 } TableDescriptor;
 
 
+/**
+ * Parameters for executing parametrized SQL statements, with values in binary format.
+ */
+typedef struct {
+  char *data;                     ///< Buffer containing the binary parameter values
+  int size;                       ///< (bytes) Allocated size of the data buffer
+  const char **values;            ///< Pointers to the parameter values in the data buffer (NULL for SQL NULL)
+  int *lengths;                   ///< (bytes) Lengths of the parameter values
+  int *formats;                   ///< Parameter formats (1 for binary)
+  Oid *types;                     ///< PostgreSQL type OIDs of the parameters
+  int capacity;                   ///< Number of parameters that can be stored
+  int n;                          ///< Number of parameters currently set
+} SQLParams;
+
+
+/**
+ * A row of data waiting to be inserted when the current batch is committed.
+ */
+typedef struct {
+  Variable *var;                  ///< The variable containing the data
+  TableDescriptor *table;         ///< The table into which to insert the data
+  int seq;                        ///< Sequence number of the row in the batch
+} PendingRow;
+
+
+/**
+ * State of the batch transaction, in which rows from the same grab cycle are committed together.
+ */
+typedef struct {
+  boolean isOpen;                 ///< Whether a batch transaction is currently open
+  time_t grabTime;                ///< (s) UNIX time of the grab cycle to which the batch belongs
+  int rows;                       ///< Number of rows added in the current batch
+  long bytes;                     ///< (bytes) SQL command volume sent in the current batch
+  struct timespec deadline;       ///< Time by which the current batch should be committed
+  TableDescriptor **metaTables;   ///< Tables whose metadata was updated in the current batch
+  int nMeta;                      ///< Number of tables whose metadata was updated in the current batch
+  int metaCapacity;               ///< Number of table entries that can be stored in metaTables
+  PendingRow *pending;            ///< Rows to insert, grouped by table, when the batch is committed
+  int nPending;                   ///< Number of rows pending in the current batch
+  int pendingCapacity;            ///< Number of rows that can be stored in pending
+} BatchState;
+
+
+/**
+ * A row of data sent in pipeline mode, whose results are yet to be processed.
+ */
+typedef struct {
+  Variable *var;                  ///< The variable containing the data
+  TableDescriptor *table;         ///< The table into which the data is inserted
+  boolean hasMeta;                ///< Whether new metadata was sent along with the row
+  boolean failed;                 ///< Whether the row failed to insert
+} PipelineRow;
+
+
+/**
+ * A statement sent in pipeline mode, whose result is yet to be processed.
+ */
+typedef struct {
+  int row;                        ///< Index of the pipeline row to which the statement belongs
+  TableDescriptor *prepared;      ///< The table whose INSERT is prepared by the statement, or NULL
+} PipelineStatement;
+
+
+/**
+ * A sequence of statements in the pipeline, ending with a sync point, which are executed in a single
+ * (implicit) transaction.
+ */
+typedef struct {
+  int endRow;                     ///< Index after the last row in the segment
+  int endStatement;               ///< Index after the last statement in the segment
+  boolean isBatch;                ///< Whether the rows in the segment were sent as a batch
+} PipelineSegment;
+
+
+/**
+ * State of the pipeline, in which statements are sent to the database without waiting for their
+ * results.
+ */
+typedef struct {
+  boolean isActive;               ///< Whether the connection is in pipeline mode
+  PipelineRow *rows;              ///< Rows sent, whose results have not been processed yet
+  int nRows;                      ///< Number of rows in flight
+  int rowCapacity;                ///< Number of rows that can be stored in rows
+  PipelineStatement *statements;  ///< Statements sent, whose results have not been processed yet
+  int nStatements;                ///< Number of statements in flight
+  int statementCapacity;          ///< Number of statements that can be stored in statements
+  PipelineSegment *segments;      ///< Segments sent, whose results have not been processed yet
+  int nSegments;                  ///< Number of segments in flight
+  int segmentCapacity;            ///< Number of segments that can be stored in segments
+  struct timespec deadline;       ///< Time by which to process the results of the segments in flight
+  Variable *retryFirst;           ///< First of the variables to insert again, after their batch failed
+  Variable *retryLast;            ///< Last of the variables to insert again, after their batch failed
+} PipelineState;
+
+
+/**
+ * A writer in the pool of SQL writers. Each writer has its own thread, queue, and database connection,
+ * and inserts the data for a subset of the tables, so that the rows for any one table are always
+ * inserted in order, by the same writer.
+ */
+typedef struct {
+  int index;                      ///< Index of the writer in the pool
+  pthread_t thread;               ///< The thread in which the writer runs
+  WriterQueue queue;              ///< The queue of variables for the writer to insert
+  atomic_int isRunning;           ///< Whether the writer is processing its queue
+  sem_t stopped;                  ///< Posted when the writer has closed its connection at shutdown
+} Writer;
+
+
+/**
+ * Counters for the data queued between the SMA-X grabber and the SQL writers.
+ */
+typedef struct {
+  atomic_long rows;               ///< Number of variables in the queues
+  atomic_long bytes;              ///< (bytes) Approximate memory used by the variables in the queues
+  atomic_long dropped;            ///< Number of variables dropped because the queue was full
+  atomic_long spilled;            ///< Number of variables spilled to disk because the queue was full
+  atomic_long spillRows;          ///< Number of variables in the spill file, waiting to be queued again
+  atomic_long coalesced;          ///< Number of variables replaced by newer data while queued
+} QueueCounters;
+
+
+/**
+ * The spill file, to which variables are written when the queue is full, to be queued again once the
+ * queue has drained.
+ */
+typedef struct {
+  pthread_mutex_t mutex;          ///< mutex for accessing the spill file
+  FILE *fp;                       ///< {mut} The spill file, or NULL if not opened yet
+  long readPos;                   ///< {mut} (bytes) Position of the next spilled record to read
+  char *buf;                      ///< {mut} Buffer for assembling or parsing spilled records
+  long size;                      ///< {mut} (bytes) Allocated size of the buffer
+} SpillState;
+
+
+/**
+ * The background loader of the column layouts and last metadata of the tables, which are not loaded
+ * at startup.
+ */
+typedef struct {
+  pthread_mutex_t mutex;          ///< mutex for the loader state and for setting table layouts
+  pthread_t thread;               ///< The background loader thread
+  atomic_int isRunning;           ///< Whether the background loader is (still) running
+  TableDescriptor **requested;    ///< {mut} Tables to load ahead of the others
+  int nRequested;                 ///< {mut} Number of tables to load ahead of the others
+  int capacity;                   ///< {mut} Capacity for tables to load ahead of the others
+  int loaded;                     ///< {mut} Number of tables loaded
+} LoaderState;
+
+
+/**
+ * The fingerprint of the database schema, by which to validate the schema cache file.
+ */
+typedef struct {
+  int64_t maxTid;                 ///< The largest table index in the titles
+  int64_t changes;                ///< The value of the schema change counter
+} SchemaFingerprint;
+
+
+/**
+ * The header of the schema cache file, which is followed by the table records, and then by the
+ * '\0'-terminated variable IDs.
+ */
+typedef struct {
+  char magic[8];                  ///< SCHEMA_CACHE_MAGIC, for the file type and version
+  SchemaFingerprint fingerprint;  ///< The fingerprint of the database schema that the file matches
+  int64_t count;                  ///< Number of table records
+  int64_t size;                   ///< (bytes) Total file size
+} SchemaCacheHeader;
+
+
+/**
+ * A table record in the schema cache file.
+ */
+typedef struct {
+  int64_t idOffset;               ///< (bytes) Offset of the variable ID from the start of the file
+  int32_t index;                  ///< Unique table id (serial)
+  int32_t cols;                   ///< Number of array elements (columns)
+  int32_t hasMeta;                ///< (boolean) if we have metadata available
+  int32_t metaVersion;            ///< metadata serial number
+  int32_t sampling;               ///< the current sampling interval for array data
+  int32_t ndim;                   ///< array dimensions (may be 0 for scalars)
+  int32_t sizes[X_MAX_DIMS];      ///< array sizes along each dimension
+  char sqlType[SQL_TYPE_LEN];     ///< The SQL storage type
+  char unit[META_UNIT_LEN];       ///< physical unit in which data is expressed
+} SchemaCacheRecord;
+
+
 // Local prototypes -------------------------------------------------------->
 static void initCache();
+static void initWriters();
+static void *WriterThread(void *arg);
+static void processQueue();
 
-static void lockQueue();
-static void unlockQueue();
+static Variable *pullQueue(const struct timespec *deadline);
+static void dequeued(const Variable *u);
+static void dropVariable(Variable *u);
+static boolean isQueueFull(double fraction);
+static Variable *nextQueued(const struct timespec *deadline);
+static Variable *takePending(Variable *u);
 
 static int ensureCommandCapacity(int n);
 
@@ -93,36 +353,99 @@ static int getStringSize(XType type);
 
 static TableDescriptor *getTableDescriptor(const Variable *u);
 static TableDescriptor *getCachedTableDescriptor(const char *name);
+static TableDescriptor *getIndexedTableDescriptor(const InternedId *id);
+static void setIndexedTableDescriptor(const InternedId *id, TableDescriptor *t);
 static TableDescriptor *addVariable(const char *id, const Variable *u);
+static boolean isLoaded(TableDescriptor *t);
+static int sqlLoadTable(TableDescriptor *t);
+static void requestLoad(TableDescriptor *t);
+static void sqlNoteSchemaChange();
+static void writeSchemaCache(const SchemaFingerprint *f);
 static int sqlCreateTable(const Variable *u, int id);
 static int sqlConvertToHyperTable(int id);
 static int sqlCreateMetaTable(int id);
-static int sqlGetLastMeta(TableDescriptor *t);
+static int sqlGetLastMeta(TableDescriptor **tables, int n);
 
 static int sqlExec(const char *sql, PGresult **resp);
+static int sqlBegin();
+static int sqlCommit();
 static int sqlExecSimple(const char *sql);
 static int sqlConnect(const char *userName, const char *auth, const char *dbName);
 static void sqlDisconnect();
+static void sqlShutdown();
+static void closeWriter();
 static int sqlConnectRetry(int attempts);
 static int sqlInsertVariable(const Variable *u);
+static TableDescriptor *sqlPrepareTable(const Variable *u);
+static int sqlInsertRow(const Variable *u, TableDescriptor *t);
 static int sqlAddValues(const Variable *u);
+static int sqlQueueValues(Variable *u);
+static int sqlInsertParams(const Variable *u, TableDescriptor *t, XType colType);
+static int sqlAddMetaParams(const Variable *u, const TableDescriptor *t, int step, int ndim);
+static void sqlDeallocateInsert(TableDescriptor *t);
+static XType getBinaryColumnType(const char *sqlType);
+static boolean isBinaryCompatible(XType type, XType colType);
+static void sqlFlushPending();
+static int sqlInsertData(const Variable *u, TableDescriptor *t);
+static boolean isMetaUpdate(const Variable *u, const TableDescriptor *t);
+static int sqlAddMeta(const Variable *u, TableDescriptor *t);
+
+static boolean isPipelining();
+static boolean sqlEnterPipeline();
+static void sqlExitPipeline();
+static int sqlPipelineSync(boolean isBatch);
+static void addPipelineStatement(TableDescriptor *prepared);
+static void sqlDrainPipeline();
+static Variable *pullRetry();
+static int sqlPipeValues(Variable *u);
+static int sqlExecParams(const char *sql, const char *name);
+static int sqlExecStatement(const char *sql);
+static void setDeadline(double dt, struct timespec *deadline);
+
+static boolean isBatching();
+static int sqlBeginBatch(time_t grabTime);
+static int sqlCommitBatch();
+static boolean isBatchComplete();
 
 static int printColumnFormat(int ncols, char *fmt);
 static int printSQLType(XType type, char *dst);
 static int cmpSQLType(const char *a, const char *b);
 static char *appendValues(const Variable *u, char *dst);
 static char *appendValue(const void *data, XType type, char *dst);
+static char *appendSerializedValues(Variable *u, char *dst);
 
 // Local variables --------------------------------------------------------->
-static pthread_mutex_t qMutex = PTHREAD_MUTEX_INITIALIZER;  ///< Queue mutex
-static sem_t qAvailable;                                    ///< {mut} Counting semaphore for the queue
-static Variable *first = NULL, *last = NULL;                ///< {mut} Queue head and tail elements
-
-static PGconn *sql_db;      ///< The current SQL connection information
-static char *cmd;           ///< Buffer for assembling long SQL commands in.
-
-static struct hsearch_data lookup;                          ///< Local cache hash table for stored variabled
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;   ///< mutex for atomic transaction blocks.
+static Writer *writers;                                     ///< The pool of SQL writers
+static int nWriters;                                        ///< Number of SQL writers in the pool
+static pthread_once_t writersOnce = PTHREAD_ONCE_INIT;      ///< Initialization of the pool of writers
+static pthread_once_t shutdownOnce = PTHREAD_ONCE_INIT;     ///< Registration of the exit handler
+static atomic_int isShuttingDown;                           ///< Whether the writers should close their connections and stop
+
+// Writer-specific state, with each writer thread using its own
+static __thread Writer *writer;         ///< The writer running in the calling thread, or NULL
+static __thread BatchState batch;       ///< The state of the current batch transaction
+static __thread SQLParams params;       ///< Parameters for parametrized statements
+static __thread PipelineState pipeline; ///< The state of the pipeline, when using pipeline mode
+static __thread int nPrepared;          ///< Number of prepared INSERT statements on the connection
+static __thread boolean isSchemaNoted;  ///< Whether the schema change counter was advanced on the connection
+
+static __thread PGconn *sql_db;         ///< The current SQL connection information
+static __thread char *cmd;              ///< Buffer for assembling long SQL commands in.
+
+static QueueCounters queued;                                    ///< Counters for the data queued for the writers
+static SpillState spill = { .mutex = PTHREAD_MUTEX_INITIALIZER }; ///< The spill file, for the QUEUE_SPILL policy
+static LoaderState loader = { .mutex = PTHREAD_MUTEX_INITIALIZER }; ///< The background loader of table layouts
+static SchemaFingerprint schemaFingerprint;                     ///< The fingerprint of the database schema at startup
+static boolean hasSchemaCounter;                                ///< Whether the schema change counter is available
+static atomic_int schemaChanges;                                ///< Number of writers that noted schema changes
+static pthread_mutex_t spaceMutex = PTHREAD_MUTEX_INITIALIZER;  ///< mutex for waiting on queue space
+static pthread_cond_t spaceAvailable = PTHREAD_COND_INITIALIZER; ///< {mut} Signaled when queue space is freed
+static atomic_int spaceWaiters;                                 ///< Number of producers waiting for queue space
+
+static HashMap *lookup;                                         ///< {lookupLock} Local cache of table descriptors by variable ID
+static pthread_rwlock_t lookupLock = PTHREAD_RWLOCK_INITIALIZER; ///< Lock for accessing the lookup, shared by writers
+static TableDescriptor **indexed;                               ///< {lookupLock} Cached table descriptors by interned ID index
+static int nIndexed;                                            ///< {lookupLock} Capacity of the indexed table descriptors
 
 
 static int getStringType(int maxlen, char *buf) {
@@ -137,13 +460,19 @@ static int getStringType(int maxlen, char *buf) {
 
 /**
  * The main processing thread, which pulls values from the queue and inserts them into the
- * database asynchronously. It is started up by initialize();
+ * database asynchronously. It runs the first SQL writer, and starts the other writers in the pool (if
+ * any) once the table cache is initialized. It is started up by initialize();
  *
  * @return    NULL
  */
 void *SQLThread() {
+  int i;
+
   printf("SQLThread has started\n");
 
+  pthread_once(&writersOnce, initWriters);
+  writer = &writers[0];
+
   if(sqlConnectRetry(CONNECT_RETRY_ATTEMPTS) != SUCCESS_RETURN) exit(ERROR_EXIT);
 
 # if FIX_SCALAR_DIMS
@@ -156,1400 +485,4451 @@ void *SQLThread() {
 
   initCache();
 
-  // Initialize a the counting sempahore for the queue.
-  sem_init(&qAvailable, 0, 0);
+  // Start the other writers, which share the cache.
+  for(i = 1; i < nWriters; i++) if(pthread_create(&writers[i].thread, NULL, WriterThread, &writers[i]) != 0) {
+    perror("ERROR! could not start SQL writer");
+    exit(ERROR_EXIT);
+  }
+
+  if(nWriters > 1) printf("Started %d SQL writers\n", nWriters);
 
 # if USE_SYSTEMD
   sd_notify(0, "READY=1");
   setSDState(IDLE_STATE);
 # endif
 
-  // The main processing loop.
-  while(TRUE) {
-    Variable *u;
-
-    // Wait until something has been placed on the queue
-    while(sem_wait(&qAvailable));
-
-    // Take the first element from the queue...
-    lockQueue();
-    u = first;
-    first = first->next;
-    if(!first) last = NULL;
-    unlockQueue();
-
-    // ... Send to the SQL database ...
-    sqlAddValues(u);
-
-    // ... and deallocate.
-    destroyVariable(u);
-  }
+  processQueue();
 
   return NULL;
 }
 
 
 /**
- * Gets exclusive access for adding or removing variables to/from the queue.
+ * The thread of an additional SQL writer in the pool, with its own database connection.
  *
+ * @param arg   Pointer to the Writer.
+ * @return      NULL
  */
-static void lockQueue() {
-  if (pthread_mutex_lock(&qMutex) != 0) perror("lockQueue()");
-}
+static void *WriterThread(void *arg) {
+  writer = (Writer *) arg;
 
+  dprintf("SQL writer %d has started\n", writer->index);
 
-/**
- * Relinquishes exclusive access after adding or removing variables to/from the queue.
- *
- */
-static void unlockQueue() {
-  if (pthread_mutex_unlock(&qMutex) != 0) perror("unlockQueue()");
+  if(sqlConnectRetry(CONNECT_RETRY_ATTEMPTS) != SUCCESS_RETURN) exit(ERROR_EXIT);
+
+  processQueue();
+
+  return NULL;
 }
 
 
 /**
- * Add the variable to the queue for database insertion.
+ * Initializes the pool of SQL writers, with their queues. Variables may be queued for the writers
+ * before these are started.
  *
- * @param u   Pointer to the variable data structure
- * @return    SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1; errno will indicate the type
- *            of error).
  */
-int insertQueue(Variable *u) {
-  if(!u) {
-    errno = EINVAL;
-    return ERROR_RETURN;
-  }
-
-  /* Insert in queue */
-  lockQueue();
-  if(!first) first = u;
-  else last->next = u;
-  last = u;
-  sem_post(&qAvailable);
-  unlockQueue();
+static void initWriters() {
+  int i;
 
-  return SUCCESS_RETURN;
-}
+  nWriters = getWriterThreads();
+  if(nWriters < 1) nWriters = 1;
 
+  writers = (Writer *) calloc(nWriters, sizeof(Writer));
+  x_check_alloc(writers);
 
-static int shorten(char *str, const char *match, const char *replacement) {
-  if(!str || !match || !replacement) {
-    errno = EINVAL;
-    return -1;
-  }
+  for(i = 0; i < nWriters; i++) {
+    Writer *w = &writers[i];
 
-  if(strlen(match) < strlen(replacement)) {
-    errno = EINVAL;
-    return -1;
+    w->index = i;
+    initWriterQueue(&w->queue);
+    atomic_init(&w->isRunning, FALSE);
+    sem_init(&w->stopped, 0, 0);
   }
+}
 
-  char *from = strstr(str, match);
-  if(from) {
-    char *rest = strdup(from + strlen(match));
-    if(rest) {
-      sprintf(from, "%s%s", replacement, rest);
-      free(rest);
-    }
-  }
 
-  return 0;
+/**
+ * Returns the writer that handles the data for a given variable. All data for the same variable
+ * (table) is handled by the same writer, so that it is inserted in order.
+ *
+ * @param u     The variable.
+ * @return      The writer that inserts data for the variable.
+ */
+static Writer *getWriter(const Variable *u) {
+  if(nWriters == 1) return &writers[0];
+  return &writers[(u->interned ? u->interned->hash : hashString(u->id)) % nWriters];
 }
 
 
 /**
- * Initializes the local table ID lookup for variables, for efficient data insertions.
- * It queries the SQL database for existing tables (variables) to create the cache.
- * The cache can accomodate up to CACHE_SIZE variables.in the lookup, so make sure
- * CACHE_SIZE is defined appropriately.
+ * The processing loop of SQL writers, which pull variables from their queue and insert their data into
+ * the database.
  *
  */
-static void initCache() {
-  PGresult *tables;
-  int nTitles, i, success;
+static void processQueue() {
+  atomic_store(&writer->isRunning, TRUE);
 
-  // Get all existing Titles, and cache them
-  success = sqlExec("SELECT name, tid FROM " MASTER_TABLE ";", &tables);
+  // The main processing loop.
+  while(TRUE) {
+    Variable *u;
 
-  if (!success) {
-    PQfinish(sql_db);
-    exit(ERROR_EXIT);
-  }
+    if(atomic_load(&isShuttingDown)) {
+      closeWriter();
+      return;
+    }
 
-  nTitles = PQntuples(tables);
-  printf("Found %d titles in DB\n", nTitles);
+    // Rows from failed batches are retried first...
+    u = pullRetry();
 
-  // Create a hashtable for caching/lookup of translation tables.
-  if(!hcreate_r(CACHE_SIZE, &lookup)) {
-    fprintf(stderr, "ERROR! Could not create table lookup.\n");
-    exit(ERROR_EXIT);
-  }
+    // Wait until something has been placed on the queue, or until the open batch or pipeline results
+    // are due.
+    if(!u) {
+      const struct timespec *deadline = NULL;
 
-  for (i = 0; i < nTitles; i++) {
-    PGresult *columns;
-    const char *id;
-    char type[SQL_TYPE_LEN] = {'\0'};
-    char colFmt[SQL_COL_NAME_LEN];
-    int k, firstDataCol = 2, nCols, table = 0;
-    ENTRY e, *added = NULL;
-    TableDescriptor *desc;
+      if(batch.isOpen) deadline = &batch.deadline;
+      else if(pipeline.nSegments) deadline = &pipeline.deadline;
 
-    id = PQgetvalue(tables, i, 0);
-    if(!id) {
-      fprintf(stderr, "WARNING! NULL id in SQL entry.\n");
+      u = nextQueued(deadline);
+    }
+
+    if(!u) {
+      sqlCommitBatch();
+      sqlDrainPipeline();
       continue;
     }
 
-    id = strdup(id);
-    if (id == NULL) {
-      perror("ERROR: duplicate table ID");
-      exit(errno);
-    };
+    // Values may only be inserted as serialized text via INSERT statements.
+    if(!isTextPassThrough()) deserializeVariable(u);
 
-    if(1 != sscanf(PQgetvalue(tables, i, 1), "%d", &table)) {
-      fprintf(stderr, "WARNING! Invalid table id '%s'.\n", PQgetvalue(tables, i, 1));
-      continue;
+    // Rows from a different grab cycle go into a new batch, unless rows are grouped by table
+    // (in which case a batch may span cycles to catch up with a backlog).
+    if(batch.isOpen && u->grabTime != batch.grabTime && getInsertMethod() != INSERT_COPY) sqlCommitBatch();
+    if(isBatching() && !batch.isOpen) sqlBeginBatch(u->grabTime);
+
+    if(batch.isOpen && getInsertMethod() == INSERT_COPY) {
+      // ... Add to the batch, to be sent when the batch is committed ...
+      sqlQueueValues(u);
     }
+    else if(isPipelining()) {
+      // ... Send to the SQL database without waiting for the result ...
+      sqlPipeValues(u);
+    }
+    else {
+      // ... Send to the SQL database ...
+      sqlAddValues(u);
 
-    ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN);
-    sprintf(cmd, "select COLUMN_NAME, DATA_TYPE from INFORMATION_SCHEMA.COLUMNS where TABLE_NAME = '" TABLE_NAME_PATTERN "';", table);
-    success = sqlExec(cmd, &columns);
-    if (!success) {
-      PQclear(tables);
-      PQfinish(sql_db);
-      exit(ERROR_EXIT);
+      // ... and deallocate.
+      destroyVariable(u);
     }
 
-    nCols = PQntuples(columns);
+    if(batch.isOpen) if(isBatchComplete()) sqlCommitBatch();
+  }
+}
 
-    for(k = 0; k < nCols; k++) {
-      const char *colName = PQgetvalue(columns, k, 0);
-      const int max = (int) (sizeof(type) - 1);
 
-      // Use the first data column to determine how many data columns and what type they are.
-      if(strncmp(COL_NAME_STEM "0", colName, sizeof(COL_NAME_STEM)) == 0) {
-        char *storeType = PQgetvalue(columns, k, 1);
-        int j;
+/**
+ * Takes the next variable from the queue of the calling writer, waiting for one to become available if
+ * necessary.
+ *
+ * @param deadline  Absolute (CLOCK_REALTIME) time until which to wait for a variable, or NULL to wait
+ *                  indefinitely.
+ * @return          The next variable from the queue, or NULL if the deadline has passed with the queue
+ *                  remaining empty, or if the program is shutting down.
+ */
+static Variable *pullQueue(const struct timespec *deadline) {
+  WriterQueue *q = &writer->queue;
 
-        firstDataCol = k;
-        nCols -= firstDataCol;
+  while(TRUE) {
+    Variable *u;
 
-        // convert to upper case...
-        for(j = 0; j < max && storeType[j]; j++) type[j] = toupper(storeType[j]);
+    if(atomic_load(&isShuttingDown)) return NULL;
 
-        // Substitute short forms
-        shorten(storeType, "CHARACTER VARIABLE", "VARCHAR");
-        shorten(storeType, "CHARCTER", "CHAR");
+    u = takeWriterQueue(q);
+    if(u) return u;
 
-        break;
-      }
-    }
+    if(waitWriterQueue(q, deadline) != SUCCESS_RETURN) return NULL;
+  }
+}
 
-    // Check and fix up column names.
-    printColumnFormat(nCols, colFmt);
 
-    for(k = 0; k < nCols; k++) {
-      const char *name = PQgetvalue(columns, firstDataCol + k, 0);
-      char colName[SQL_COL_NAME_LEN];
+/**
+ * Takes the next variable to insert from the queue of the calling writer, waiting for one to become
+ * available if necessary. With the QUEUE_DROP_OLDEST overflow policy, the oldest variables are dropped
+ * here, for as long as the queue remains full without them.
+ *
+ * @param deadline  Absolute (CLOCK_REALTIME) time until which to wait for a variable, or NULL to wait
+ *                  indefinitely.
+ * @return          The next variable from the queue, or NULL if the deadline has passed with the queue
+ *                  remaining empty.
+ */
+static Variable *nextQueued(const struct timespec *deadline) {
+  while(TRUE) {
+    Variable *u = pullQueue(deadline);
+    if(!u) return NULL;
 
-      sprintf(colName, colFmt, k);
+    dequeued(u);
+    u = takePending(u);
 
-      if(strcmp(name, colName) != 0) {
-        fprintf(stderr, "!FIX! %s: column name %s -> %s\n", id, name, colName);
-        sprintf(cmd, "ALTER TABLE " TABLE_NAME_PATTERN " RENAME COLUMN %s TO %s;", table, name, colName);
-        sqlExecSimple(cmd);
-      }
+    if(getQueueOverflow() == QUEUE_DROP_OLDEST) if(isQueueFull(1.0)) {
+      dropVariable(u);
+      continue;
     }
 
-    PQclear(columns);
+    return u;
+  }
+}
 
-    if(!type[0]) continue;   // Not a data table (contains no data)
 
-    desc = (TableDescriptor *) calloc(1, sizeof(*desc));
-    if(!desc) {
-      perror("ERROR! alloc table format description");
-      exit(errno);
-    }
+/**
+ * Returns the approximate memory footprint of a variable while it is queued.
+ *
+ * @param u   Pointer to the variable
+ * @return    (bytes) The memory used by the variable and its data.
+ */
+static long getFootprint(const Variable *u) {
+  const XField *f = &u->field;
+  long bytes = sizeof(Variable);
+  int n = xGetFieldCount(f);
 
-    desc->index = table;
-    desc->cols = nCols;
-    strncpy(desc->sqlType, type, sizeof(desc->sqlType) - 1);
+  if(u->id) bytes += strlen(u->id) + 1;
+  if(f->name) bytes += strlen(f->name) + 1;
+  if(u->unit) bytes += strlen(u->unit) + 1;
 
-    desc->hasMeta = sqlGetLastMeta(desc);
-    desc->id = (char *) id;
+  if(!f->value || n <= 0) return bytes;
 
-    e.key = desc->id;
-    e.data = desc;
+  if(f->isSerialized) bytes += strlen((char *) f->value) + 1;
+  else if(f->type == X_STRING) {
+    char **s = (char **) f->value;
+    int i;
 
-    if(!hsearch_r(e, ENTER, &added, &lookup)) {
-      free(e.data);
-      fprintf(stderr, "WARNING! could not cache table id for '%s'.\n", id);
-      break;
-    }
+    bytes += n * sizeof(char *);
+    for(i = 0; i < n; i++) if(s[i]) bytes += strlen(s[i]) + 1;
   }
+  else bytes += (long) n * xElementSizeOf(f->type);
 
-  PQclear(tables);
-
-  printf("Created cache.\n");
+  return bytes;
 }
 
 
 /**
- *  Allocates or reallocates a sufficiently sized buffer for storing the SQL command.
- *
- *  \param n        Number of bytes needed in the cmd variable.
+ * Checks if the queue has reached a fraction of its configured limits.
  *
- *  \return         SUCCESS_RETURN (0) if cmd can accomonade the requested number of
- *                  bytes, or ERROR_RETURN if the (re)allocation failed.
+ * @param fraction  The fraction of the configured limits to check against, e.g. 1.0 to check if the
+ *                  queue is full.
+ * @return          TRUE (1) if the queued rows or bytes are at or above the given fraction of their
+ *                  configured limits, or else FALSE (0).
  */
-static int ensureCommandCapacity(int n) {
-  static int cmdSize = 0;
+static boolean isQueueFull(double fraction) {
+  long maxRows = getMaxQueueRows(), maxBytes = getMaxQueueBytes();
 
-  // Don't bother with tiny buffers, start with an minimum...
-  if(n < MIN_CMD_SIZE) n = MIN_CMD_SIZE;
-
-  if(!cmd) {
-    cmdSize = n;
-    cmd = malloc(cmdSize);
-  }
-  else if(n > cmdSize) {
-    cmdSize = n;
-    cmd = realloc(cmd, cmdSize);
-    x_check_alloc(cmd);
+  if(maxRows > 0) if(atomic_load(&queued.rows) >= fraction * maxRows) return TRUE;
+  if(maxBytes > 0) if(atomic_load(&queued.bytes) >= fraction * maxBytes) return TRUE;
+  return FALSE;
+}
 
-    dprintf("Growing command buffer to %d bytes.\n", cmdSize);
-  }
 
-  if(!cmd) {
-    fprintf(stderr, "ERROR! malloc command (%d bytes).\n", n);
-    exit(ERROR_EXIT);
-  }
+/**
+ * Pushes a variable onto the queue of the writer that handles it, regardless of the queue limits.
+ *
+ * @param u   Pointer to the variable
+ */
+static void pushQueue(Variable *u) {
+  atomic_fetch_add(&queued.rows, 1);
+  atomic_fetch_add(&queued.bytes, u->queueBytes);
 
-  return SUCCESS_RETURN;
+  pushWriterQueue(&getWriter(u)->queue, u);
 }
 
 
+/**
+ * Blocks the calling (producer) thread until the queue is no longer full.
+ *
+ */
+static void waitForSpace() {
+  pthread_mutex_lock(&spaceMutex);
+  atomic_fetch_add(&spaceWaiters, 1);
+  while(isQueueFull(1.0)) pthread_cond_wait(&spaceAvailable, &spaceMutex);
+  atomic_fetch_sub(&spaceWaiters, 1);
+  pthread_mutex_unlock(&spaceMutex);
+}
 
 
 /**
- * Returns the maximum string size required for representing this type when sending it to
- * the database.
- *
- * \param type      Variable type, e.g. SHORT_TYPE
- *
- * \return          Maximum string size to represent a value of this type.
+ * Discards a variable because the queue overflowed, and counts it as dropped.
  *
+ * @param u   Pointer to the variable
  */
-static int getStringSize(XType type) {
-  if(xIsCharSequence(type)) return xElementSizeOf(type) + 2;  // including quotes
-  return xStringElementSizeOf(type);
+static void dropVariable(Variable *u) {
+  if(!atomic_fetch_add(&queued.dropped, 1)) fprintf(stderr, "WARNING! Queue is full. Dropping data (e.g. %s).\n", u->id);
+  destroyVariable(u);
 }
 
 
 /**
- * Converts a string or fixed-length character array to representation in SQL, enclosing it in single quotes,
- * and escaping any single quotes within. It support the full set of extended ASCII characters.
- *
- * @param s     An ASCII string value
- * @param l     (bytes) The length of the string which may be unterminated.
- * @param dst   Destination buffer in which to write string.
+ * Writes data to the spill file, growing the spill buffer as necessary.
  *
- * @return      Pointer to the position after the SQL-ized string in the destination buffer
+ * @param data    Pointer to the data
+ * @param n       (bytes) Number of bytes to write.
+ * @param dst     Pointer to the location in the spill buffer where to write
+ * @return        Pointer to the location in the spill buffer after the data written.
  */
-static char *printSQLString(const char *s, int l, char *dst) {
-  int i;
+static char *putSpill(const void *data, int n, char *dst) {
+  long used = dst - spill.buf;
+
+  if(used + n > spill.size) {
+    spill.size = (used + n) << 1;
+    spill.buf = (char *) realloc(spill.buf, spill.size);
+    x_check_alloc(spill.buf);
+    dst = spill.buf + used;
+  }
 
-  if(!s || !dst) {
-    errno = EINVAL;
-    return dst;
-  }
-
-  *(dst++) = '\'';
+  memcpy(dst, data, n);
+  return dst + n;
+}
 
-  for(i=0; i < l && s[i]; i++) {
-    const char c = s[i];
-    *(dst++) = c;
-    if(c == '\'') *(dst++) = '\'';        // escape single quotes by doubling them
-  }
 
-  *(dst++) = '\'';
+/**
+ * Adds a string to the spill buffer, with its length (-1 for NULL) in front of it.
+ *
+ * @param str     The string, or NULL
+ * @param dst     Pointer to the location in the spill buffer where to write
+ * @return        Pointer to the location in the spill buffer after the data written.
+ */
+static char *putSpillString(const char *str, char *dst) {
+  int32_t len = str ? (int32_t) strlen(str) : -1;
 
+  dst = putSpill(&len, sizeof(len), dst);
+  if(len > 0) dst = putSpill(str, len, dst);
   return dst;
 }
 
 
 /**
- * Appends the SQL variable type for the given local data type at the given
- * string location, and returns the string location after the appended
- * variable type.
- *
- * \param type          The xchange data type, e.g. X_SHORT
- * \param dst           String location at which to append the corresponding
- *                      SQL type.
- *
- * \return              The number of characters printed
+ * Gets a string from a spilled record, which was written via putSpillString().
  *
+ * @param[in, out] src    Pointer to the location in the record, which is advanced past the string.
+ * @return                A newly allocated copy of the string, or NULL.
  */
-static int printSQLType(XType type, char *dst) {
-  if(!dst) {
-    errno = EINVAL;
-    return ERROR_RETURN;
-  }
-
-  if(xIsCharSequence(type)) {
-    return getStringType(xElementSizeOf(type), dst);
-  }
-  else switch (type) {
-    case X_BOOLEAN:
-      return sprintf(dst, SQL_BOOLEAN);
-    case X_BYTE:
-      return sprintf(dst, SQL_INT8);
-    case X_INT16:
-      return sprintf(dst, SQL_INT16);
-    case X_INT32:
-      return sprintf(dst, SQL_INT32);
-    case X_INT64:
-      return sprintf(dst, SQL_INT64);
-    case X_FLOAT:
-      return sprintf(dst, SQL_FLOAT);
-    case X_DOUBLE:
-      return sprintf(dst, SQL_DOUBLE);
-    default:
-      fprintf(stderr, "WARNING! no matching SQL type (%d)\n", type);
-  }
-
-  errno = EBADR;
-  return ERROR_RETURN;
-}
+static char *getSpillString(const char **src) {
+  int32_t len;
+  char *str;
 
+  memcpy(&len, *src, sizeof(len));
+  *src += sizeof(len);
 
-static int cmpSQLType(const char *a, const char *b) {
-  static const char *types = SQL_INT8 " " SQL_INT16 " " SQL_INT32 " " SQL_INT64 " " SQL_FLOAT " " SQL_DOUBLE;
-
-  int na, nb;
+  if(len < 0) return NULL;
 
-  if(strcmp(a, b) == 0) return 0;
+  str = (char *) malloc(len + 1);
+  x_check_alloc(str);
 
-  // VARCHAR is deprecated in PostgreSQL now, but we'll consider it nevertheless -- just in case
-  if(sscanf(a, "VARCHAR(%d)", &na) == 1) {
-    if(sscanf(b, "VARCHAR(%d)", &nb) == 1) return na - nb;
-    return -1;
-  }
+  memcpy(str, *src, len);
+  str[len] = '\0';
+  *src += len;
 
-  return (int) (strstr(types, a) - strstr(types, b));
+  return str;
 }
 
 
 /**
- * Appends the values stored in the variable as a comma-separated list starting at the specified string
- * location, returning the string location immediately after the appended list.
- *
- * \param u     Pointer to the variable
- * \param dst   String location at which to append string list of elements
+ * Writes a variable to the spill file, from which it is queued again once the queue has drained.
+ * The variable is destroyed after it has been written.
  *
- * \return      String location after the insertion (or same as dst if no string were appended).
+ * @param u   Pointer to the variable
+ * @return    SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
  *
+ * @sa unspill()
  */
-static char *appendValues(const Variable *u, char *dst) {
-  const XField *f;
-  int eSize, step = 1;
+static int spillVariable(Variable *u) {
+  const XField *f = &u->field;
+  int64_t times[2] = { u->updateTime, u->grabTime };
+  int32_t header[4 + X_MAX_DIMS] = { u->sampling, u->force, f->type, f->ndim };
+  int32_t len = 0;
+  char *next;
+  int i, n = xGetFieldCount(f);
 
-  if(!u || !dst) {
-    errno = EINVAL;
-    return dst;
-  }
+  // Spilled records always contain binary data.
+  deserializeVariable(u);
 
-  f = &u->field;
-  if(!f->value) {
-    errno = EINVAL;
-    return dst;
+  pthread_mutex_lock(&spill.mutex);
+
+  if(!spill.fp) {
+    spill.fp = fopen(getSpillFile(), "w+b");
+    if(!spill.fp) {
+      fprintf(stderr, "WARNING! Cannot open spill file %s: %s\n", getSpillFile(), strerror(errno));
+      pthread_mutex_unlock(&spill.mutex);
+      return ERROR_RETURN;
+    }
   }
 
-  eSize = xElementSizeOf(f->type);
+  memcpy(&header[4], f->sizes, sizeof(f->sizes));
 
-  if(u->sampling > 1) step = u->sampling;
+  // Record length comes first, and is filled in at the end...
+  next = putSpill(&len, sizeof(len), spill.buf);
 
-  if(f->ndim > 0) {
-    char *data = (char *) f->value;
-    int i, n = getSampleCount(u);
-    for(i = 0; i < n; i++) dst = appendValue(&data[i * step * eSize], f->type, dst);
+  next = putSpillString(u->id, next);
+  next = putSpillString(f->name, next);
+  next = putSpillString(u->unit, next);
+  next = putSpill(times, sizeof(times), next);
+  next = putSpill(header, sizeof(header), next);
+
+  if(f->type == X_STRING) {
+    char **s = (char **) f->value;
+    for(i = 0; i < n; i++) next = putSpillString(s ? s[i] : NULL, next);
   }
-  else dst = appendValue(f->value, f->type, dst);
+  else if(f->value && n > 0) next = putSpill(f->value, n * xElementSizeOf(f->type), next);
 
-  return dst;
+  len = (int32_t) (next - spill.buf);
+  memcpy(spill.buf, &len, sizeof(len));
+
+  fseek(spill.fp, 0, SEEK_END);
+  if(fwrite(spill.buf, len, 1, spill.fp) != 1) {
+    fprintf(stderr, "WARNING! Cannot write spill file %s: %s\n", getSpillFile(), strerror(errno));
+    pthread_mutex_unlock(&spill.mutex);
+    return ERROR_RETURN;
+  }
+
+  atomic_fetch_add(&queued.spilled, 1);
+  atomic_fetch_add(&queued.spillRows, 1);
+
+  pthread_mutex_unlock(&spill.mutex);
+
+  destroyVariable(u);
+
+  return SUCCESS_RETURN;
 }
 
 
 /**
- * Appends a string representation of an elemental value (with a preceding comma)
- * at the specified location, returning the location immediately after the appended
- * string.
- *
- * \param data          Pointer to the binary element
- * \param type          Element type, e.g. SHORT_TYPE
- * \param elementSize   Bytes occupied by this element
- * \param dst           String location to append value at.
+ * Reconstructs a variable from a record in the spill file.
  *
- * \return              String location after the inserted element.
+ * @param src   The record, following the record length.
+ * @return      The newly allocated variable.
  */
-static char *appendValue(const void *data, XType type, char *dst) {
-  if(!dst) {
-    errno = EINVAL;
-    return dst;
-  }
-
-  dst += sprintf(dst, SQL_SEP);
+static Variable *parseSpilled(const char *src) {
+  XField *f;
+  int64_t times[2];
+  int32_t header[4 + X_MAX_DIMS];
+  int n;
 
-  if(xIsCharSequence(type)) {
-    return printSQLString((char *) data, xElementSizeOf(type), dst);
-  }
+  Variable *u = (Variable *) calloc(1, sizeof(Variable));
+  char *id;
 
-  if (!data) return dst + sprintf(dst, "NULL");
+  x_check_alloc(u);
 
-  switch (type) {
+  f = &u->field;
 
-    case X_BOOLEAN: return dst + sprintf(dst, "%s",*(boolean *) data ? "true" : "false");
+  id = getSpillString(&src);
+  u->interned = internId(id);
+  if(u->interned) u->id = (char *) u->interned->name;
+  if(id) free(id);
 
-    case X_BYTE: return dst + sprintf(dst, "%hhd", *(char *) data);
+  f->name = getSpillString(&src);
+  u->unit = getSpillString(&src);
 
-    case X_SHORT: return dst + sprintf(dst, "%hd", *(int16_t *) data);
+  memcpy(times, src, sizeof(times));
+  src += sizeof(times);
+  u->updateTime = (time_t) times[0];
+  u->grabTime = (time_t) times[1];
 
-    case X_INT: return dst + sprintf(dst, "%d", *(int32_t *) data);
+  memcpy(header, src, sizeof(header));
+  src += sizeof(header);
+  u->sampling = header[0];
+  u->force = header[1];
+  f->type = (XType) header[2];
+  f->ndim = header[3];
+  memcpy(f->sizes, &header[4], sizeof(f->sizes));
 
-    case X_LONG: return dst + sprintf(dst, "%ld", *(int64_t *) data);
+  n = xGetFieldCount(f);
 
-    case X_FLOAT: {
-      float f = *(float *) data;
-      if(isfinite(f)) return dst + sprintf(dst, "%.7g", f);      // Was %.7e
-      return dst + sprintf(dst, "'NaN'");
+  if(f->type == X_STRING) {
+    // Pointers and strings in a single block, so destroyVariable() frees it all.
+    const char *from = src;
+    long size = n * sizeof(char *);
+    char **s, *next;
+    int i;
+
+    for(i = 0; i < n; i++) {
+      int32_t len;
+      memcpy(&len, from, sizeof(len));
+      from += sizeof(len);
+      if(len > 0) from += len;
+      size += (len < 0 ? 0 : len) + 1;
     }
 
-    case X_DOUBLE: {
-      // SQL can be a bit picky with extreme doubles so apply some sanity here...
-      double d = *(double *) data;
-      if(isfinite(d)) {
-        double a = fabs(d);
-        if(a < SQL_MIN_DOUBLE) return dst + sprintf(dst, "0.0");
-        if(a > SQL_MAX_DOUBLE) return dst + sprintf(dst, "'NaN'");
-        return dst + sprintf(dst, "%.16lg", d);     // %.16e
+    f->value = malloc(size > 0 ? size : 1);
+    x_check_alloc(f->value);
+
+    s = (char **) f->value;
+    next = (char *) &s[n];
+
+    for(i = 0; i < n; i++) {
+      int32_t len;
+      memcpy(&len, src, sizeof(len));
+      src += sizeof(len);
+
+      if(len < 0) {
+        s[i] = NULL;
+        continue;
       }
-      return dst + sprintf(dst, "'NaN'");
-    }
 
-    case X_STRING: {
-      const char *s = *(char **) data;
-      return printSQLString(s, strlen(s), dst);
+      s[i] = next;
+      memcpy(next, src, len);
+      next[len] = '\0';
+      next += len + 1;
+      src += len;
     }
-    default:
-      fprintf(stderr, "WARNING! addValue(): Unknown data type (%d)\n", type);
-      return dst + sprintf(dst, "NULL");
+  }
+  else if(n > 0) {
+    long size = (long) n * xElementSizeOf(f->type);
+    f->value = malloc(size);
+    x_check_alloc(f->value);
+    memcpy(f->value, src, size);
   }
 
-  return dst;
+  return u;
 }
 
 
 /**
- * Returns the cached table ID for a given compound variable name.
- *
- * \param name      The compund variable name, as returned by getLongName().
+ * Queues spilled variables again, until the queue is half full or there are no more spilled variables.
+ * Only one thread reads the spill file at a time. Other callers return immediately.
  *
- * \return          The cached table descriptor or else NULL if the table id for the
- *                  given compound name is not cached.
- *
- * \sa getLongName()
+ * @sa spillVariable()
  */
-static TableDescriptor *getCachedTableDescriptor(const char *name) {
-  ENTRY e, *match;
+static void unspill() {
+  if(pthread_mutex_trylock(&spill.mutex) != 0) return;
 
-  if(!name) {
-    errno = EINVAL;
-    return NULL;
-  }
+  if(spill.fp) fseek(spill.fp, spill.readPos, SEEK_SET);
 
-  e.key = (char *) name;
-  if(!hsearch_r(e, FIND, &match, &lookup)) {
-    dprintf("No cached entry for '%s'.\n", name);
-    return NULL;
+  while(atomic_load(&queued.spillRows) > 0 && !isQueueFull(0.5)) {
+    Variable *u;
+    int32_t len;
+
+    if(fread(&len, sizeof(len), 1, spill.fp) == 1) if(len > spill.size) {
+      spill.size = len;
+      spill.buf = (char *) realloc(spill.buf, spill.size);
+      x_check_alloc(spill.buf);
+    }
+
+    if(feof(spill.fp) || ferror(spill.fp) || fread(spill.buf, len - sizeof(len), 1, spill.fp) != 1) {
+      fprintf(stderr, "WARNING! Cannot read spill file %s. Discarding %ld spilled rows.\n", getSpillFile(), (long) atomic_load(&queued.spillRows));
+      atomic_store(&queued.spillRows, 0);
+      break;
+    }
+
+    spill.readPos += len;
+    atomic_fetch_sub(&queued.spillRows, 1);
+
+    u = parseSpilled(spill.buf);
+    u->queueBytes = getFootprint(u);
+    pushQueue(u);
   }
 
-  dprintf("Found cached table number: %d\n", *(int *) match->data);
+  if(atomic_load(&queued.spillRows) <= 0 && spill.fp) {
+    // All spilled data has been queued again, so we can start over with an empty file.
+    if(ftruncate(fileno(spill.fp), 0) != 0) perror("WARNING! truncate spill file");
+    rewind(spill.fp);
+    spill.readPos = 0;
+    atomic_store(&queued.spillRows, 0);
+  }
 
-  return (TableDescriptor *) match->data;
+  pthread_mutex_unlock(&spill.mutex);
 }
 
 
 /**
- * Gets the table ID number by which the database refers to the variable.
- *
- * \param u     Pointer to the variable
+ * Accounts for a variable that a writer has taken from its queue, waking up producers that are waiting
+ * for space, and queuing spilled data again, once the queue has drained sufficiently.
  *
- * \return      The corresponfing database table descritor or NULL if there was an error.
+ * @param u   Pointer to the variable that was taken from the queue.
  */
-static TableDescriptor *getTableDescriptor(const Variable *u) {
-  TableDescriptor *t;
-
-  if(!u) {
-    errno = EINVAL;
-    return NULL;
+static void dequeued(const Variable *u) {
+  atomic_fetch_sub(&queued.rows, 1);
+  atomic_fetch_sub(&queued.bytes, u->queueBytes);
+
+  if(atomic_load(&spaceWaiters) > 0) {
+    pthread_mutex_lock(&spaceMutex);
+    pthread_cond_broadcast(&spaceAvailable);
+    pthread_mutex_unlock(&spaceMutex);
   }
 
-  t = getCachedTableDescriptor(u->id);
-  if(!t) t = addVariable(u->id, u);
-  return t;
+  if(atomic_load(&queued.spillRows) > 0) if(!isQueueFull(0.5)) unspill();
 }
 
 
-static int getEnclosingStringLength(const XField *f, int sampling) {
-  int i, n, max = DEFAULT_STRING_LEN;
-  char **s;
+/**
+ * Returns statistics on the queue between the SMA-X grabber and the SQL writers.
+ *
+ * @param[out] stats    Pointer to the structure to populate with the current queue statistics.
+ */
+void getQueueStats(queue_stats *stats) {
+  if(!stats) return;
+
+  stats->rows = atomic_load(&queued.rows);
+  stats->bytes = atomic_load(&queued.bytes);
+  stats->dropped = atomic_load(&queued.dropped);
+  stats->spilled = atomic_load(&queued.spilled);
+  stats->spillRows = atomic_load(&queued.spillRows);
+  stats->coalesced = atomic_load(&queued.coalesced);
+}
 
-  if(!f) {
-    errno = EINVAL;
-    return max;
-  }
 
-  if(sampling < 1) sampling = 1;
+/**
+ * Returns the table descriptor, through which new data for a variable is to be coalesced with the data
+ * that is still waiting in the queue, if coalescing applies. Coalescing applies to variables selected by
+ * `coalesce` patterns, once the queue is backlogged beyond the configured threshold, and for as long as
+ * there is earlier data for the variable pending.
+ *
+ * @param u   Pointer to the variable
+ * @return    The table descriptor for the variable, if its data is to be coalesced, or else NULL.
+ *
+ * @sa getCoalesceThreshold()
+ */
+static TableDescriptor *getCoalescingTable(const Variable *u) {
+  TableDescriptor *t;
 
-  s = (char **) f->value;
-  n = xGetFieldCount(f);
+  if(!u->coalesce) return NULL;
 
-  for(i = 0; i < n; i += sampling) if(s[i]) {
-    int l = strlen(s[i]);
-    while(l > max) max <<= 1;
-  }
+  // We can only coalesce data for tables that the writers already know.
+  t = u->interned ? getIndexedTableDescriptor(u->interned) : getCachedTableDescriptor(u->id);
+  if(!t) return NULL;
 
-  return max;
+  if(atomic_load(&t->pending)) return t;
+  if(atomic_load(&queued.rows) >= getCoalesceThreshold()) return t;
+
+  return NULL;
 }
 
 
 /**
- * Adds a new table in the database to store data for the specified variable.
+ * Coalesces new data for a variable with the data for the same variable that is pending insertion.
+ * If there is pending data, it is replaced by the new data. Otherwise, if claim is set, the new data
+ * becomes the pending data for the table, which the caller must then push to the queue.
  *
- * \param id            The aggregated SMA-X variable ID.
- * \param u             Pointer to the variable
+ * @param u       Pointer to the variable with the new data
+ * @param t       The table descriptor for the variable
+ * @param claim   Whether the new data should become the pending data for the table, if there is none.
+ * @return        TRUE (1) if the new data replaced pending data, and so must not be queued, or else
+ *                FALSE (0).
  *
- * return               The table descriptor for the newly created entry in the database.
- *                      or else NULL if there was an error.
+ * @sa takePending()
  */
-static TableDescriptor *addVariable(const char *id, const Variable *u) {
-  ENTRY e = { NULL, NULL }, *added = NULL;
-  TableDescriptor *desc;
-  int idx;
+static boolean coalesceVariable(Variable *u, TableDescriptor *t, boolean claim) {
+  uintptr_t expected = atomic_load(&t->pending);
 
-  if(!id || !u) {
-    errno = EINVAL;
-    return NULL;
+  while(TRUE) {
+    if(!expected) {
+      if(!claim) return FALSE;
+      if(atomic_compare_exchange_weak(&t->pending, &expected, (uintptr_t) u | PENDING_QUEUED)) {
+        u->pending = &t->pending;
+        return FALSE;
+      }
+    }
+    else if(atomic_compare_exchange_weak(&t->pending, &expected, (uintptr_t) u)) break;
   }
 
-  if(getSampleCount(u) > 128) {
-    fprintf(stderr, "WARNING! %s: too many cols (%d).\n", id, getSampleCount(u));
-  }
+  atomic_fetch_add(&queued.coalesced, 1);
 
-  idx = sqlInsertVariable(u);
-  if(idx <= 0) return NULL;
+  // Data that is not in the queue was replaced before a writer got to it, so we discard it here.
+  // The queued variable itself is discarded by the writer, when it takes it from the queue.
+  if(!(expected & PENDING_QUEUED)) destroyVariable((Variable *) expected);
 
-  desc = calloc(1, sizeof(*desc));
-  if(!desc) {
-    perror("ERROR! alloc of cached table descriptor");
-    exit(errno);
-  }
+  return TRUE;
+}
 
-  desc->id = strdup(id);
-  if(!desc->id) {
-    perror("ERROR! copy cached table id");
-    exit(errno);
-  }
-  desc->index = idx;
-  desc->cols = getSampleCount(u);
 
-  if(u->field.type == X_STRING) getStringType(getEnclosingStringLength(&u->field, u->sampling), desc->sqlType);
-  else if(printSQLType(u->field.type, desc->sqlType) < 0) {
-    fprintf(stderr, "WARNING! add variable: unsupported xchange type '%c'.\n", u->field.type);
-    goto add_table_cleanup; // @suppress("Goto statement used")
-  }
+/**
+ * Resolves a variable that a writer has taken from its queue to the latest data for the same
+ * variable, if the data was coalesced while it was queued. The variable taken from the queue is
+ * destroyed if newer data replaced it.
+ *
+ * @param u   Pointer to the variable taken from the queue
+ * @return    The latest data for the variable, to be inserted into the database.
+ *
+ * @sa coalesceVariable()
+ */
+static Variable *takePending(Variable *u) {
+  Variable *latest;
 
-  e.key = desc->id;
-  e.data = desc;
+  if(!u->pending) return u;
 
-  if(!hsearch_r(e, ENTER, &added, &lookup)) {
-    fprintf(stderr, "WARNING! could not cache new variable.\n");
-    goto add_table_cleanup; // @suppress("Goto statement used")
-  }
+  latest = (Variable *) (atomic_exchange((atomic_uintptr_t *) u->pending, 0) & ~PENDING_QUEUED);
+  u->pending = NULL;
 
-  return desc;
+  if(!latest || latest == u) return u;
 
-  // ----------------------------------------------------------------
+  dprintf("Coalesced %s: inserting the latest of several queued samples.\n", u->id);
+
+  destroyVariable(u);
+  return latest;
+}
+
+
+/**
+ * Add the variable to the queue for database insertion, of the writer that handles the variable. The
+ * variable is pushed to the writer's queue via an atomic compare-and-swap, and the writer is woken only if
+ * its queue was empty. If the queue is full (see getMaxQueueRows() and getMaxQueueBytes()), the
+ * configured overflow policy applies: the call may block until there is space, or the variable may be
+ * dropped or spilled to disk instead. While there is spilled data, new data is spilled also, behind it.
+ * Data for variables that are coalesced under backlog may replace the data for the same variable that is
+ * still in the queue, rather than being queued itself.
+ *
+ * @param u   Pointer to the variable data structure
+ * @return    SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1; errno will indicate the type
+ *            of error).
+ */
+int insertQueue(Variable *u) {
+  TableDescriptor *t;
+
+  if(!u) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  pthread_once(&writersOnce, initWriters);
+
+  u->queueBytes = getFootprint(u);
+  u->pending = NULL;
+
+  // While tables are still loading in the background, load the ones with queued data first.
+  if(atomic_load(&loader.isRunning)) {
+    t = u->interned ? getIndexedTableDescriptor(u->interned) : getCachedTableDescriptor(u->id);
+    if(t) requestLoad(t);
+  }
+
+  // Once data was spilled, new data follows it through the spill file, until the spill file is drained,
+  // so that it is not inserted ahead of earlier data for the same variable.
+  if(getQueueOverflow() == QUEUE_SPILL) if(atomic_load(&queued.spillRows) > 0) {
+    if(spillVariable(u) == SUCCESS_RETURN) {
+      if(!isQueueFull(0.5)) unspill();
+      return SUCCESS_RETURN;
+    }
+  }
+
+  t = getCoalescingTable(u);
+  if(t) if(coalesceVariable(u, t, FALSE)) return SUCCESS_RETURN;
+
+  if(isQueueFull(1.0)) switch(getQueueOverflow()) {
+    case QUEUE_DROP_OLDEST:
+      // Writers drop the oldest data as they take it. But, if they are stuck (e.g. waiting on the
+      // database), we drop the new data beyond a hard limit.
+      if(isQueueFull(2.0)) {
+        dropVariable(u);
+        return SUCCESS_RETURN;
+      }
+      break;
+
+    case QUEUE_DROP_OPTIONAL:
+      if(!u->force) {
+        dropVariable(u);
+        return SUCCESS_RETURN;
+      }
+      waitForSpace();
+      break;
+
+    case QUEUE_SPILL:
+      if(spillVariable(u) == SUCCESS_RETURN) return SUCCESS_RETURN;
+      waitForSpace();
+      break;
+
+    default:
+      waitForSpace();
+  }
+
+  if(t) if(coalesceVariable(u, t, TRUE)) return SUCCESS_RETURN;
+
+  pushQueue(u);
+
+  return SUCCESS_RETURN;
+}
+
+
+static int shorten(char *str, const char *match, const char *replacement) {
+  if(!str || !match || !replacement) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(strlen(match) < strlen(replacement)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  char *from = strstr(str, match);
+  if(from) {
+    char *rest = strdup(from + strlen(match));
+    if(rest) {
+      sprintf(from, "%s%s", replacement, rest);
+      free(rest);
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * Checks the names of the data columns of a table, and renames the ones that do not follow the
+ * expected naming convention. Inside a transaction, each rename is isolated in a savepoint, so
+ * that a failure does not abort the enclosing transaction.
+ *
+ * @param id              The SMA-X variable ID (for reporting)
+ * @param table           The table index
+ * @param names           The space-separated list of data column names, in order.
+ * @param nCols           The number of data columns.
+ * @param inTransaction   Whether the caller is inside a transaction block.
+ */
+static void sqlFixColumnNames(const char *id, int table, char *names, int nCols, boolean inTransaction) {
+  char colFmt[SQL_COL_NAME_LEN];
+  char *name, *next = NULL;
+  int k;
+
+  printColumnFormat(nCols, colFmt);
+
+  name = strtok_r(names, " ", &next);
+
+  for(k = 0; k < nCols && name; k++, name = strtok_r(NULL, " ", &next)) {
+    char colName[SQL_COL_NAME_LEN];
+
+    sprintf(colName, colFmt, k);
+
+    if(strcmp(name, colName) != 0) {
+      fprintf(stderr, "!FIX! %s: column name %s -> %s\n", id, name, colName);
+      ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + strlen(name));
+
+      if(!inTransaction) {
+        sprintf(cmd, "ALTER TABLE " TABLE_NAME_PATTERN " RENAME COLUMN %s TO %s;", table, name, colName);
+        sqlExecSimple(cmd);
+        continue;
+      }
+
+      sprintf(cmd, "SAVEPOINT " FIX_SAVEPOINT "; ALTER TABLE " TABLE_NAME_PATTERN " RENAME COLUMN %s TO %s; "
+              "RELEASE SAVEPOINT " FIX_SAVEPOINT ";", table, name, colName);
+      if(!sqlExecSimple(cmd)) sqlExecSimple("ROLLBACK TO SAVEPOINT " FIX_SAVEPOINT "; RELEASE SAVEPOINT " FIX_SAVEPOINT ";");
+    }
+  }
+}
+
+
+/**
+ * Creates a new table descriptor from a row of the table layout query, fixing up column names
+ * as necessary. The returned descriptor has hasMeta set if the table has an associated
+ * metadata table, from which the last metadata has yet to be loaded.
+ *
+ * @param res             The result of the table layout query (or a FETCH from its cursor).
+ * @param row             The row index in the result.
+ * @param inTransaction   Whether the caller is inside a transaction block.
+ * @return                A newly allocated table descriptor, or NULL if the row is not for a data table.
+ *
+ * @sa SQL_TABLE_LAYOUT
+ */
+static TableDescriptor *parseTableLayout(PGresult *res, int row, boolean inTransaction) {
+  TableDescriptor *desc;
+  const char *id = PQgetvalue(res, row, 0);
+  char *storeType, *names;
+  int j, table = 0, nCols = 0;
+  const int max = (int) (sizeof(desc->sqlType) - 1);
+
+  if(!id || !*id) {
+    fprintf(stderr, "WARNING! NULL id in SQL entry.\n");
+    return NULL;
+  }
+
+  if(1 != sscanf(PQgetvalue(res, row, 1), "%d", &table)) {
+    fprintf(stderr, "WARNING! Invalid table id '%s'.\n", PQgetvalue(res, row, 1));
+    return NULL;
+  }
+
+  // Not a data table (contains no data)
+  if(PQgetisnull(res, row, 3)) return NULL;
+
+  // The column names start with the first data column.
+  names = PQgetvalue(res, row, 2);
+  nCols = 1;
+  for(j = 0; names[j]; j++) if(names[j] == ' ') nCols++;
+
+  desc = (TableDescriptor *) calloc(1, sizeof(*desc));
+  if(!desc) {
+    perror("ERROR! alloc table format description");
+    exit(errno);
+  }
+
+  // Share the interned copy of the ID.
+  desc->id = (char *) internId(id)->name;
+  desc->index = table;
+  desc->cols = nCols;
+
+  // The type of the first data column, converted to upper case...
+  storeType = PQgetvalue(res, row, 3);
+  for(j = 0; j < max && storeType[j]; j++) desc->sqlType[j] = toupper(storeType[j]);
+
+  // Substitute short forms
+  shorten(storeType, "CHARACTER VARIABLE", "VARCHAR");
+  shorten(storeType, "CHARCTER", "CHAR");
+
+  // Check and fix up column names.
+  sqlFixColumnNames(desc->id, table, names, nCols, inTransaction);
+
+  // For now, whether there is a metadata table at all...
+  desc->hasMeta = (*PQgetvalue(res, row, 4) == 't');
+
+  return desc;
+}
+
+
+/**
+ * Sets the column layout and last metadata of a cached table descriptor, which was created from the
+ * titles only, unless it has been loaded already.
+ *
+ * @param t         The cached table descriptor.
+ * @param loaded    A table descriptor with the column layout and last metadata of the same table.
+ *
+ * @sa isLoaded()
+ */
+static void setTableLayout(TableDescriptor *t, const TableDescriptor *loaded) {
+  pthread_mutex_lock(&loader.mutex);
+
+  if(!atomic_load(&t->isLoaded)) {
+    t->cols = loaded->cols;
+    memcpy(t->sqlType, loaded->sqlType, sizeof(t->sqlType));
+    t->hasMeta = loaded->hasMeta;
+    t->metaVersion = loaded->metaVersion;
+    t->sampling = loaded->sampling;
+    t->ndim = loaded->ndim;
+    memcpy(t->sizes, loaded->sizes, sizeof(t->sizes));
+    memcpy(t->unit, loaded->unit, sizeof(t->unit));
+    atomic_store(&t->isLoaded, TRUE);
+    loader.loaded++;
+  }
+
+  pthread_mutex_unlock(&loader.mutex);
+}
+
+
+/**
+ * Applies the table layouts and last metadata loaded for a set of tables to the cached table
+ * descriptors.
+ *
+ * @param descs     The loaded table descriptors, which are freed.
+ * @param n         The number of loaded table descriptors.
+ */
+static void applyTableLayouts(TableDescriptor **descs, int n) {
+  int i;
+
+  for(i = 0; i < n; i++) {
+    TableDescriptor *t = getCachedTableDescriptor(descs[i]->id);
+    if(t) if(t->index == descs[i]->index) setTableLayout(t, descs[i]);
+    free(descs[i]);
+  }
+}
+
+
+/**
+ * Checks if the column layout and last metadata of a cached table descriptor have been loaded.
+ *
+ * @param t     The cached table descriptor
+ * @return      TRUE (1) if the table descriptor is complete, or else FALSE (0).
+ */
+static boolean isLoaded(TableDescriptor *t) {
+  return atomic_load(&t->isLoaded);
+}
+
+
+/**
+ * Loads the column layout and last metadata of a cached table descriptor, which was created from the
+ * titles only, using the connection of the calling writer. It is called by writers when they first
+ * use a table that the background loader has not got to yet.
+ *
+ * @param t     The cached table descriptor
+ * @return      TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlLoadTable(TableDescriptor *t) {
+  PGresult *res;
+  TableDescriptor *loaded = NULL;
+
+  ensureCommandCapacity(sizeof(SQL_TABLE_LAYOUT) + sizeof(SQL_TABLE_LAYOUT_GROUPING) + 100);
+  sprintf(cmd, "%s WHERE t.tid = %d %s;", SQL_TABLE_LAYOUT, t->index, SQL_TABLE_LAYOUT_GROUPING);
+
+  if(!sqlExec(cmd, &res)) return FALSE;
+
+  if(PQntuples(res) > 0) loaded = parseTableLayout(res, 0, batch.isOpen);
+  PQclear(res);
+
+  if(!loaded) {
+    fprintf(stderr, "WARNING! %s: no data table " TABLE_NAME_PATTERN ".\n", t->id, t->index);
+    errno = ENOENT;
+    return FALSE;
+  }
+
+  sqlGetLastMeta(&loaded, 1);
+  applyTableLayouts(&loaded, 1);
+
+  return TRUE;
+}
+
+
+/**
+ * Asks the background loader to load a cached table descriptor ahead of the others, e.g. because
+ * there is data for it in the queue. It does nothing if the table descriptor is already loaded, or
+ * if the background loader is no longer running.
+ *
+ * @param t     The cached table descriptor
+ */
+static void requestLoad(TableDescriptor *t) {
+  if(isLoaded(t)) return;
+  if(atomic_exchange(&t->isRequested, TRUE)) return;
+
+  pthread_mutex_lock(&loader.mutex);
+
+  if(loader.isRunning) {
+    if(loader.nRequested >= loader.capacity) {
+      int n = loader.capacity ? 2 * loader.capacity : LOADER_FETCH_SIZE;
+      TableDescriptor **r = (TableDescriptor **) realloc(loader.requested, n * sizeof(*r));
+      if(r) {
+        loader.requested = r;
+        loader.capacity = n;
+      }
+    }
+    if(loader.nRequested < loader.capacity) loader.requested[loader.nRequested++] = t;
+  }
+
+  pthread_mutex_unlock(&loader.mutex);
+}
+
+
+/**
+ * Loads the table descriptors that were requested ahead of the others, up to LOADER_FETCH_SIZE at a time.
+ *
+ * @param descs     Buffer for up to LOADER_FETCH_SIZE table descriptors.
+ * @return          The number of queries used.
+ */
+static int loadRequested(TableDescriptor **descs) {
+  int nQueries = 0;
+
+  for(;;) {
+    PGresult *res;
+    char *next;
+    int i, n, nDescs = 0;
+
+    pthread_mutex_lock(&loader.mutex);
+
+    n = loader.nRequested < LOADER_FETCH_SIZE ? loader.nRequested : LOADER_FETCH_SIZE;
+    if(n > 0) {
+      ensureCommandCapacity(sizeof(SQL_TABLE_LAYOUT) + sizeof(SQL_TABLE_LAYOUT_GROUPING) + 100 + 12 * n);
+      next = cmd + sprintf(cmd, "%s WHERE t.tid IN (", SQL_TABLE_LAYOUT);
+      for(i = 0; i < n; i++) next += sprintf(next, "%s%d", i ? "," : "", loader.requested[--loader.nRequested]->index);
+      sprintf(next, ") %s;", SQL_TABLE_LAYOUT_GROUPING);
+    }
+
+    pthread_mutex_unlock(&loader.mutex);
+
+    if(n <= 0) return nQueries;
+
+    if(!sqlExec(cmd, &res)) return nQueries;
+    nQueries++;
+
+    n = PQntuples(res);
+    for(i = 0; i < n; i++) {
+      TableDescriptor *desc = parseTableLayout(res, i, TRUE);
+      if(desc) descs[nDescs++] = desc;
+    }
+
+    PQclear(res);
+
+    if(!nDescs) continue;
+
+    sqlGetLastMeta(descs, nDescs);
+    nQueries++;
+
+    applyTableLayouts(descs, nDescs);
+  }
+}
+
+
+/**
+ * The background loader thread, which loads the column layouts and last metadata of all cached
+ * tables, using its own connection. The column layouts of all tables are obtained from the system
+ * catalog in a single query, which is streamed through a cursor LOADER_FETCH_SIZE tables at a time.
+ * The last metadata for each fetched set of tables is then obtained with one more query. Tables that
+ * are requested ahead of the others (because data is waiting for them in the queue) are loaded in
+ * between fetches.
+ *
+ * @param arg   Unused
+ * @return      NULL
+ */
+static void *LoaderThread(void *arg) {
+  TableDescriptor **descs;
+  struct timespec start, end;
+  int nQueries = 0;
+  boolean isComplete = FALSE;
+
+  (void) arg;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  descs = (TableDescriptor **) calloc(LOADER_FETCH_SIZE, sizeof(*descs));
+  if(!descs) {
+    perror("ERROR! alloc loaded tables");
+    exit(errno);
+  }
+
+  if(sqlConnectRetry(CONNECT_RETRY_ATTEMPTS) != SUCCESS_RETURN) {
+    fprintf(stderr, "WARNING! Tables will be loaded on first use only.\n");
+    goto loader_cleanup; // @suppress("Goto statement used")
+  }
+
+  // The cursor lives inside a transaction.
+  if(!sqlExecSimple("BEGIN;")) goto loader_cleanup; // @suppress("Goto statement used")
+  nQueries++;
+
+  ensureCommandCapacity(sizeof(SQL_TABLE_LAYOUT) + sizeof(SQL_TABLE_LAYOUT_GROUPING) + 100);
+  sprintf(cmd, "DECLARE " LOADER_CURSOR " NO SCROLL CURSOR FOR %s %s;", SQL_TABLE_LAYOUT, SQL_TABLE_LAYOUT_GROUPING);
+  if(!sqlExecSimple(cmd)) goto loader_cleanup; // @suppress("Goto statement used")
+  nQueries++;
+
+  for(;;) {
+    PGresult *res;
+    int i, n, nDescs = 0;
+    boolean hasMeta = FALSE;
+
+    nQueries += loadRequested(descs);
+
+    sprintf(cmd, "FETCH FORWARD %d FROM " LOADER_CURSOR ";", LOADER_FETCH_SIZE);
+    if(!sqlExec(cmd, &res)) break;
+    nQueries++;
+
+    n = PQntuples(res);
+    for(i = 0; i < n; i++) {
+      TableDescriptor *desc;
+
+      // Skip the tables that were loaded already, on request or on first use.
+      TableDescriptor *t = getCachedTableDescriptor(PQgetvalue(res, i, 0));
+      if(t) if(isLoaded(t)) continue;
+
+      desc = parseTableLayout(res, i, TRUE);
+      if(!desc) continue;
+      if(desc->hasMeta) hasMeta = TRUE;
+      descs[nDescs++] = desc;
+    }
+
+    PQclear(res);
+
+    if(hasMeta) {
+      sqlGetLastMeta(descs, nDescs);
+      nQueries++;
+    }
+
+    applyTableLayouts(descs, nDescs);
+
+    if(n < LOADER_FETCH_SIZE) {
+      isComplete = TRUE;
+      break;
+    }
+  }
+
+  sqlExecSimple("CLOSE " LOADER_CURSOR "; COMMIT;");
+  nQueries++;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("Loaded %d table layouts in %.3f s, using %d queries.\n", loader.loaded,
+          (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec), nQueries);
+
+  if(isComplete) writeSchemaCache(&schemaFingerprint);
+
+  // ----------------------------------------------------------------
+  loader_cleanup:
+
+  // Writers load whatever is left on first use.
+  pthread_mutex_lock(&loader.mutex);
+  loader.isRunning = FALSE;
+  loader.nRequested = 0;
+  pthread_mutex_unlock(&loader.mutex);
+
+  free(descs);
+
+  if(sql_db) {
+    PQfinish(sql_db);
+    sql_db = NULL;
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Adds a table descriptor to the local cache.
+ *
+ * @param desc    The table descriptor
+ * @return        TRUE (1) if successful, or else FALSE (0).
+ */
+static boolean cacheTableDescriptor(TableDescriptor *desc) {
+  int success;
+
+  pthread_rwlock_wrlock(&lookupLock);
+  success = hashMapPut(lookup, desc->id, desc, NULL) >= 0;
+  if(success) setIndexedTableDescriptor(internId(desc->id), desc);
+  pthread_rwlock_unlock(&lookupLock);
+
+  if(!success) {
+    fprintf(stderr, "WARNING! could not cache table id for '%s'.\n", desc->id);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/**
+ * Gets the current fingerprint of the database schema, by which to validate the schema cache file.
+ *
+ * @param[out] f    The fingerprint to set.
+ * @return          TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlGetSchemaFingerprint(SchemaFingerprint *f) {
+  PGresult *res;
+  long long maxTid = 0, changes = 0;
+  int success;
+
+  if(!sqlExec("SELECT (SELECT coalesce(max(tid), 0) FROM " MASTER_TABLE "), "
+          "(SELECT last_value + is_called::int FROM " SCHEMA_COUNTER ");", &res)) return FALSE;
+
+  success = PQntuples(res) > 0;
+  if(success) success = sscanf(PQgetvalue(res, 0, 0), "%lld", &maxTid) == 1;
+  if(success) success = sscanf(PQgetvalue(res, 0, 1), "%lld", &changes) == 1;
+
+  PQclear(res);
+
+  f->maxTid = maxTid;
+  f->changes = changes;
+
+  return success;
+}
+
+
+/**
+ * Advances the schema change counter in the database, before the calling writer first changes a table
+ * layout, adds metadata, or deletes a variable, so that the schema cache file is no longer considered up to date with the
+ * database. It does nothing unless a schema cache is configured.
+ *
+ * @sa getSchemaCacheFile()
+ */
+static void sqlNoteSchemaChange() {
+  if(isSchemaNoted || !hasSchemaCounter) return;
+
+  atomic_fetch_add(&schemaChanges, 1);
+  if(sqlExecStatement("SELECT nextval('" SCHEMA_COUNTER "');")) isSchemaNoted = TRUE;
+}
+
+
+/**
+ * Populates the table cache from the schema cache file, if there is one and it matches the current
+ * fingerprint of the database schema. The file is memory mapped and read in place.
+ *
+ * @return    The number of tables cached from the file, or -1 if the file was not used.
+ *
+ * @sa writeSchemaCache()
+ */
+static int loadSchemaCache() {
+  const char *path = getSchemaCacheFile();
+  const SchemaCacheHeader *h;
+  const SchemaCacheRecord *r;
+  const char *map;
+  struct stat st;
+  int fd, n = -1;
+  int64_t i;
+
+  if(!path || !hasSchemaCounter) return -1;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    if(errno != ENOENT) fprintf(stderr, "WARNING! schema cache %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(*h)) {
+    close(fd);
+    fprintf(stderr, "WARNING! schema cache %s: invalid file.\n", path);
+    return -1;
+  }
+
+  map = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if(map == MAP_FAILED) {
+    fprintf(stderr, "WARNING! schema cache %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  h = (const SchemaCacheHeader *) map;
+  r = (const SchemaCacheRecord *) &h[1];
+
+  if(memcmp(h->magic, SCHEMA_CACHE_MAGIC, sizeof(h->magic)) != 0 || h->size != st.st_size || h->count < 0 ||
+          h->count > (int64_t) ((st.st_size - sizeof(*h)) / sizeof(*r))) {
+    fprintf(stderr, "WARNING! schema cache %s: invalid file.\n", path);
+    goto load_cleanup; // @suppress("Goto statement used")
+  }
+
+  if(h->fingerprint.maxTid != schemaFingerprint.maxTid || h->fingerprint.changes != schemaFingerprint.changes) {
+    printf("Schema cache %s is out of date.\n", path);
+    goto load_cleanup; // @suppress("Goto statement used")
+  }
+
+  for(n = 0, i = 0; i < h->count; i++, r++) {
+    TableDescriptor *desc;
+
+    if(r->idOffset < (int64_t) sizeof(*h) || r->idOffset >= h->size) continue;
+    if(!memchr(&map[r->idOffset], '\0', h->size - r->idOffset)) continue;
+
+    desc = (TableDescriptor *) calloc(1, sizeof(*desc));
+    if(!desc) {
+      perror("ERROR! alloc table format description");
+      exit(errno);
+    }
+
+    // Share the interned copy of the ID.
+    desc->id = (char *) internId(&map[r->idOffset])->name;
+    desc->index = r->index;
+    desc->cols = r->cols;
+    memcpy(desc->sqlType, r->sqlType, sizeof(desc->sqlType) - 1);
+    desc->hasMeta = r->hasMeta;
+    desc->metaVersion = r->metaVersion;
+    desc->sampling = r->sampling;
+    desc->ndim = r->ndim;
+    memcpy(desc->sizes, r->sizes, sizeof(desc->sizes));
+    memcpy(desc->unit, r->unit, sizeof(desc->unit) - 1);
+    desc->isLoaded = TRUE;
+
+    if(!cacheTableDescriptor(desc)) {
+      free(desc);
+      break;
+    }
+
+    n++;
+  }
+
+  // ----------------------------------------------------------------
+  load_cleanup:
+
+  munmap((void *) map, st.st_size);
+
+  return n;
+}
+
+
+/**
+ * Writes the loaded table descriptors to the schema cache file, with the given fingerprint of the
+ * database schema. The file is replaced atomically, by writing a temporary file first, which is then
+ * renamed. The file is not written (or it is removed) if a writer changes a table layout or metadata
+ * in the meantime.
+ *
+ * @param f     The fingerprint of the database schema from before the tables were loaded.
+ *
+ * @sa loadSchemaCache()
+ */
+static void writeSchemaCache(const SchemaFingerprint *f) {
+  const char *path = getSchemaCacheFile();
+  SchemaCacheHeader h;
+  char *tmp;
+  FILE *fp;
+  int64_t offset;
+  int i;
+
+  if(!path || !hasSchemaCounter) return;
+  if(atomic_load(&schemaChanges)) return;
+
+  tmp = (char *) malloc(strlen(path) + 5);
+  if(!tmp) return;
+  sprintf(tmp, "%s.tmp", path);
+
+  fp = fopen(tmp, "w");
+  if(!fp) {
+    fprintf(stderr, "WARNING! schema cache %s: %s\n", tmp, strerror(errno));
+    free(tmp);
+    return;
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, SCHEMA_CACHE_MAGIC, sizeof(h.magic));
+  h.fingerprint = *f;
+
+  pthread_rwlock_rdlock(&lookupLock);
+
+  for(i = 0; i < nIndexed; i++) if(indexed[i]) if(isLoaded(indexed[i])) {
+    h.count++;
+    h.size += strlen(indexed[i]->id) + 1;
+  }
+
+  offset = sizeof(h) + h.count * sizeof(SchemaCacheRecord);
+  h.size += offset;
+
+  fwrite(&h, sizeof(h), 1, fp);
+
+  for(i = 0; i < nIndexed; i++) if(indexed[i]) if(isLoaded(indexed[i])) {
+    const TableDescriptor *t = indexed[i];
+    SchemaCacheRecord r;
+
+    memset(&r, 0, sizeof(r));
+    r.idOffset = offset;
+    r.index = t->index;
+    r.cols = t->cols;
+    memcpy(r.sqlType, t->sqlType, sizeof(r.sqlType));
+    r.hasMeta = t->hasMeta;
+    r.metaVersion = t->metaVersion;
+    r.sampling = t->sampling;
+    r.ndim = t->ndim;
+    memcpy(r.sizes, t->sizes, sizeof(r.sizes));
+    memcpy(r.unit, t->unit, sizeof(r.unit));
+
+    fwrite(&r, sizeof(r), 1, fp);
+    offset += strlen(t->id) + 1;
+  }
+
+  for(i = 0; i < nIndexed; i++) if(indexed[i]) if(isLoaded(indexed[i]))
+    fwrite(indexed[i]->id, strlen(indexed[i]->id) + 1, 1, fp);
+
+  pthread_rwlock_unlock(&lookupLock);
+
+  if(fflush(fp) != 0 || fsync(fileno(fp)) != 0 || ferror(fp)) {
+    fprintf(stderr, "WARNING! schema cache %s: %s\n", tmp, strerror(errno));
+    fclose(fp);
+    unlink(tmp);
+  }
+  else if(fclose(fp) != 0 || atomic_load(&schemaChanges)) unlink(tmp);
+  else if(rename(tmp, path) != 0) {
+    fprintf(stderr, "WARNING! schema cache %s: %s\n", path, strerror(errno));
+    unlink(tmp);
+  }
+  else {
+    printf("Wrote %lld tables to schema cache %s.\n", (long long) h.count, path);
+
+    // A writer may have changed a table between the check above and the rename.
+    if(atomic_load(&schemaChanges)) unlink(path);
+  }
+
+  free(tmp);
+}
+
+
+/**
+ * Initializes the local table ID lookup for variables, for efficient data insertions.
+ * It queries the SQL database for existing tables (variables) to create the cache,
+ * which grows as needed to accommodate any number of variables.
+ *
+ * If there is an up-to-date schema cache file, the cache is populated from it, without querying the
+ * tables at all. Otherwise, only the titles (variable ID to table index) are loaded up front, so that
+ * ingest can start right away. The column layouts and last metadata of the tables are loaded by a
+ * background loader, or else by the writers when they first use a table.
+ *
+ * @sa LoaderThread()
+ * @sa sqlLoadTable()
+ */
+static void initCache() {
+  PGresult *tables;
+  struct timespec start, end;
+  int nTitles, i, nTables = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // Create a hashtable for caching/lookup of translation tables.
+  lookup = hashMapCreate(MIN_CACHED);
+
+  // The schema change counter, and the current schema fingerprint, for validating the schema cache file.
+  // These are used only with a schema cache, so that the database is left alone otherwise.
+  if(getSchemaCacheFile()) {
+    hasSchemaCounter = sqlExecSimple("CREATE SEQUENCE IF NOT EXISTS " SCHEMA_COUNTER ";");
+    if(hasSchemaCounter) hasSchemaCounter = sqlGetSchemaFingerprint(&schemaFingerprint);
+  }
+
+  nTables = loadSchemaCache();
+  if(nTables >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Cached %d tables from %s in %.3f s.\n", nTables, getSchemaCacheFile(),
+            (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec));
+    return;
+  }
+
+  nTables = 0;
+
+  // Get all existing Titles, and cache them
+  if(!sqlExec("SELECT " VARNAME_ID ", tid FROM " MASTER_TABLE ";", &tables)) {
+    PQfinish(sql_db);
+    exit(ERROR_EXIT);
+  }
+
+  nTitles = PQntuples(tables);
+  printf("Found %d titles in DB\n", nTitles);
+
+  for(i = 0; i < nTitles; i++) {
+    TableDescriptor *desc;
+    const char *id = PQgetvalue(tables, i, 0);
+    int table = 0;
+
+    if(!id || !*id) {
+      fprintf(stderr, "WARNING! NULL id in SQL entry.\n");
+      continue;
+    }
+
+    if(1 != sscanf(PQgetvalue(tables, i, 1), "%d", &table)) {
+      fprintf(stderr, "WARNING! Invalid table id '%s'.\n", PQgetvalue(tables, i, 1));
+      continue;
+    }
+
+    desc = (TableDescriptor *) calloc(1, sizeof(*desc));
+    if(!desc) {
+      perror("ERROR! alloc table format description");
+      exit(errno);
+    }
+
+    // Share the interned copy of the ID.
+    desc->id = (char *) internId(id)->name;
+    desc->index = table;
+
+    if(!cacheTableDescriptor(desc)) {
+      free(desc);
+      break;
+    }
+
+    nTables++;
+  }
+
+  PQclear(tables);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("Cached %d tables in %.3f s.\n", nTables, (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec));
+
+  // Load the rest in the background
+  loader.isRunning = TRUE;
+  if(pthread_create(&loader.thread, NULL, LoaderThread, NULL) != 0) {
+    perror("WARNING! could not start background table loader");
+    loader.isRunning = FALSE;
+  }
+  else pthread_detach(loader.thread);
+}
+
+
+/**
+ *  Allocates or reallocates a sufficiently sized buffer for storing the SQL command.
+ *
+ *  \param n        Number of bytes needed in the cmd variable.
+ *
+ *  \return         SUCCESS_RETURN (0) if cmd can accomonade the requested number of
+ *                  bytes, or ERROR_RETURN if the (re)allocation failed.
+ */
+static int ensureCommandCapacity(int n) {
+  static __thread int cmdSize = 0;
+
+  // Don't bother with tiny buffers, start with an minimum...
+  if(n < MIN_CMD_SIZE) n = MIN_CMD_SIZE;
+
+  if(!cmd) {
+    cmdSize = n;
+    cmd = malloc(cmdSize);
+  }
+  else if(n > cmdSize) {
+    cmdSize = n;
+    cmd = realloc(cmd, cmdSize);
+    x_check_alloc(cmd);
+
+    dprintf("Growing command buffer to %d bytes.\n", cmdSize);
+  }
+
+  if(!cmd) {
+    fprintf(stderr, "ERROR! malloc command (%d bytes).\n", n);
+    exit(ERROR_EXIT);
+  }
+
+  return SUCCESS_RETURN;
+}
+
+
+
+
+/**
+ * Returns the maximum string size required for representing this type when sending it to
+ * the database.
+ *
+ * \param type      Variable type, e.g. SHORT_TYPE
+ *
+ * \return          Maximum string size to represent a value of this type.
+ *
+ */
+static int getStringSize(XType type) {
+  if(xIsCharSequence(type)) return xElementSizeOf(type) + 2;  // including quotes
+  return xStringElementSizeOf(type);
+}
+
+
+/**
+ * Converts a string or fixed-length character array to representation in SQL, enclosing it in single quotes,
+ * and escaping any single quotes within. It support the full set of extended ASCII characters.
+ *
+ * @param s     An ASCII string value
+ * @param l     (bytes) The length of the string which may be unterminated.
+ * @param dst   Destination buffer in which to write string.
+ *
+ * @return      Pointer to the position after the SQL-ized string in the destination buffer
+ */
+static char *printSQLString(const char *s, int l, char *dst) {
+  int i;
+
+  if(!s || !dst) {
+    errno = EINVAL;
+    return dst;
+  }
+
+  *(dst++) = '\'';
+
+  for(i=0; i < l && s[i]; i++) {
+    const char c = s[i];
+    *(dst++) = c;
+    if(c == '\'') *(dst++) = '\'';        // escape single quotes by doubling them
+  }
+
+  *(dst++) = '\'';
+
+  return dst;
+}
+
+
+/**
+ * Appends the SQL variable type for the given local data type at the given
+ * string location, and returns the string location after the appended
+ * variable type.
+ *
+ * \param type          The xchange data type, e.g. X_SHORT
+ * \param dst           String location at which to append the corresponding
+ *                      SQL type.
+ *
+ * \return              The number of characters printed
+ *
+ */
+static int printSQLType(XType type, char *dst) {
+  if(!dst) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  if(xIsCharSequence(type)) {
+    return getStringType(xElementSizeOf(type), dst);
+  }
+  else switch (type) {
+    case X_BOOLEAN:
+      return sprintf(dst, SQL_BOOLEAN);
+    case X_BYTE:
+      return sprintf(dst, SQL_INT8);
+    case X_INT16:
+      return sprintf(dst, SQL_INT16);
+    case X_INT32:
+      return sprintf(dst, SQL_INT32);
+    case X_INT64:
+      return sprintf(dst, SQL_INT64);
+    case X_FLOAT:
+      return sprintf(dst, SQL_FLOAT);
+    case X_DOUBLE:
+      return sprintf(dst, SQL_DOUBLE);
+    default:
+      fprintf(stderr, "WARNING! no matching SQL type (%d)\n", type);
+  }
+
+  errno = EBADR;
+  return ERROR_RETURN;
+}
+
+
+static int cmpSQLType(const char *a, const char *b) {
+  static const char *types = SQL_INT8 " " SQL_INT16 " " SQL_INT32 " " SQL_INT64 " " SQL_FLOAT " " SQL_DOUBLE;
+
+  int na, nb;
+
+  if(strcmp(a, b) == 0) return 0;
+
+  // VARCHAR is deprecated in PostgreSQL now, but we'll consider it nevertheless -- just in case
+  if(sscanf(a, "VARCHAR(%d)", &na) == 1) {
+    if(sscanf(b, "VARCHAR(%d)", &nb) == 1) return na - nb;
+    return -1;
+  }
+
+  return (int) (strstr(types, a) - strstr(types, b));
+}
+
+
+/**
+ * Appends the values stored in the variable as a comma-separated list starting at the specified string
+ * location, returning the string location immediately after the appended list.
+ *
+ * \param u     Pointer to the variable
+ * \param dst   String location at which to append string list of elements
+ *
+ * \return      String location after the insertion (or same as dst if no string were appended).
+ *
+ */
+static char *appendValues(const Variable *u, char *dst) {
+  const XField *f;
+  int eSize, step = 1;
+
+  if(!u || !dst) {
+    errno = EINVAL;
+    return dst;
+  }
+
+  f = &u->field;
+  if(!f->value) {
+    errno = EINVAL;
+    return dst;
+  }
+
+  if(f->isSerialized) return appendSerializedValues((Variable *) u, dst);
+
+  eSize = xElementSizeOf(f->type);
+
+  if(u->sampling > 1) step = u->sampling;
+
+  if(f->ndim > 0) {
+    char *data = (char *) f->value;
+    int i, n = getSampleCount(u);
+    for(i = 0; i < n; i++) dst = appendValue(&data[i * step * eSize], f->type, dst);
+  }
+  else dst = appendValue(f->value, f->type, dst);
+
+  return dst;
+}
+
+
+/**
+ * Appends a string representation of an elemental value (with a preceding comma)
+ * at the specified location, returning the location immediately after the appended
+ * string.
+ *
+ * \param data          Pointer to the binary element
+ * \param type          Element type, e.g. SHORT_TYPE
+ * \param elementSize   Bytes occupied by this element
+ * \param dst           String location to append value at.
+ *
+ * \return              String location after the inserted element.
+ */
+static char *appendValue(const void *data, XType type, char *dst) {
+  if(!dst) {
+    errno = EINVAL;
+    return dst;
+  }
+
+  dst += sprintf(dst, SQL_SEP);
+
+  if(xIsCharSequence(type)) {
+    return printSQLString((char *) data, xElementSizeOf(type), dst);
+  }
+
+  if (!data) return dst + sprintf(dst, "NULL");
+
+  switch (type) {
+
+    case X_BOOLEAN: return dst + sprintf(dst, "%s",*(boolean *) data ? "true" : "false");
+
+    case X_BYTE: return printLong(*(char *) data, dst);
+
+    case X_SHORT: return printLong(*(int16_t *) data, dst);
+
+    case X_INT: return printLong(*(int32_t *) data, dst);
+
+    case X_LONG: return printLong(*(int64_t *) data, dst);
+
+    case X_FLOAT: {
+      float f = *(float *) data;
+      if(isfinite(f)) return printFloat(f, dst);      // exact round-trip
+      return dst + sprintf(dst, "'NaN'");
+    }
+
+    case X_DOUBLE: {
+      // SQL can be a bit picky with extreme doubles so apply some sanity here...
+      double d = *(double *) data;
+      if(isfinite(d)) {
+        double a = fabs(d);
+        if(a < SQL_MIN_DOUBLE) return dst + sprintf(dst, "0.0");
+        if(a > SQL_MAX_DOUBLE) return dst + sprintf(dst, "'NaN'");
+        return printDouble(d, dst);     // exact round-trip
+      }
+      return dst + sprintf(dst, "'NaN'");
+    }
+
+    case X_STRING: {
+      const char *s = *(char **) data;
+      return printSQLString(s, strlen(s), dst);
+    }
+    default:
+      fprintf(stderr, "WARNING! addValue(): Unknown data type (%d)\n", type);
+      return dst + sprintf(dst, "NULL");
+  }
+
+  return dst;
+}
+
+
+/**
+ * Returns the largest number of decimal digits, with which an integer literal is guaranteed to fit into the
+ * given integer type.
+ *
+ * @param type    The integer type, e.g. X_INT
+ * @return        The maximum number of digits that are safe to pass through, or 0 if the type is not an
+ *                integer type.
+ */
+static int getSafeDigits(XType type) {
+  switch(type) {
+    case X_BYTE: return 2;
+    case X_SHORT: return 4;
+    case X_INT: return 9;
+    case X_LONG: return 18;
+    default: return 0;
+  }
+}
+
+
+/**
+ * Checks if a serialized SMA-X value can be inserted into the database as is. Integer values must have
+ * few enough digits to fit the type. Floating-point values must be well within the range that the
+ * database accepts, i.e. inside SQL_MIN_DOUBLE and SQL_MAX_DOUBLE for doubles, and the normal range of
+ * IEEE floats for floats.
+ *
+ * @param s       The serialized value (not terminated)
+ * @param len     Number of characters in the serialized value
+ * @param type    The SMA-X type of the value, e.g. X_DOUBLE
+ * @return        TRUE (1) if the serialized value can be inserted as is, or else FALSE (0).
+ */
+static boolean isValidLiteral(const char *s, int len, XType type) {
+  const char *end = s + len;
+  int intDigits = 0, fracDigits = 0, lead = 0, mag, exp10 = 0, expDigits = 0;
+  boolean isNonZero = FALSE, isFraction = FALSE, isExpNegative = FALSE;
+
+  if(*s == '-' || *s == '+') s++;
+
+  for(; s < end; s++) {
+    if(*s == '.') {
+      if(isFraction) return FALSE;
+      isFraction = TRUE;
+      continue;
+    }
+
+    if(!isdigit((unsigned char) *s)) break;
+
+    if(isFraction) fracDigits++;
+    else intDigits++;
+
+    // The decimal exponent of the leading non-zero digit
+    if(!isNonZero && *s != '0') {
+      isNonZero = TRUE;
+      lead = isFraction ? -fracDigits : intDigits;
+    }
+  }
+
+  if(!intDigits && !fracDigits) return FALSE;
+
+  if(s < end) {
+    if(*s != 'e' && *s != 'E') return FALSE;
+    if(++s < end) if(*s == '-' || *s == '+') isExpNegative = (*(s++) == '-');
+
+    for(; s < end; s++, expDigits++) {
+      if(!isdigit((unsigned char) *s) || expDigits >= 4) return FALSE;
+      exp10 = 10 * exp10 + (*s - '0');
+    }
+
+    if(!expDigits) return FALSE;
+    if(isExpNegative) exp10 = -exp10;
+  }
+
+  if(type != X_FLOAT && type != X_DOUBLE) {
+    // Integers, in plain decimal notation only.
+    if(isFraction || expDigits) return FALSE;
+    return intDigits - lead < getSafeDigits(type);
+  }
+
+  if(!isNonZero) return TRUE;           // zero
+
+  mag = exp10 + (lead > 0 ? intDigits - lead : lead);
+
+  if(type == X_FLOAT) return mag >= -37 && mag <= 37;
+  return mag >= -100 && mag < 100;
+}
+
+
+/**
+ * Appends a serialized SMA-X value (with a preceding comma) at the specified location, as is if it is
+ * a valid SQL literal for the type, or else as printed from the parsed binary value.
+ *
+ * @param s       The serialized value, followed by a separator or string termination.
+ * @param len     Number of characters in the serialized value
+ * @param type    The SMA-X type of the value, e.g. X_DOUBLE
+ * @param dst     String location to append value at.
+ * @return        String location after the inserted element.
+ */
+static char *appendSerializedValue(const char *s, int len, XType type, char *dst) {
+  if(isValidLiteral(s, len, type)) {
+    dst += sprintf(dst, SQL_SEP);
+    memcpy(dst, s, len);
+    return dst + len;
+  }
+
+  // Parse and sanitize the same way as binary data
+  switch(type) {
+    case X_BYTE: {
+      char b = (char) strtol(s, NULL, 10);
+      return appendValue(&b, type, dst);
+    }
+    case X_SHORT: {
+      int16_t i = (int16_t) strtol(s, NULL, 10);
+      return appendValue(&i, type, dst);
+    }
+    case X_INT: {
+      int32_t i = (int32_t) strtol(s, NULL, 10);
+      return appendValue(&i, type, dst);
+    }
+    case X_LONG: {
+      int64_t l = (int64_t) strtoll(s, NULL, 10);
+      return appendValue(&l, type, dst);
+    }
+    case X_FLOAT: {
+      float f = strtof(s, NULL);
+      return appendValue(&f, type, dst);
+    }
+    default: {
+      double d = strtod(s, NULL);
+      return appendValue(&d, X_DOUBLE, dst);
+    }
+  }
+}
+
+
+/**
+ * Appends the serialized SMA-X values of a numerical variable as a comma-separated list, at the specified
+ * location, without converting them to binary first. Values are sampled the same way as binary data, and
+ * values that are not valid SQL literals for the type (or are outside of the range the database accepts),
+ * are parsed and printed the same way as binary data. If there are fewer values than expected, the
+ * variable is converted to binary, and the binary values are appended instead.
+ *
+ * @param u     Pointer to the variable, with serialized numerical values
+ * @param dst   String location at which to append string list of elements
+ * @return      String location after the insertion.
+ *
+ * @sa appendValues()
+ */
+static char *appendSerializedValues(Variable *u, char *dst) {
+  const XField *f = &u->field;
+  const char *next = (const char *) f->value;
+  char *start = dst;
+  int i = 0, k, step = 1, n = getSampleCount(u);
+
+  if(u->sampling > 1) step = u->sampling;
+
+  for(k = 0; i < n; k++) {
+    const char *s;
+    int len;
+
+    next += strspn(next, SMAX_SEPARATORS);
+    if(!*next) break;
+
+    s = next;
+    len = strcspn(next, SMAX_SEPARATORS);
+    next += len;
+
+    if(k % step) continue;
+
+    dst = appendSerializedValue(s, len, f->type, dst);
+    i++;
+  }
+
+  if(i < n) {
+    // Fewer values than expected, so let SMA-X parse them the usual way.
+    deserializeVariable(u);
+    return appendValues(u, start);
+  }
+
+  return dst;
+}
+
+
+/**
+ * Returns the cached table ID for a given compound variable name.
+ *
+ * \param name      The compund variable name, as returned by getLongName().
+ *
+ * \return          The cached table descriptor or else NULL if the table id for the
+ *                  given compound name is not cached.
+ *
+ * \sa getLongName()
+ */
+static TableDescriptor *getCachedTableDescriptor(const char *name) {
+  TableDescriptor *t;
+
+  if(!name) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pthread_rwlock_rdlock(&lookupLock);
+  t = (TableDescriptor *) hashMapGet(lookup, name);
+  pthread_rwlock_unlock(&lookupLock);
+
+  if(!t) {
+    dprintf("No cached entry for '%s'.\n", name);
+    return NULL;
+  }
+
+  dprintf("Found cached table number: %d\n", t->index);
+
+  return t;
+}
+
+
+/**
+ * Removes the table descriptor of a variable from the local cache, e.g. after the variable was deleted
+ * from the database. The descriptor itself is not freed, since writers may still hold it.
+ *
+ * \param name      The SMA-X variable ID.
+ *
+ * \return          The table descriptor that was removed, or NULL if there was none.
+ */
+static TableDescriptor *forgetTableDescriptor(const char *name) {
+  const InternedId *id = findInternedId(name);
+  TableDescriptor *t;
+
+  pthread_rwlock_wrlock(&lookupLock);
+  t = (TableDescriptor *) hashMapRemove(lookup, name);
+  if(id) setIndexedTableDescriptor(id, NULL);
+  pthread_rwlock_unlock(&lookupLock);
+
+  return t;
+}
+
+
+/**
+ * Returns the cached table descriptor for an interned variable ID, by the index of the ID.
+ *
+ * \param id        The interned SMA-X variable ID.
+ *
+ * \return          The cached table descriptor or else NULL if there is no cached table descriptor for the
+ *                  variable.
+ *
+ * \sa setIndexedTableDescriptor()
+ */
+static TableDescriptor *getIndexedTableDescriptor(const InternedId *id) {
+  TableDescriptor *t = NULL;
+
+  pthread_rwlock_rdlock(&lookupLock);
+  if(id->index < nIndexed) t = indexed[id->index];
+  pthread_rwlock_unlock(&lookupLock);
+
+  return t;
+}
+
+
+/**
+ * Caches a table descriptor by the index of the interned variable ID. The caller should hold the write lock
+ * of the lookup.
+ *
+ * \param id        The interned SMA-X variable ID.
+ * \param t         The table descriptor for the variable, or NULL to remove it.
+ *
+ * \sa getIndexedTableDescriptor()
+ */
+static void setIndexedTableDescriptor(const InternedId *id, TableDescriptor *t) {
+  if(id->index >= nIndexed) {
+    int n = nIndexed ? nIndexed : MIN_INDEXED;
+    TableDescriptor **old = indexed;
+
+    while(n <= id->index) n <<= 1;
+
+    indexed = (TableDescriptor **) realloc(indexed, n * sizeof(TableDescriptor *));
+    if(!indexed) {
+      perror("ERROR! grow indexed table descriptors");
+      free(old);
+      exit(errno);
+    }
+
+    memset(&indexed[nIndexed], 0, (n - nIndexed) * sizeof(TableDescriptor *));
+    nIndexed = n;
+  }
+
+  indexed[id->index] = t;
+}
+
+
+/**
+ * Gets the table ID number by which the database refers to the variable.
+ *
+ * \param u     Pointer to the variable
+ *
+ * \return      The corresponfing database table descritor or NULL if there was an error.
+ */
+static TableDescriptor *getTableDescriptor(const Variable *u) {
+  TableDescriptor *t;
+
+  if(!u) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  // Interned variables are looked up by index, without hashing their names.
+  t = u->interned ? getIndexedTableDescriptor(u->interned) : getCachedTableDescriptor(u->id);
+  if(!t) return addVariable(u->id, u);
+
+  // Load the table layout, if the background loader has not got to it yet.
+  if(!isLoaded(t)) if(!sqlLoadTable(t)) return NULL;
+
+  return t;
+}
+
+
+static int getEnclosingStringLength(const XField *f, int sampling) {
+  int i, n, max = DEFAULT_STRING_LEN;
+  char **s;
+
+  if(!f) {
+    errno = EINVAL;
+    return max;
+  }
+
+  if(sampling < 1) sampling = 1;
+
+  s = (char **) f->value;
+  n = xGetFieldCount(f);
+
+  for(i = 0; i < n; i += sampling) if(s[i]) {
+    int l = strlen(s[i]);
+    while(l > max) max <<= 1;
+  }
+
+  return max;
+}
+
+
+/**
+ * Adds a new table in the database to store data for the specified variable.
+ *
+ * \param id            The aggregated SMA-X variable ID.
+ * \param u             Pointer to the variable
+ *
+ * return               The table descriptor for the newly created entry in the database.
+ *                      or else NULL if there was an error.
+ */
+static TableDescriptor *addVariable(const char *id, const Variable *u) {
+  TableDescriptor *desc;
+  int idx, success;
+
+  if(!id || !u) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if(getSampleCount(u) > 128) {
+    fprintf(stderr, "WARNING! %s: too many cols (%d).\n", id, getSampleCount(u));
+  }
+
+  idx = sqlInsertVariable(u);
+  if(idx <= 0) return NULL;
+
+  desc = calloc(1, sizeof(*desc));
+  if(!desc) {
+    perror("ERROR! alloc of cached table descriptor");
+    exit(errno);
+  }
+
+  // Share the interned copy of the ID.
+  desc->id = (char *) internId(id)->name;
+  desc->index = idx;
+  desc->cols = getSampleCount(u);
+  desc->isLoaded = TRUE;
+
+  if(u->field.type == X_STRING) getStringType(getEnclosingStringLength(&u->field, u->sampling), desc->sqlType);
+  else if(printSQLType(u->field.type, desc->sqlType) < 0) {
+    fprintf(stderr, "WARNING! add variable: unsupported xchange type '%c'.\n", u->field.type);
+    goto add_table_cleanup; // @suppress("Goto statement used")
+  }
+
+  // Other writers may be looking up their own variables concurrently.
+  pthread_rwlock_wrlock(&lookupLock);
+  success = hashMapPut(lookup, desc->id, desc, NULL) >= 0;
+  if(success) setIndexedTableDescriptor(internId(id), desc);
+  pthread_rwlock_unlock(&lookupLock);
+
+  if(!success) {
+    fprintf(stderr, "WARNING! could not cache new variable.\n");
+    goto add_table_cleanup; // @suppress("Goto statement used")
+  }
+
+  return desc;
+
+  // ----------------------------------------------------------------
   add_table_cleanup:
 
-  if(desc->id) free(desc->id);
-  if(desc) free(desc);
+  if(desc) free(desc);
+
+  return NULL;
+}
+
+
+static int printColumnFormat(int ncols, char *fmt) {
+  int digits;
+
+  if(!fmt) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  if(ncols <= 1) ncols = 1;
+  else ncols--;
+
+  digits = 1 + (int) floor(log10(ncols));
+  return sprintf(fmt, COL_NAME_STEM "%%0%dd", digits);
+}
+
+
+static int sqlBegin() {
+  // Schema changes and other atomic blocks run in their own transaction, outside of batches.
+  if(batch.isOpen) sqlCommitBatch();
+
+  return sqlExecSimple("BEGIN");
+}
+
+
+static int sqlCommit() {
+  return sqlExecSimple("COMMIT;");
+}
+
+
+static int sqlRollback() {
+  return sqlExecSimple("ROLLBACK;");
+}
+
+
+/**
+ * Starts an atomic block for adding a single row (with its metadata). Inside a batch transaction it
+ * sets a savepoint, so that a failing row may be rolled back without affecting the rest of the batch.
+ * Otherwise it begins a new transaction.
+ *
+ * @return    TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlBeginRow() {
+  if(batch.isOpen) return sqlExecSimple("SAVEPOINT " ROW_SAVEPOINT ";");
+  return sqlBegin();
+}
+
+
+/**
+ * Completes the atomic block for adding a single row, by releasing the row savepoint inside a batch
+ * transaction, or else by committing the transaction.
+ *
+ * @return    TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlCommitRow() {
+  if(batch.isOpen) return sqlExecSimple("RELEASE SAVEPOINT " ROW_SAVEPOINT ";");
+  return sqlCommit();
+}
+
+
+/**
+ * Discards the atomic block for adding a single row, by rolling back to the row savepoint inside a
+ * batch transaction, or else by rolling back the transaction.
+ *
+ * @return    TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlRollbackRow() {
+  if(batch.isOpen) return sqlExecSimple("ROLLBACK TO SAVEPOINT " ROW_SAVEPOINT "; RELEASE SAVEPOINT " ROW_SAVEPOINT ";");
+  return sqlRollback();
+}
+
+
+/**
+ * Checks if rows should be committed in batches, i.e. if the configuration allows more than one row per
+ * transaction.
+ *
+ * @return    TRUE (1) if rows are to be committed in batches, or else FALSE (0).
+ */
+static boolean isBatching() {
+  return getBatchRows() > 1;
+}
+
+
+/**
+ * Sets a deadline some time from now.
+ *
+ * @param dt          (s) Time from now until the deadline.
+ * @param deadline    The absolute (CLOCK_REALTIME) time to set.
+ */
+static void setDeadline(double dt, struct timespec *deadline) {
+  clock_gettime(CLOCK_REALTIME, deadline);
+  deadline->tv_sec += (time_t) dt;
+  deadline->tv_nsec += (long) (1e9 * (dt - floor(dt)));
+  if(deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
+  }
+}
+
+
+/**
+ * Checks if rows should be sent in pipeline mode, i.e. without waiting for the result of each
+ * statement before sending the next one. Rows inserted via COPY are not pipelined.
+ *
+ * @return    TRUE (1) if rows are to be sent in pipeline mode, or else FALSE (0).
+ */
+static boolean isPipelining() {
+  return getPipelineDepth() > 0 && getInsertMethod() != INSERT_COPY;
+}
+
+
+/**
+ * Opens a new batch transaction, in which rows are inserted until the batch is committed via
+ * sqlCommitBatch().
+ *
+ * @param grabTime    (s) UNIX time of the grab cycle, to which the batch belongs.
+ * @return            TRUE (1) if successful, or else FALSE (0).
+ *
+ * @sa sqlCommitBatch()
+ */
+static int sqlBeginBatch(time_t grabTime) {
+  // In pipeline mode, the batch is a pipeline segment, which runs as a single transaction.
+  if(isPipelining()) {
+    if(!sqlEnterPipeline()) return FALSE;
+  }
+  else if(!sqlBegin()) return FALSE;
+
+  batch.isOpen = TRUE;
+  batch.grabTime = grabTime;
+  batch.rows = 0;
+  batch.bytes = 0;
+  batch.nMeta = 0;
+
+  setDeadline(getBatchTime(), &batch.deadline);
+
+  return TRUE;
+}
+
+
+/**
+ * Keeps track of a table whose metadata was updated inside the current batch, so its cached metadata
+ * state can be invalidated if the batch fails to commit.
+ *
+ * @param t   The table descriptor whose metadata was updated.
+ */
+static void addBatchMeta(TableDescriptor *t) {
+  // Failed pipeline segments are accounted for when their results are processed.
+  if(!batch.isOpen || pipeline.isActive) return;
+
+  if(batch.nMeta >= batch.metaCapacity) {
+    batch.metaCapacity = batch.metaCapacity ? (batch.metaCapacity << 1) : DEFAULT_STRING_LEN;
+    batch.metaTables = (TableDescriptor **) realloc(batch.metaTables, batch.metaCapacity * sizeof(TableDescriptor *));
+    x_check_alloc(batch.metaTables);
+  }
+
+  batch.metaTables[batch.nMeta++] = t;
+}
+
+
+/**
+ * Commits the currently open batch transaction, if any. If the commit fails, all tables whose metadata
+ * was updated in the batch are marked for a fresh metadata entry on their next insert.
+ *
+ * @return    TRUE (1) if successful or if there was no batch open, or else FALSE (0).
+ *
+ * @sa sqlBeginBatch()
+ */
+static int sqlCommitBatch() {
+  int success;
+
+  if(!batch.isOpen) return TRUE;
+
+  if(pipeline.isActive) {
+    // The rows sent since the start of the batch are committed together at the sync point.
+    batch.isOpen = FALSE;
+    dprintf("Sent batch of %d rows (%ld bytes).\n", batch.rows, batch.bytes);
+    return sqlPipelineSync(TRUE);
+  }
+
+  sqlFlushPending();
+
+  batch.isOpen = FALSE;
+
+  success = sqlCommit();
+  if(!success) {
+    int i;
+    fprintf(stderr, "WARNING! Batch of %d rows failed to commit.\n", batch.rows);
+    for(i = 0; i < batch.nMeta; i++) batch.metaTables[i]->hasMeta = FALSE;
+  }
+  else dprintf("Committed batch of %d rows (%ld bytes).\n", batch.rows, batch.bytes);
+
+  batch.nMeta = 0;
+
+  return success;
+}
+
+
+/**
+ * Checks if the currently open batch has reached any of the configured limits for the number of rows,
+ * the SQL command volume, or the time it may stay open.
+ *
+ * @return    TRUE (1) if the current batch should be committed, or else FALSE (0).
+ */
+static boolean isBatchComplete() {
+  struct timespec now;
+
+  if(batch.rows >= getBatchRows()) return TRUE;
+  if(batch.bytes >= getBatchBytes()) return TRUE;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  if(now.tv_sec != batch.deadline.tv_sec) return now.tv_sec > batch.deadline.tv_sec;
+  return now.tv_nsec >= batch.deadline.tv_nsec;
+}
+
+
+static int sqlBootstrap(const char *owner, const char *passwd) {
+  ensureCommandCapacity(200 + 2 * sizeof(MASTER_TABLE) + sizeof(VARNAME_ID) + sizeof(SQL_VARNAME) + sizeof(SQL_SERIAL));
+
+  if(owner) {
+    if(sqlConnect(owner, passwd, NULL) != SUCCESS_RETURN) return ERROR_RETURN;
+
+    // Create the database and assign the database to the user
+    sprintf(cmd, "CREATE DATABASE %s OWNER %s;", getSQLDatabaseName(), getSQLUserName());
+    sqlExecSimple(cmd);
+    sqlDisconnect();
+  }
+
+  // Now login to the database with our designated logger account...
+  // Create the 'titles' table
+  if(sqlConnect(getSQLUserName(), getSQLAuth(), getSQLDatabaseName()) != SUCCESS_RETURN) return ERROR_RETURN;
+
+  // Enable the TimescaleDB extension (if configured)
+  if(isUseHyperTables()) sqlExecSimple("CREATE EXTENSION IF NOT EXISTS timescaledb;");
+
+  sprintf(cmd, "CREATE TABLE " MASTER_TABLE " (" VARNAME_ID " " SQL_VARNAME " PRIMARY KEY, tid " SQL_SERIAL " UNIQUE);");
+  sqlExecSimple(cmd);
+
+  // Add indexing to the 'titles' table for faster access.
+  sprintf(cmd, "CREATE UNIQUE INDEX " MASTER_TABLE "_index_" VARNAME_ID " ON " MASTER_TABLE " (" VARNAME_ID ");");
+  sqlExecSimple(cmd);
+
+  sqlDisconnect();
+
+  return SUCCESS_RETURN;
+}
+
+
+/**
+ * Sets up (bootstraps) a clean new database
+ *
+ * @param owner   User that will own the database (it must have privileges for creating the database)
+ * @param passwd  Password for oqner
+ * @return  SUUCCESS_RETURN if successful, or else ERROR_RETURN.
+ */
+int setupDB(const char *owner, const char *passwd) {
+  int status;
+
+# if USE_SYSTEMD
+  setSDState("BOOTSTRAP");
+# endif
+
+  status = sqlBootstrap(owner, passwd);
+
+# if USE_SYSTEMD
+  setSDState(IDLE_STATE);
+# endif
+
+  return status;
+}
+
+
+/**
+ * Prints the SQL command, into the the static <code>cmd</code> string buffer, to create
+ * a new table for the given variable in the database.
+ *
+ * \param u     Pointer to the new variable to insert in the database.
+ * \param id    The table id to use.
+ *
+ * \return      SUCCESS_RETURN (0) if the variable has been successfully added to
+ *              the database or else ERROR_RETURN (-1).
+ *
+ */
+static int sqlCreateTable(const Variable *u, int id) {
+  const XField *f = &u->field;
+  XType type;
+  char fmt[SQL_COL_NAME_LEN];
+  char sqlType[SQL_TYPE_LEN];
+  char colName[SQL_COL_NAME_LEN];
+  char *next;
+  int i, n;
+
+  if(!u || id < 0) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  n = getSampleCount(u);
+  if(n < 1) return SUCCESS_RETURN;
+
+  type = f->type;
+  if(type == X_STRING) type = X_CHARS(getEnclosingStringLength(f, u->sampling));
+
+  if(printSQLType(type, sqlType) < 0) {
+    fprintf(stderr, "WARNING! create table: unsupported xchange type '%c'.\n", f->type);
+    return ERROR_RETURN;
+  }
+
+  // Figure out the length of the last (possibly longest) column's name, incl. separator
+  printColumnFormat(n, fmt);
+  sprintf(colName, fmt, (n - 1));
+
+  // The max. bytes per column definition in the SQL command...
+  i = sizeof(SQL_SEP) + strlen(colName) + strlen(sqlType) + 1;
+
+  // Make sure the command buffer is large enough...
+  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + sizeof(SQL_DATE) + sizeof(SQL_INT32) + (n * i));
+
+  next = cmd;
+  next += sprintf(next, "CREATE TABLE " TABLE_NAME_PATTERN " (time " SQL_DATE " PRIMARY KEY, age " SQL_INT32, id);
+
+  for(i = 0; i < n; i++) {
+    sprintf(colName, fmt, i);
+    next += sprintf(next, SQL_SEP "%s %s", colName, sqlType);
+  }
+
+  sprintf(next, ");");
+
+  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
+
+  return SUCCESS_RETURN;
+}
+
+
+static int sqlConvertToHyperTable(int id) {
+  if(id < 0) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + sizeof(TIMESCALE));
+
+# if TIMESCALEDB_OLD
+  // Old syntax
+  sprintf(cmd, "SELECT create_hypertable('" TABLE_NAME_PATTERN "', 'time', chunk_time_interval => INTERVAL '" TIMESCALE "');", id);
+# else
+  // New syntax
+  sprintf(cmd, "SELECT create_hypertable('" TABLE_NAME_PATTERN "', by_range('time', INTERVAL '" TIMESCALE "'));", id);
+#endif
+
+  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
+
+  return SUCCESS_RETURN;
+}
+
+
+static int sqlCreateMetaTable(int id) {
+  char samplingType[SQL_TYPE_LEN];
+  char dimType[SQL_TYPE_LEN];
+  char shapeType[SQL_TYPE_LEN];
+  char unitType[SQL_TYPE_LEN];
+
+  if(id < 0) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  printSQLType(X_INT, samplingType);
+  printSQLType(X_BYTE, dimType);
+  printSQLType(X_CHARS(META_SHAPE_LEN - 1), shapeType);
+  printSQLType(X_CHARS(META_UNIT_LEN - 1), unitType);
+
+  // Make sure the command buffer is large enough...
+  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + sizeof(META_SERIAL_ID) + sizeof(SQL_SERIAL) + sizeof(SQL_DATE));
+
+  // Create metadata table
+  sprintf(cmd, "CREATE TABLE " META_NAME_PATTERN " (" META_SERIAL_ID " " SQL_SERIAL " PRIMARY KEY, time " SQL_DATE " NOT NULL, "
+          "sampling %s DEFAULT 1, ndim %s DEFAULT 0, shape %s, unit %s);", id, samplingType, dimType, shapeType, unitType);
+
+  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
+
+  return SUCCESS_RETURN;
+}
+
+
+static int sqlAddMeta(const Variable *u, TableDescriptor *t) {
+  const XField *f = &u->field;
+  int step, ndim;
+
+  if(!u || !t) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  step = t->sampling;
+  if(step < 1) step = 1;
+
+  sqlNoteSchemaChange();
+
+  // Treat all singilar values as scalars.
+  ndim = f->ndim;
+  if(ndim < 1) ndim = 0;
+  else if(ndim == 1 && t->sizes[0] <= 1) ndim = 0;
+
+  if(getInsertMethod() != INSERT_SQL) {
+    if(sqlAddMetaParams(u, t, step, ndim) != SUCCESS_RETURN) return ERROR_RETURN;
+  }
+  else {
+    char *next;
+
+    ensureCommandCapacity(200 + META_SHAPE_LEN + META_UNIT_LEN);
+    next = cmd;
+    next += sprintf(next, "INSERT INTO " META_NAME_PATTERN " VALUES(DEFAULT" SQL_SEP, t->index);
+
+    next += strftime(next, 100, SQL_DATE_FORMAT, gmtime(&u->updateTime));
+
+    next += sprintf(next, SQL_SEP "%d", step);
+    next += sprintf(next, SQL_SEP "%d", ndim);
+
+    if(ndim > 0) {
+      next += sprintf(next, SQL_SEP "'");
+      next += xPrintDims(next, ndim, f->sizes);
+      next += sprintf(next, "'");
+    }
+    else next += sprintf(next, SQL_SEP "NULL");
+
+    if(*t->unit) next += sprintf(next, SQL_SEP "'%s'", t->unit);
+    else next += sprintf(next, SQL_SEP "NULL");
+
+    sprintf(next, ");");
+
+    if(!sqlExecStatement(cmd)) return ERROR_RETURN;
+  }
+
+  // Keep track of the the current associated metadata
+  t->sampling = u->sampling;
+
+  t->ndim = ndim;
+  memcpy(t->sizes, f->sizes, sizeof(t->sizes));
+
+  if(u->unit) strncpy(t->unit, u->unit, META_UNIT_LEN - 1);
+  else t->unit[0] = '\0';
+
+  t->hasMeta = TRUE;
+  t->metaVersion++;
+
+  addBatchMeta(t);
+
+  return SUCCESS_RETURN;
+}
+
+
+static int compareTableIndex(const void *a, const void *b) {
+  const TableDescriptor *A = *(const TableDescriptor **) a;
+  const TableDescriptor *B = *(const TableDescriptor **) b;
+  return A->index < B->index ? -1 : (A->index > B->index ? 1 : 0);
+}
+
+
+/**
+ * Sets the cached metadata of a table from a row of metadata in a query result.
+ *
+ * @param res     The query result
+ * @param row     The row index in the result
+ * @param col     The column index of the metadata serial number, followed by the other columns of the metadata table.
+ * @param t       The table descriptor to update.
+ */
+static void parseMeta(PGresult *res, int row, int col, TableDescriptor *t) {
+  const char *val = PQgetvalue(res, row, col);
+  if(val) sscanf(val, "%d", &t->metaVersion);
+
+  t->sampling = 1;
+  val = PQgetvalue(res, row, col + 2);
+  if(val) sscanf(val, "%d", &t->sampling);
+
+  t->ndim = 0;
+  memset(t->sizes, 0, sizeof(t->sizes));
+
+  val = PQgetvalue(res, row, col + 3);
+  if(val) if(sscanf(val, "%d", &t->ndim) == 1) if(t->ndim > 0) {
+    val = PQgetvalue(res, row, col + 4);
+    if(val) xParseDims(val, t->sizes);
+  }
+
+  val = PQgetvalue(res, row, col + 5);
+  if(val) if(*val) strncpy(t->unit, val, sizeof(t->unit) - 1);
+
+  t->hasMeta = TRUE;
+}
+
+
+/**
+ * Loads the last metadata for a set of tables in a single query. On entry, hasMeta should be set for the
+ * tables that have a metadata table. On return, it is set for the tables whose last metadata was loaded.
+ *
+ * @param tables    The table descriptors, sorted by increasing table index.
+ * @param n         The number of table descriptors.
+ * @return          TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlGetLastMeta(TableDescriptor **tables, int n) {
+  PGresult *res;
+  char *next;
+  int i, k = 0;
+
+  if(!tables || n < 0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  ensureCommandCapacity(100 + n * (100 + 2 * SQL_TABLE_NAME_LEN + sizeof(SQL_LAST(META_SERIAL_ID))));
+
+  next = cmd;
+  for(i = 0; i < n; i++) if(tables[i]->hasMeta) {
+    tables[i]->hasMeta = FALSE;
+    if(k++) next += sprintf(next, " UNION ALL ");
+    next += sprintf(next, "(SELECT %d, * FROM " META_NAME_PATTERN " " SQL_LAST(META_SERIAL_ID) ")", tables[i]->index, tables[i]->index);
+  }
+
+  if(!k) return TRUE;
+
+  sprintf(next, ";");
+  if(!sqlExec(cmd, &res)) return FALSE;
+
+  for(i = PQntuples(res); --i >= 0; ) {
+    TableDescriptor key, *pkey = &key, **t;
+
+    if(1 != sscanf(PQgetvalue(res, i, 0), "%d", &key.index)) continue;
+
+    t = (TableDescriptor **) bsearch(&pkey, tables, n, sizeof(*tables), compareTableIndex);
+    if(t) parseMeta(res, i, 1, *t);
+  }
+
+  PQclear(res);
+
+  return TRUE;
+}
+
+
+static boolean isMetaUpdate(const Variable *u, const TableDescriptor *t) {
+  const XField *f = &u->field;
+  int i;
+  int ndim = f->ndim;
+
+  if(!u || !t) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  // If the table does not have associated metadata already, then let's add one.
+  if(!t->hasMeta) {
+    dprintf("! Initial metadata %s\n", u->id);
+    return TRUE;
+  }
+
+  if(t->sampling != u->sampling) {
+    dprintf("! Found new sampling for %s\n", u->id);
+    return TRUE;
+  }
+
+  // Treat all singular values as scalar
+  if(ndim < 1) ndim = 0;
+  else if(ndim == 1 && f->sizes[0] <= 1) ndim = 0;
+
+  if(ndim != u->field.ndim) {
+    dprintf("! Found new dimensionality for %s\n", u->id);
+    return TRUE;
+  }
+
+  for(i = 0; i < t->ndim; i++) if(t->sizes[i] != u->field.sizes[i]) {
+    dprintf("! Found new shape for %s\n", u->id);
+    return TRUE;
+  }
+
+  if(u->unit) {
+    size_t n = strlen(u->unit);
+    if(n >= sizeof(t->unit)) n = sizeof(t->unit) - 1;
+    if(strncmp(u->unit, t->unit, n) != 0) {
+      dprintf("! Found new physical unit for %s\n", u->id);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+
+/**
+ *  Execute an SQL command.
+ *
+ *  \param sql      Pointer to the command string
+ *  \param resp     Reference to the object pointer containing the response.
+ *
+ *  \return         TRUE (non-zero) on success, or FALSE (0) on error.
+ */
+static int sqlExec(const char *sql, PGresult **resp) {
+  if(!sql || !resp) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  if(!cmd[0]) {
+    errno = EAGAIN;
+    return FALSE;
+  }
+
+  // Synchronous statements are not allowed in pipeline mode.
+  sqlExitPipeline();
+
+  *resp = PQexec(sql_db, sql);
+  dprintf("SQL: %s\n", sql);
+  if(PQresultStatus(*resp) != PGRES_COMMAND_OK && PQresultStatus(*resp) != PGRES_TUPLES_OK) {
+    fprintf(stderr, "WARNING! %s SQL error: %s", sql,  PQerrorMessage(sql_db));
+    errno = EBADE;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/**
+ *  Executes an SQL command, ignoring the response received from the server.
+ *
+ *  \param sql      Pointer to the command string
+ *
+ *  \return         TRUE (non-zero) on success, or FALSE (0) on error.
+ */
+static int sqlExecSimple(const char *sql) {
+  PGresult *reply = NULL;
+  int success;
+
+  if(!sql) {
+    errno = EINVAL;
+    return FALSE;
+  }
+
+  success = sqlExec(sql, &reply);
+  if(success) PQclear(reply);
+  return success;
+}
+
+
+/**
+ * Executes a statement with the current parameters, or else a prepared statement with the current
+ * parameters. In pipeline mode, the statement is only sent, and its result is processed later.
+ *
+ * \param sql      The SQL statement to execute, or NULL to execute a prepared statement
+ * \param name     The name of the prepared statement to execute, if sql is NULL
+ * \return         TRUE (non-zero) on success, or FALSE (0) on error.
+ *
+ * \sa sqlDrainPipeline()
+ */
+static int sqlExecParams(const char *sql, const char *name) {
+  PGresult *res;
+  int success;
+
+  if(pipeline.isActive) {
+    if(sql) success = PQsendQueryParams(sql_db, sql, params.n, params.types, params.values, params.lengths, params.formats, 0);
+    else success = PQsendQueryPrepared(sql_db, name, params.n, params.values, params.lengths, params.formats, 0);
+    dprintf("SQL: [pipeline] %s\n", sql ? sql : name);
+
+    if(!success) {
+      fprintf(stderr, "WARNING! %s send error: %s", sql ? sql : name, PQerrorMessage(sql_db));
+      return FALSE;
+    }
+
+    addPipelineStatement(NULL);
+    return TRUE;
+  }
+
+  if(sql) res = PQexecParams(sql_db, sql, params.n, params.types, params.values, params.lengths, params.formats, 0);
+  else res = PQexecPrepared(sql_db, name, params.n, params.values, params.lengths, params.formats, 0);
+  dprintf("SQL: %s\n", sql ? sql : name);
+
+  success = (PQresultStatus(res) == PGRES_COMMAND_OK);
+  PQclear(res);
+
+  if(!success) fprintf(stderr, "WARNING! %s SQL error: %s", sql ? sql : name, PQerrorMessage(sql_db));
+
+  return success;
+}
+
+
+/**
+ * Executes an SQL statement without parameters, ignoring the response. In pipeline mode, the statement
+ * is only sent, and its result is processed later.
+ *
+ * \param sql      Pointer to the command string
+ * \return         TRUE (non-zero) on success, or FALSE (0) on error.
+ */
+static int sqlExecStatement(const char *sql) {
+  if(!pipeline.isActive) return sqlExecSimple(sql);
+
+  params.n = 0;
+  return sqlExecParams(sql, NULL);
+}
+
+
+/**
+ * Closes the database connection of the calling thread, if it has one.
+ *
+ */
+static void sqlDisconnect() {
+  dprintf("Disconnecting.\n");
+
+  if(sql_db) {
+    PQfinish(sql_db);
+    sql_db = NULL;
+  }
+}
+
+
+/**
+ * Commits the open batch of the calling writer, drains its pipeline, and closes its database
+ * connection. Data still waiting in the writer's queue is not inserted.
+ *
+ */
+static void closeWriter() {
+  if(sql_db) {
+    sqlCommitBatch();
+    sqlExitPipeline();
+  }
+
+  sqlDisconnect();
+
+  atomic_store(&writer->isRunning, FALSE);
+  sem_post(&writer->stopped);
+}
+
+
+/**
+ * Exit handler, which has each running writer commit its open batch, drain its pipeline, and close its
+ * own database connection (the connections are thread-local, so only their writers can close them). It
+ * waits up to SHUTDOWN_TIMEOUT seconds for the other writers, and closes the connection of the calling
+ * thread last.
+ *
+ */
+static void sqlShutdown() {
+  struct timespec deadline;
+  int i;
+
+  dprintf("Shutting down SQL writers.\n");
+
+  atomic_store(&isShuttingDown, TRUE);
+
+  // Wake up the writers that are waiting for data.
+  for(i = 0; i < nWriters; i++) if(&writers[i] != writer) wakeWriterQueue(&writers[i].queue);
+
+  setDeadline(SHUTDOWN_TIMEOUT, &deadline);
+
+  for(i = 0; i < nWriters; i++) {
+    Writer *w = &writers[i];
+
+    if(w == writer || !atomic_load(&w->isRunning)) continue;
+
+    while(sem_timedwait(&w->stopped, &deadline) != 0) if(errno != EINTR) {
+      fprintf(stderr, "WARNING! SQL writer %d did not close its connection in time.\n", w->index);
+      break;
+    }
+  }
+
+  if(writer) closeWriter();
+  else sqlDisconnect();
+}
+
+
+/**
+ * Registers sqlShutdown() to be called when the program exits.
+ *
+ */
+static void registerShutdown() {
+  atexit(sqlShutdown);
+}
+
+
+/**
+ * Connects to the SQL server.
+ *
+ * \param userName  Database user name (cannot be NULL)
+ * \param dbName    Database name or NULL
+ * \return      SUCCESS_RETURN (0) if the connected, or else ERROR_RETURN (-1).
+ */
+static int sqlConnect(const char *userName, const char *auth, const char *dbName) {
+  int pos;
+
+  if(!userName) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  ensureCommandCapacity(200);
+
+  pos = sprintf(cmd, "host=%s user=%s", getSQLServerAddress(), userName);
+
+  if(dbName) pos += sprintf(&cmd[pos], " dbname=%s", dbName);
+
+  // Add password if needed
+  if(auth) sprintf(&cmd[pos], " password=%s", auth);
+
+  dprintf("connect %s\n", cmd);
+  sql_db = PQconnectdb(cmd);
+
+  // Check to see that the backend connection was successfully made
+  if (PQstatus(sql_db) != CONNECTION_OK) {
+    fprintf(stderr, "WARNING! connect to '%s' failed: %s\n", cmd, PQerrorMessage(sql_db));
+    PQfinish(sql_db);
+    return ERROR_RETURN;
+  }
+  printf("Connected to SQL server\n");
+
+  pthread_once(&shutdownOnce, registerShutdown);
+
+  return SUCCESS_RETURN;
+}
+
+
+/**
+ * Connects to the SQL server. If not successful, it will keep trying to connect the specified
+ * number of times, at intervals defined by CONNECT_RETRY_SECONDS.
+ *
+ * \param       Number of retry attempts.
+ *
+ * \return      SUCCESS_RETURN (0) if the connection has been established, or ERROR_RETURN (-1)
+ *              if could not connect even after the requested number of retries.
+ *
+ */
+static int sqlConnectRetry(int attempts) {
+  int i;
+  // Connect to the database (and keep retrying...)
+  for(i = 1; i < attempts; i++) {
+    if(sqlConnect(getSQLUserName(), getSQLAuth(), getSQLDatabaseName()) == SUCCESS_RETURN) return SUCCESS_RETURN;
+    fprintf(stderr, "Will retry connecting to SQL server in %d seconds (%d of %d)...\n", CONNECT_RETRY_SECONDS, i, attempts);
+    sleep(CONNECT_RETRY_SECONDS);
+  }
+
+  fprintf(stderr, "ERROR! SQL connection failed after %d attemps. Exiting.\n", i);
+  errno = ENOTCONN;
+  return ERROR_RETURN;
+}
+
+
+/**
+ *  Create a new variable in the database.  Returns new table id on
+ *  success, zero on error.  is_dsm should be true if the variable is
+ *  from DSM (will cause a unix timestamp column to be added)
+ *
+ *  \param      Pointer to the variable for which to create a new entity in the database.
+ *
+ *  \return     SUCCESS_RETURN (0) if the variable was successfully added in the databsase
+ *              or ERROR_RETURN (-1) otherwise.
+ */
+static int sqlInsertVariable(const Variable *u) {
+  PGresult *reply;
+  int tid;
+
+  if(!u) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  // do it atomically
+  if(!sqlBegin()) return ERROR_RETURN;
+
+  fprintf(stderr, "!ADD! %s\n", u->id);
+
+  ensureCommandCapacity(100 + strlen(u->id));
+
+  // Create a new title in the DB for the variable-name, assigning it a tid
+  sprintf(cmd, "INSERT INTO titles VALUES('%s', DEFAULT) RETURNING tid;", u->id);
+  if(!sqlExec(cmd, &reply)) goto cleanup; // @suppress("Goto statement used")
+
+  if(1 != sscanf(PQgetvalue(reply, 0, 0), "%d", &tid)) goto cleanup; // @suppress("Goto statement used")
+
+  PQclear(reply);
+
+  // Create a table containing columns for each variable entry
+  if(sqlCreateTable(u, tid) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
+
+  if(isUseHyperTables()) if(sqlConvertToHyperTable(tid) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
+
+  // Create an index for the table for faster data access
+  ensureCommandCapacity(100 + 2 * SQL_TABLE_NAME_LEN);
+  sprintf(cmd, "CREATE UNIQUE INDEX " TABLE_NAME_PATTERN "_index_time ON " TABLE_NAME_PATTERN " (time);", tid, tid);
+
+  if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+
+  if(sqlCreateMetaTable(tid) != SUCCESS_RETURN)  goto cleanup; // @suppress("Goto statement used")
+
+  // Finish the atomic block
+  if(!sqlCommit()) tid = ERROR_RETURN;
+
+  return tid;
+
+  // -------------------------------------------------------------------------------
+  cleanup:
+
+  sqlRollback();
+
+  return ERROR_RETURN;
+}
+
+
+static int sqlAddColumns(TableDescriptor *t, const Variable *u) {
+  char tabName[SQL_TABLE_NAME_LEN];
+  char colName[SQL_COL_NAME_LEN];
+  char oldFmt[SQL_COL_NAME_LEN], newFmt[SQL_COL_NAME_LEN];
+
+  if(!t || !u) {
+    errno = EINVAL;
+    return ERROR_RETURN;
+  }
+
+  int i, nCols = getSampleCount(u);
+
+  if(nCols <= t->cols) return SUCCESS_RETURN;
+
+  fprintf(stderr, "!CHANGE! Add %d columns to %s\n", nCols - t->cols, t->id);
+
+  sqlNoteSchemaChange();
+
+  sprintf(tabName, TABLE_NAME_PATTERN, t->index);
+
+  ensureCommandCapacity(200 + sizeof(tabName) + 2 * sizeof(colName));
+
+  // do it atomically
+  if(!sqlBegin()) return ERROR_RETURN;
+
+  // The table gets new columns, so the prepared INSERT must be recreated.
+  sqlDeallocateInsert(t);
+
+  // Check if column names need extra digits compared to what we had before
+  if(printColumnFormat(t->cols, oldFmt) < printColumnFormat(nCols, newFmt)) for(i = 0; i < t->cols; i++) {
+    char oldName[SQL_COL_NAME_LEN];
+
+    sprintf(oldName, oldFmt, i);  // existing column name
+    sprintf(colName, newFmt, i);  // new column name with extra digit
+
+    // Change the old column name to add the extra digit
+    sprintf(cmd, "ALTER TABLE %s RENAME COLUMN %s TO %s;", tabName, oldName, colName);
+    if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+  }
+
+  while(t->cols < nCols) {
+    sprintf(colName, newFmt, t->cols);  // added column name
+
+    // Add a column to the table
+    sprintf(cmd, "ALTER TABLE %s ADD COLUMN %s %s;", tabName, colName, t->sqlType);
+    if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+
+    t->cols++;
+  }
+
+  // Finish atomic block
+  if(!sqlCommit()) return ERROR_RETURN;
+
+  return SUCCESS_RETURN;
+
+  // -------------------------------------------------------------------------------
+  cleanup:
+
+  sqlRollback();
+
+  return ERROR_RETURN;
+}
+
+
+static int sqlChangeType(TableDescriptor *t, const char *newType) {
+  char tabName[SQL_TABLE_NAME_LEN];
+  char colName[SQL_COL_NAME_LEN];
+  char fmt[SQL_COL_NAME_LEN];
+
+  int i;
+
+  fprintf(stderr, "!CHANGE! %s type to %s\n", t->id, newType);
+
+  sqlNoteSchemaChange();
+
+  sprintf(tabName, TABLE_NAME_PATTERN, t->index);
+
+  printColumnFormat(t->cols, fmt);
+
+  ensureCommandCapacity(100 + sizeof(tabName) + 2 * sizeof(colName));
+
+  // do it atomically
+  if(!sqlBegin()) return ERROR_RETURN;
+
+  for(i = 0; i < t->cols; i++) {
+    sprintf(colName, fmt, i);
+
+    // Change the column type -- the syntax is SQL flavor dependent
+    sprintf(cmd, "ALTER TABLE %s ALTER COLUMN %s TYPE %s;", tabName, colName, newType);
+    if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+  }
+
+  // Finish the atomic block
+  if(!sqlCommit()) return ERROR_RETURN;
+
+  strncpy(t->sqlType, newType, sizeof(t->sqlType) - 1);
+
+  // The parameter types have changed, so the prepared INSERT must be recreated.
+  sqlDeallocateInsert(t);
+
+  return SUCCESS_RETURN;
+
+  // -------------------------------------------------------------------------------
+  cleanup:
 
-  return NULL;
+  sqlRollback();
+
+  return ERROR_RETURN;
 }
 
 
-static int printColumnFormat(int ncols, char *fmt) {
-  int digits;
+/**
+ * Makes sure the database has a table for the variable, which can accommodate its data, creating a new
+ * table, widening its column type, or adding more columns as necessary.
+ *
+ * \param u     Pointer to the variable
+ * \return      The table descriptor for the variable, or else NULL if there was an error.
+ */
+static TableDescriptor *sqlPrepareTable(const Variable *u) {
+  const XField *f = &u->field;
+  TableDescriptor *t;
+  char sqlType[SQL_TYPE_LEN];
 
-  if(!fmt) {
+  if(!u) {
     errno = EINVAL;
-    return ERROR_RETURN;
+    return NULL;
   }
 
-  if(ncols <= 1) ncols = 1;
-  else ncols--;
+  t = getTableDescriptor(u);
+  if(!t) {
+    fprintf(stderr, "ERROR! No SQL table -- this is just great.\n");
+    errno = EAGAIN;
+    return NULL;
+  }
 
-  digits = 1 + (int) floor(log10(ncols));
-  return sprintf(fmt, COL_NAME_STEM "%%0%dd", digits);
-}
+  dprintf("Found cached translation entry, TID = %d\n", t->index);
 
+  if(f->type == X_STRING) {
+    if(strcmp(t->sqlType, SQL_TEXT) != 0) {
+      int len = getEnclosingStringLength(&u->field, u->sampling);
+      int got = 0;
+      sscanf(t->sqlType, "VARCHAR(%d)", &got);
 
-static int sqlBegin() {
-  pthread_mutex_lock(&mutex);
-  if(!sqlExecSimple("BEGIN")) {
-    pthread_mutex_unlock(&mutex);
-    return FALSE;
+      if(len <= got) {
+        getStringType(len, sqlType);
+        if(sqlChangeType(t, sqlType) < 0) return NULL;
+      }
+    }
   }
-  return TRUE;
-}
+  else if(printSQLType(f->type, sqlType) < 0) {
+    fprintf(stderr, "WARNING! add values: unsupported xchange type '%c' - skipping\n", f->type);
+    return NULL;
+  }
+  else if(cmpSQLType(sqlType, t->sqlType) > 0) if(sqlChangeType(t, sqlType) < 0) return NULL;
 
+  if(getSampleCount(u) > t->cols) if(sqlAddColumns(t, u) < 0) return NULL;
 
-static int sqlCommit() {
-  int retval = sqlExecSimple("COMMIT;");
-  pthread_mutex_unlock(&mutex);
-  return retval;
+  return t;
 }
 
 
-static int sqlRollback() {
-  int retval = sqlExecSimple("ROLLBACK;");
-  pthread_mutex_unlock(&mutex);
-  return retval;
-}
+/**
+ * Inserts the data from a variable into its (existing) table, via a parametrized statement with binary
+ * parameters if the insert method and the column type allow it, or else via an INSERT statement with
+ * the values in text format.
+ *
+ * \param u     Pointer to the variable
+ * \param t     The table descriptor for the variable
+ * \return      SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ */
+static int sqlInsertData(const Variable *u, TableDescriptor *t) {
+  const XField *f = &u->field;
+  int len;
+  char *next;
 
+  if(getInsertMethod() != INSERT_SQL) {
+    XType colType = getBinaryColumnType(t->sqlType);
+    if(isBinaryCompatible(f->type, colType)) return sqlInsertParams(u, t, colType);
+  }
 
-static int sqlBootstrap(const char *owner, const char *passwd) {
-  ensureCommandCapacity(200 + 2 * sizeof(MASTER_TABLE) + sizeof(VARNAME_ID) + sizeof(SQL_VARNAME) + sizeof(SQL_SERIAL));
+  if(f->type == X_STRING) len = getEnclosingStringLength(&u->field, u->sampling) + 2; // + quotes around string values....
+  else {
+    len = getStringSize(f->type); // maximum size for each entry
+    if(len < 0) {
+      fprintf(stderr, "WARNING! Unknown string size of data type '%c' - skipping\n", f->type);
+      return ERROR_RETURN;
+    }
+  }
 
-  if(owner) {
-    if(sqlConnect(owner, passwd, NULL) != SUCCESS_RETURN) return ERROR_RETURN;
+  len += sizeof(SQL_SEP); // + separator
 
-    // Create the database and assign the database to the user
-    sprintf(cmd, "CREATE DATABASE %s OWNER %s;", getSQLDatabaseName(), getSQLUserName());
-    sqlExecSimple(cmd);
-    sqlDisconnect();
+  // Serialized values are copied as is, or replaced by values not longer than the binary representation.
+  if(f->isSerialized) ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + getSampleCount(u) * len + strlen((char *) f->value));
+  else ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + getSampleCount(u) * len);
+
+  /* Now insert the data */
+  next = cmd;
+  next += sprintf(next, "INSERT INTO " TABLE_NAME_PATTERN " VALUES(", t->index);
+  next += strftime(next, 100, SQL_DATE_FORMAT, gmtime(&u->grabTime));
+  next += sprintf(next, SQL_SEP "'%d'", (int) (u->grabTime - u->updateTime));
+  next = appendValues(u, next);
+  next += sprintf(next, ");");
+
+  if(!sqlExecStatement(cmd)) return ERROR_RETURN;
+
+  if(batch.isOpen) {
+    batch.rows++;
+    batch.bytes += next - cmd;
   }
 
-  // Now login to the database with our designated logger account...
-  // Create the 'titles' table
-  if(sqlConnect(getSQLUserName(), getSQLAuth(), getSQLDatabaseName()) != SUCCESS_RETURN) return ERROR_RETURN;
+  return SUCCESS_RETURN;
+}
 
-  // Enable the TimescaleDB extension (if configured)
-  if(isUseHyperTables()) sqlExecSimple("CREATE EXTENSION IF NOT EXISTS timescaledb;");
 
-  sprintf(cmd, "CREATE TABLE " MASTER_TABLE " (" VARNAME_ID " " SQL_VARNAME " PRIMARY KEY, tid " SQL_SERIAL " UNIQUE);");
-  sqlExecSimple(cmd);
+/**
+ * Inserts a row of data from a variable into its (existing) table, along with new metadata if the
+ * variable's metadata has changed.
+ *
+ * \param u     Pointer to the variable
+ * \param t     The table descriptor for the variable
+ * \return      SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ */
+static int sqlInsertRow(const Variable *u, TableDescriptor *t) {
+  // Add values in an atomic block...
+  if(!sqlBeginRow()) return ERROR_RETURN;
 
-  // Add indexing to the 'titles' table for faster access.
-  sprintf(cmd, "CREATE UNIQUE INDEX " MASTER_TABLE "_index_" VARNAME_ID " ON " MASTER_TABLE " (" VARNAME_ID ");");
-  sqlExecSimple(cmd);
+  if(sqlInsertData(u, t) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
 
-  sqlDisconnect();
+  if(isMetaUpdate(u, t)) if(sqlAddMeta(u, t) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
+
+  if(!sqlCommitRow()) return ERROR_RETURN;
 
   return SUCCESS_RETURN;
+
+  // -------------------------------------------------------------------------------
+  cleanup:
+
+  sqlRollbackRow();
+
+  return ERROR_RETURN;
 }
 
 
 /**
- * Sets up (bootstraps) a clean new database
+ * Pushes the data from a variable into the database, creating a new table if necessary for new
+ * variables.
  *
- * @param owner   User that will own the database (it must have privileges for creating the database)
- * @param passwd  Password for oqner
- * @return  SUUCCESS_RETURN if successful, or else ERROR_RETURN.
+ * \param u     Pointer to the variable
+ * \return      SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
  */
-int setupDB(const char *owner, const char *passwd) {
-  int status;
+static int sqlAddValues(const Variable *u) {
+  TableDescriptor *t = sqlPrepareTable(u);
+  if(!t) return ERROR_RETURN;
+  return sqlInsertRow(u, t);
+}
 
-# if USE_SYSTEMD
-  setSDState("BOOTSTRAP");
-# endif
 
-  status = sqlBootstrap(owner, passwd);
+/**
+ * Returns the element type in which values are to be sent to a table column of a given SQL type in
+ * PostgreSQL's binary format.
+ *
+ * \param sqlType   The SQL type of the column, e.g. "DOUBLE PRECISION".
+ * \return          The matching element type, or X_UNKNOWN if the column type is not supported for
+ *                  binary transfers.
+ */
+static XType getBinaryColumnType(const char *sqlType) {
+  if(strcmp(sqlType, SQL_BOOLEAN) == 0) return X_BOOLEAN;
+  if(strcmp(sqlType, SQL_INT16) == 0) return X_SHORT;
+  if(strcmp(sqlType, SQL_INT32) == 0) return X_INT;
+  if(strcmp(sqlType, SQL_INT64) == 0) return X_LONG;
+  if(strcmp(sqlType, SQL_FLOAT) == 0) return X_FLOAT;
+  if(strcmp(sqlType, SQL_DOUBLE) == 0) return X_DOUBLE;
+  if(strcmp(sqlType, SQL_TEXT) == 0) return X_STRING;
+  if(strncmp(sqlType, "VARCHAR", 7) == 0) return X_STRING;
+  if(strncmp(sqlType, "CHARACTER VARYING", 17) == 0) return X_STRING;
+  return X_UNKNOWN;
+}
 
-# if USE_SYSTEMD
-  setSDState(IDLE_STATE);
-# endif
 
-  return status;
+/**
+ * Appends a 16-bit integer in network byte order.
+ *
+ * \param value   The value to append
+ * \param dst     Buffer location at which to append the value
+ * \return        The buffer location after the appended value.
+ */
+static char *putInt16(int16_t value, char *dst) {
+  uint16_t v = htobe16((uint16_t) value);
+  memcpy(dst, &v, sizeof(v));
+  return dst + sizeof(v);
 }
 
 
 /**
- * Prints the SQL command, into the the static <code>cmd</code> string buffer, to create
- * a new table for the given variable in the database.
+ * Appends a 32-bit integer in network byte order.
  *
- * \param u     Pointer to the new variable to insert in the database.
- * \param id    The table id to use.
+ * \param value   The value to append
+ * \param dst     Buffer location at which to append the value
+ * \return        The buffer location after the appended value.
+ */
+static char *putInt32(int32_t value, char *dst) {
+  uint32_t v = htobe32((uint32_t) value);
+  memcpy(dst, &v, sizeof(v));
+  return dst + sizeof(v);
+}
+
+
+/**
+ * Appends a 64-bit integer in network byte order.
  *
- * \return      SUCCESS_RETURN (0) if the variable has been successfully added to
- *              the database or else ERROR_RETURN (-1).
+ * \param value   The value to append
+ * \param dst     Buffer location at which to append the value
+ * \return        The buffer location after the appended value.
+ */
+static char *putInt64(int64_t value, char *dst) {
+  uint64_t v = htobe64((uint64_t) value);
+  memcpy(dst, &v, sizeof(v));
+  return dst + sizeof(v);
+}
+
+
+/**
+ * Appends a UNIX time as a PostgreSQL binary timestamp field (including its length), that is as the
+ * number of microseconds since 2000-01-01 00:00:00 UTC.
  *
+ * \param t       (s) UNIX time
+ * \param dst     Buffer location at which to append the field
+ * \return        The buffer location after the appended field.
  */
-static int sqlCreateTable(const Variable *u, int id) {
-  const XField *f = &u->field;
-  XType type;
-  char fmt[SQL_COL_NAME_LEN];
-  char sqlType[SQL_TYPE_LEN];
-  char colName[SQL_COL_NAME_LEN];
-  char *next;
-  int i, n;
+static char *putBinaryTime(time_t t, char *dst) {
+  dst = putInt32(sizeof(int64_t), dst);
+  return putInt64(((int64_t) t - POSTGRES_EPOCH) * 1000000LL, dst);
+}
 
-  if(!u || id < 0) {
-    errno = EINVAL;
-    return ERROR_RETURN;
+
+/**
+ * Appends a binary field (including its length) for an elemental value, converted to the binary type
+ * of the column it is destined for.
+ *
+ * \param data      Pointer to the binary element
+ * \param type      Element type, e.g. X_SHORT
+ * \param colType   The binary type of the destination column, as returned by getBinaryColumnType()
+ * \param dst       Buffer location at which to append the field.
+ * \return          The buffer location after the appended field, or NULL if the element cannot be
+ *                  converted to the column type.
+ */
+static char *appendBinaryValue(const void *data, XType type, XType colType, char *dst) {
+  int64_t i = 0;
+  double d = NAN;
+  boolean isInt = TRUE;
+
+  if(xIsCharSequence(type) || type == X_STRING) {
+    const char *s = data ? (xIsCharSequence(type) ? (const char *) data : *(char **) data) : NULL;
+    int l;
+
+    if(colType != X_STRING) return NULL;
+    if(!s) return putInt32(-1, dst);  // NULL
+
+    l = xIsCharSequence(type) ? (int) strnlen(s, xElementSizeOf(type)) : (int) strlen(s);
+    dst = putInt32(l, dst);
+    memcpy(dst, s, l);
+    return dst + l;
   }
 
-  n = getSampleCount(u);
-  if(n < 1) return SUCCESS_RETURN;
+  if(!data) return putInt32(-1, dst);  // NULL
 
-  type = f->type;
-  if(type == X_STRING) type = X_CHARS(getEnclosingStringLength(f, u->sampling));
+  switch(type) {
+    case X_BOOLEAN: i = *(boolean *) data ? 1 : 0; break;
+    case X_BYTE: i = *(char *) data; break;
+    case X_SHORT: i = *(int16_t *) data; break;
+    case X_INT: i = *(int32_t *) data; break;
+    case X_LONG: i = *(int64_t *) data; break;
+    case X_FLOAT: {
+      float f = *(float *) data;
+      d = isfinite(f) ? f : NAN;
+      isInt = FALSE;
+      break;
+    }
+    case X_DOUBLE: {
+      // Same sanity for extreme doubles as for SQL statements
+      double a;
+      d = *(double *) data;
+      a = fabs(d);
+      if(!isfinite(d) || a > SQL_MAX_DOUBLE) d = NAN;
+      else if(a < SQL_MIN_DOUBLE) d = 0.0;
+      isInt = FALSE;
+      break;
+    }
+    default:
+      return NULL;
+  }
 
-  if(printSQLType(type, sqlType) < 0) {
-    fprintf(stderr, "WARNING! create table: unsupported xchange type '%c'.\n", f->type);
-    return ERROR_RETURN;
+  switch(colType) {
+    case X_BOOLEAN:
+      if(type != X_BOOLEAN) return NULL;
+      dst = putInt32(1, dst);
+      *(dst++) = (char) i;
+      return dst;
+
+    case X_SHORT:
+      if(!isInt) return NULL;
+      dst = putInt32(sizeof(int16_t), dst);
+      return putInt16((int16_t) i, dst);
+
+    case X_INT:
+      if(!isInt) return NULL;
+      dst = putInt32(sizeof(int32_t), dst);
+      return putInt32((int32_t) i, dst);
+
+    case X_LONG:
+      if(!isInt) return NULL;
+      dst = putInt32(sizeof(int64_t), dst);
+      return putInt64(i, dst);
+
+    case X_FLOAT: {
+      float f = isInt ? (float) i : (float) d;
+      int32_t bits;
+      memcpy(&bits, &f, sizeof(bits));
+      dst = putInt32(sizeof(float), dst);
+      return putInt32(bits, dst);
+    }
+
+    case X_DOUBLE: {
+      int64_t bits;
+      if(isInt) d = (double) i;
+      memcpy(&bits, &d, sizeof(bits));
+      dst = putInt32(sizeof(double), dst);
+      return putInt64(bits, dst);
+    }
+
+    default:
+      return NULL;
   }
+}
 
-  // Figure out the length of the last (possibly longest) column's name, incl. separator
-  printColumnFormat(n, fmt);
-  sprintf(colName, fmt, (n - 1));
 
-  // The max. bytes per column definition in the SQL command...
-  i = sizeof(SQL_SEP) + strlen(colName) + strlen(sqlType) + 1;
+/**
+ * Returns the maximum number of bytes that a row of data from a variable may occupy in PostgreSQL's
+ * binary COPY format.
+ *
+ * \param u     Pointer to the variable
+ * \param t     The table descriptor for the variable
+ * \return      (bytes) the maximum size of the row in binary COPY format.
+ */
+static int getBinaryRowSize(const Variable *u, const TableDescriptor *t) {
+  const XField *f = &u->field;
+  int n = getSampleCount(u);
+  int eSize = 2 * sizeof(int64_t);
 
-  // Make sure the command buffer is large enough...
-  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + sizeof(SQL_DATE) + sizeof(SQL_INT32) + (n * i));
+  if(f->type == X_STRING) eSize = getEnclosingStringLength(f, u->sampling);
+  else if(xIsCharSequence(f->type)) eSize = xElementSizeOf(f->type);
 
-  next = cmd;
-  next += sprintf(next, "CREATE TABLE " TABLE_NAME_PATTERN " (time " SQL_DATE " PRIMARY KEY, age " SQL_INT32, id);
+  if(t->cols > n) n = t->cols;
 
-  for(i = 0; i < n; i++) {
-    sprintf(colName, fmt, i);
-    next += sprintf(next, SQL_SEP "%s %s", colName, sqlType);
+  // field count + time + age + data columns (with lengths)
+  return sizeof(int16_t) + (4 + 8) + (4 + 4) + n * (4 + eSize);
+}
+
+
+/**
+ * Appends a row of data from a variable in PostgreSQL's binary COPY format. Columns, for which the
+ * variable has no data, are set to NULL.
+ *
+ * \param u         Pointer to the variable
+ * \param t         The table descriptor for the variable
+ * \param colType   The binary type of the data columns, as returned by getBinaryColumnType()
+ * \param dst       Buffer location at which to append the row.
+ * \return          The buffer location after the appended row, or NULL if the data cannot be converted
+ *                  to the column type.
+ */
+static char *appendBinaryRow(const Variable *u, const TableDescriptor *t, XType colType, char *dst) {
+  const XField *f = &u->field;
+  const char *data = (const char *) f->value;
+  int i, n = getSampleCount(u), step = 1, eSize;
+
+  if(!data) {
+    errno = EINVAL;
+    return NULL;
   }
 
-  sprintf(next, ");");
+  eSize = xElementSizeOf(f->type);
+  if(u->sampling > 1) step = u->sampling;
+  if(n > t->cols) n = t->cols;
 
-  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
+  dst = putInt16((int16_t) (2 + t->cols), dst);
+  dst = putBinaryTime(u->grabTime, dst);
+  dst = putInt32(sizeof(int32_t), dst);
+  dst = putInt32((int32_t) (u->grabTime - u->updateTime), dst);
 
-  return SUCCESS_RETURN;
+  for(i = 0; i < n; i++) {
+    dst = appendBinaryValue(&data[i * step * eSize], f->type, colType, dst);
+    if(!dst) return NULL;
+  }
+
+  // Pad with NULLs
+  for(; i < t->cols; i++) dst = putInt32(-1, dst);
+
+  return dst;
 }
 
 
-static int sqlConvertToHyperTable(int id) {
-  if(id < 0) {
-    errno = EINVAL;
-    return ERROR_RETURN;
+/**
+ * Allocates or reallocates sufficiently sized buffers for parametrized SQL statements.
+ *
+ * \param n         Number of parameters needed.
+ * \param bytes     (bytes) Space needed for the parameter values (incl. lengths).
+ */
+static void ensureParamCapacity(int n, int bytes) {
+  if(bytes > params.size) {
+    params.size = bytes < MIN_CMD_SIZE ? MIN_CMD_SIZE : bytes;
+    params.data = (char *) realloc(params.data, params.size);
+    x_check_alloc(params.data);
   }
 
-  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + sizeof(TIMESCALE));
+  if(n > params.capacity) {
+    params.capacity = n;
+    params.values = (const char **) realloc(params.values, n * sizeof(char *));
+    params.lengths = (int *) realloc(params.lengths, n * sizeof(int));
+    params.formats = (int *) realloc(params.formats, n * sizeof(int));
+    params.types = (Oid *) realloc(params.types, n * sizeof(Oid));
+
+    x_check_alloc(params.values);
+    x_check_alloc(params.lengths);
+    x_check_alloc(params.formats);
+    x_check_alloc(params.types);
+  }
+}
 
-# if TIMESCALEDB_OLD
-  // Old syntax
-  sprintf(cmd, "SELECT create_hypertable('" TABLE_NAME_PATTERN "', 'time', chunk_time_interval => INTERVAL '" TIMESCALE "');", id);
-# else
-  // New syntax
-  sprintf(cmd, "SELECT create_hypertable('" TABLE_NAME_PATTERN "', by_range('time', INTERVAL '" TIMESCALE "'));", id);
-#endif
 
-  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
+/**
+ * Sets the parameter values to the binary fields (each with a 32-bit length, followed by the data)
+ * stored consecutively in a buffer.
+ *
+ * \param fields    Pointer to the first binary field
+ * \param n         Number of fields
+ */
+static void setParams(const char *fields, int n) {
+  int i;
 
-  return SUCCESS_RETURN;
-}
+  for(i = 0; i < n; i++) {
+    uint32_t len;
 
+    memcpy(&len, fields, sizeof(len));
+    fields += sizeof(len);
 
-static int sqlCreateMetaTable(int id) {
-  char samplingType[SQL_TYPE_LEN];
-  char dimType[SQL_TYPE_LEN];
-  char shapeType[SQL_TYPE_LEN];
-  char unitType[SQL_TYPE_LEN];
+    params.lengths[i] = (int32_t) be32toh(len);
+    params.formats[i] = 1;  // binary
+    params.values[i] = params.lengths[i] < 0 ? NULL : fields;
 
-  if(id < 0) {
-    errno = EINVAL;
-    return ERROR_RETURN;
+    if(params.lengths[i] > 0) fields += params.lengths[i];
   }
 
-  printSQLType(X_INT, samplingType);
-  printSQLType(X_BYTE, dimType);
-  printSQLType(X_CHARS(META_SHAPE_LEN - 1), shapeType);
-  printSQLType(X_CHARS(META_UNIT_LEN - 1), unitType);
+  params.n = n;
+}
 
-  // Make sure the command buffer is large enough...
-  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + sizeof(META_SERIAL_ID) + sizeof(SQL_SERIAL) + sizeof(SQL_DATE));
 
-  // Create metadata table
-  sprintf(cmd, "CREATE TABLE " META_NAME_PATTERN " (" META_SERIAL_ID " " SQL_SERIAL " PRIMARY KEY, time " SQL_DATE " NOT NULL, "
-          "sampling %s DEFAULT 1, ndim %s DEFAULT 0, shape %s, unit %s);", id, samplingType, dimType, shapeType, unitType);
+/**
+ * Returns the PostgreSQL type OID for a binary parameter of the given element type.
+ *
+ * \param colType   The binary column type, as returned by getBinaryColumnType()
+ * \return          The corresponding PostgreSQL type OID, or 0 to let the server infer the type.
+ */
+static Oid getParamType(XType colType) {
+  switch(colType) {
+    case X_BOOLEAN: return PG_BOOL_OID;
+    case X_SHORT: return PG_INT2_OID;
+    case X_INT: return PG_INT4_OID;
+    case X_LONG: return PG_INT8_OID;
+    case X_FLOAT: return PG_FLOAT4_OID;
+    case X_DOUBLE: return PG_FLOAT8_OID;
+    case X_STRING: return PG_TEXT_OID;
+    default: return 0;
+  }
+}
 
-  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
 
-  return SUCCESS_RETURN;
+/**
+ * Checks if elements of a given type can be sent in binary format to a column of the given binary type.
+ *
+ * \param type      Element type, e.g. X_SHORT
+ * \param colType   The binary column type, as returned by getBinaryColumnType()
+ * \return          TRUE (1) if the elements can be converted to the column type, or else FALSE (0).
+ */
+static boolean isBinaryCompatible(XType type, XType colType) {
+  if(xIsCharSequence(type) || type == X_STRING) return colType == X_STRING;
+
+  switch(type) {
+    case X_BOOLEAN:
+      return colType == X_BOOLEAN;
+    case X_BYTE:
+    case X_SHORT:
+    case X_INT:
+    case X_LONG:
+      return colType == X_SHORT || colType == X_INT || colType == X_LONG || colType == X_FLOAT || colType == X_DOUBLE;
+    case X_FLOAT:
+    case X_DOUBLE:
+      return colType == X_FLOAT || colType == X_DOUBLE;
+    default:
+      return FALSE;
+  }
 }
 
 
-static int sqlAddMeta(const Variable *u, TableDescriptor *t) {
-  const XField *f = &u->field;
-  char *next = cmd;
-  int step, ndim;
+/**
+ * Prints a parametrized INSERT statement for a variable's table into the command buffer.
+ *
+ * \param t     The table descriptor for the variable
+ */
+static void printInsertStatement(const TableDescriptor *t) {
+  char *next;
+  int i, n = 2 + t->cols;
 
-  if(!u || !t) {
-    errno = EINVAL;
-    return ERROR_RETURN;
-  }
+  ensureCommandCapacity(100 + SQL_TABLE_NAME_LEN + n * (sizeof(SQL_SEP) + 8));
 
-  step = t->sampling;
-  if(step < 1) step = 1;
+  next = cmd;
+  next += sprintf(next, "INSERT INTO " TABLE_NAME_PATTERN " VALUES($1", t->index);
+  for(i = 2; i <= n; i++) next += sprintf(next, SQL_SEP "$%d", i);
+  sprintf(next, ");");
+}
 
-  // Treat all singilar values as scalars.
-  ndim = f->ndim;
-  if(ndim < 1) ndim = 0;
-  else if(ndim == 1 && t->sizes[0] <= 1) ndim = 0;
 
-  ensureCommandCapacity(200 + META_SHAPE_LEN + META_UNIT_LEN);
-  next += sprintf(next, "INSERT INTO " META_NAME_PATTERN " VALUES(DEFAULT" SQL_SEP, t->index);
+/**
+ * Makes sure there is a prepared INSERT statement on the connection for a table, creating it if
+ * necessary. The parameter types must be set before calling this function.
+ *
+ * \param t     The table descriptor for the variable
+ * \param name  The name of the prepared statement
+ * \return      TRUE (1) if the table has a prepared INSERT statement, or else FALSE (0), e.g. if the
+ *              configured maximum number of prepared statements has been reached.
+ *
+ * \sa sqlDeallocateInsert()
+ */
+static boolean sqlPrepareInsert(TableDescriptor *t, const char *name) {
+  boolean success;
 
-  next += strftime(next, 100, SQL_DATE_FORMAT, gmtime(&u->updateTime));
+  if(t->isPrepared) return TRUE;
+  if(nPrepared >= getMaxPrepared()) return FALSE;
 
-  next += sprintf(next, SQL_SEP "%d", step);
-  next += sprintf(next, SQL_SEP "%d", ndim);
+  printInsertStatement(t);
 
-  if(ndim > 0) {
-    next += sprintf(next, SQL_SEP "'");
-    next += xPrintDims(next, ndim, f->sizes);
-    next += sprintf(next, "'");
+  if(pipeline.isActive) {
+    // The result is checked when the pipeline results are processed.
+    if(!PQsendPrepare(sql_db, name, cmd, params.n, params.types)) {
+      fprintf(stderr, "WARNING! PREPARE %s send error: %s", name, PQerrorMessage(sql_db));
+      return FALSE;
+    }
+    dprintf("SQL: [pipeline] PREPARE %s AS %s\n", name, cmd);
+    addPipelineStatement(t);
   }
-  else next += sprintf(next, SQL_SEP "NULL");
+  else {
+    PGresult *res = PQprepare(sql_db, name, cmd, params.n, params.types);
+    dprintf("SQL: PREPARE %s AS %s\n", name, cmd);
 
-  if(*t->unit) next += sprintf(next, SQL_SEP "'%s'", t->unit);
-  else next += sprintf(next, SQL_SEP "NULL");
+    success = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    PQclear(res);
 
-  sprintf(next, ");");
+    if(!success) {
+      fprintf(stderr, "WARNING! PREPARE %s SQL error: %s", name, PQerrorMessage(sql_db));
+      return FALSE;
+    }
+  }
 
-  if(!sqlExecSimple(cmd)) return ERROR_RETURN;
+  t->isPrepared = TRUE;
+  nPrepared++;
 
-  // Keep track of the the current associated metadata
-  t->sampling = u->sampling;
+  return TRUE;
+}
 
-  t->ndim = ndim;
-  memcpy(t->sizes, f->sizes, sizeof(t->sizes));
 
-  if(u->unit) strncpy(t->unit, u->unit, META_UNIT_LEN - 1);
-  else t->unit[0] = '\0';
+/**
+ * Discards the prepared INSERT statement for a table (if any), e.g. after its columns have changed. A
+ * new statement will be prepared the next time data is inserted into the table.
+ *
+ * \param t     The table descriptor for the variable
+ *
+ * \sa sqlPrepareInsert()
+ */
+static void sqlDeallocateInsert(TableDescriptor *t) {
+  // Settle any pending PREPARE first.
+  sqlExitPipeline();
 
-  t->hasMeta = TRUE;
-  t->metaVersion++;
+  if(!t->isPrepared) return;
 
-  return SUCCESS_RETURN;
+  t->isPrepared = FALSE;
+  nPrepared--;
+
+  ensureCommandCapacity(100 + SQL_TABLE_NAME_LEN);
+  sprintf(cmd, "DEALLOCATE " INSERT_STMT_PATTERN ";", t->index);
+  sqlExecSimple(cmd);
 }
 
 
-static int sqlGetLastMeta(TableDescriptor *t) {
-  PGresult *res;
-  const char *val = NULL;
+/**
+ * Inserts a row of data from a variable into its table, via a parametrized statement with binary
+ * parameters. It uses the prepared INSERT statement for the table, creating it first if needed.
+ *
+ * \param u         Pointer to the variable
+ * \param t         The table descriptor for the variable
+ * \param colType   The binary type of the data columns, as returned by getBinaryColumnType()
+ * \return          SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ */
+static int sqlInsertParams(const Variable *u, TableDescriptor *t, XType colType) {
+  char name[SQL_TABLE_NAME_LEN];
+  const char *end;
+  int i, n = 2 + t->cols, success;
 
-  if(!t) {
-    errno = EINVAL;
-    return FALSE;
-  }
+  ensureParamCapacity(n, getBinaryRowSize(u, t));
 
-  ensureCommandCapacity(100 + SQL_TABLE_NAME_LEN + sizeof(SQL_LAST(META_SERIAL_ID)));
+  end = appendBinaryRow(u, t, colType, params.data);
+  if(!end) return ERROR_RETURN;
 
-  sprintf(cmd, "SELECT * FROM " META_NAME_PATTERN " " SQL_LAST(META_SERIAL_ID) ";", t->index);
-  if(!sqlExec(cmd, &res)) return FALSE;
+  // Skip the leading field count
+  setParams(params.data + sizeof(int16_t), n);
 
-  if(PQntuples(res) < 1) {
-    PQclear(res);
-    errno = ECHRNG;
-    return FALSE;
-  }
+  params.types[0] = PG_TIMESTAMPTZ_OID;
+  params.types[1] = PG_INT4_OID;
+  for(i = 2; i < n; i++) params.types[i] = getParamType(colType);
 
-  val = PQgetvalue(res, 0, 0);
-  if(val) sscanf(val, "%d", &t->metaVersion);
+  sprintf(name, INSERT_STMT_PATTERN, t->index);
 
-  t->sampling = 1;
-  val = PQgetvalue(res, 0, 2);
-  if(val) sscanf(val, "%d", &t->sampling);
+  if(sqlPrepareInsert(t, name)) success = sqlExecParams(NULL, name);
+  else {
+    printInsertStatement(t);
+    success = sqlExecParams(cmd, NULL);
+  }
 
-  t->ndim = 0;
-  memset(t->sizes, 0, sizeof(t->sizes));
+  if(!success) return ERROR_RETURN;
 
-  val = PQgetvalue(res, 0, 3);
-  if(val) if(sscanf(val, "%d", &t->ndim) == 1) if(t->ndim > 0) {
-    val = PQgetvalue(res, 0, 4);
-    if(val) xParseDims(val, t->sizes);
+  if(batch.isOpen) {
+    batch.rows++;
+    batch.bytes += end - params.data;
   }
 
-  val = PQgetvalue(res, 0, 5);
-  if(val) if(*val) strncpy(t->unit, val, sizeof(t->unit) - 1);
+  return SUCCESS_RETURN;
+}
 
-  PQclear(res);
 
-  return TRUE;
-}
+/**
+ * Inserts new metadata for a variable into its metadata table, via a parametrized statement with binary
+ * parameters.
+ *
+ * \param u       Pointer to the variable
+ * \param t       The table descriptor for the variable
+ * \param step    The sampling step of the data
+ * \param ndim    The dimensionality of the data (0 for scalars)
+ * \return        SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ */
+static int sqlAddMetaParams(const Variable *u, const TableDescriptor *t, int step, int ndim) {
+  char shape[X_MAX_STRING_DIMS] = {'\0'};
+  char *next;
+  int nShape = 0, nUnit = strlen(t->unit);
 
+  if(ndim > 0) nShape = xPrintDims(shape, ndim, u->field.sizes);
 
-static boolean isMetaUpdate(const Variable *u, const TableDescriptor *t) {
-  const XField *f = &u->field;
-  int i;
-  int ndim = f->ndim;
+  ensureParamCapacity(5, 100 + nShape + nUnit);
 
-  if(!u || !t) {
-    errno = EINVAL;
-    return FALSE;
-  }
+  next = params.data;
+  next = putBinaryTime(u->updateTime, next);
+  next = putInt32(sizeof(int32_t), next);
+  next = putInt32(step, next);
+  next = putInt32(sizeof(int16_t), next);
+  next = putInt16((int16_t) ndim, next);
 
-  // If the table does not have associated metadata already, then let's add one.
-  if(!t->hasMeta) {
-    dprintf("! Initial metadata %s\n", u->id);
-    return TRUE;
+  next = putInt32(ndim > 0 ? nShape : -1, next);
+  if(ndim > 0) {
+    memcpy(next, shape, nShape);
+    next += nShape;
   }
 
-  if(t->sampling != u->sampling) {
-    dprintf("! Found new sampling for %s\n", u->id);
-    return TRUE;
-  }
+  next = putInt32(nUnit ? nUnit : -1, next);
+  if(nUnit) memcpy(next, t->unit, nUnit);
 
-  // Treat all singular values as scalar
-  if(ndim < 1) ndim = 0;
-  else if(ndim == 1 && f->sizes[0] <= 1) ndim = 0;
+  setParams(params.data, 5);
 
-  if(ndim != u->field.ndim) {
-    dprintf("! Found new dimensionality for %s\n", u->id);
-    return TRUE;
-  }
+  params.types[0] = PG_TIMESTAMPTZ_OID;
+  params.types[1] = PG_INT4_OID;
+  params.types[2] = PG_INT2_OID;
+  params.types[3] = PG_TEXT_OID;
+  params.types[4] = PG_TEXT_OID;
 
-  for(i = 0; i < t->ndim; i++) if(t->sizes[i] != u->field.sizes[i]) {
-    dprintf("! Found new shape for %s\n", u->id);
-    return TRUE;
-  }
+  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN);
+  sprintf(cmd, "INSERT INTO " META_NAME_PATTERN " (time, sampling, ndim, shape, unit) VALUES($1, $2, $3, $4, $5);", t->index);
 
-  if(u->unit) {
-    size_t n = strlen(u->unit);
-    if(n >= sizeof(t->unit)) n = sizeof(t->unit) - 1;
-    if(strncmp(u->unit, t->unit, n) != 0) {
-      dprintf("! Found new physical unit for %s\n", u->id);
-      return TRUE;
-    }
-  }
+  if(!sqlExecParams(cmd, NULL)) return ERROR_RETURN;
 
-  return FALSE;
+  return SUCCESS_RETURN;
 }
 
 
 /**
- *  Execute an SQL command.
+ * Puts the connection into pipeline mode, if it is not in pipeline mode already.
  *
- *  \param sql      Pointer to the command string
- *  \param resp     Reference to the object pointer containing the response.
+ * \return      TRUE (1) if the connection is in pipeline mode, or else FALSE (0).
  *
- *  \return         TRUE (non-zero) on success, or FALSE (0) on error.
+ * \sa sqlExitPipeline()
  */
-static int sqlExec(const char *sql, PGresult **resp) {
-  if(!sql || !resp) {
-    errno = EINVAL;
-    return FALSE;
-  }
-
-  if(!cmd[0]) {
-    errno = EAGAIN;
-    return FALSE;
-  }
+static boolean sqlEnterPipeline() {
+  if(pipeline.isActive) return TRUE;
 
-  *resp = PQexec(sql_db, sql);
-  dprintf("SQL: %s\n", sql);
-  if(PQresultStatus(*resp) != PGRES_COMMAND_OK && PQresultStatus(*resp) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "WARNING! %s SQL error: %s", sql,  PQerrorMessage(sql_db));
-    errno = EBADE;
+  if(PQenterPipelineMode(sql_db) != 1) {
+    fprintf(stderr, "WARNING! Cannot enter pipeline mode: %s", PQerrorMessage(sql_db));
     return FALSE;
   }
 
+  dprintf("Entered pipeline mode.\n");
+  pipeline.isActive = TRUE;
   return TRUE;
 }
 
 
 /**
- *  Executes an SQL command, ignoring the response received from the server.
+ * Takes the connection out of pipeline mode, e.g. before executing statements synchronously. The open
+ * batch (if any) is sent and all results are processed first.
  *
- *  \param sql      Pointer to the command string
- *
- *  \return         TRUE (non-zero) on success, or FALSE (0) on error.
+ * \sa sqlEnterPipeline()
  */
-static int sqlExecSimple(const char *sql) {
-  PGresult *reply = NULL;
-  int success;
+static void sqlExitPipeline() {
+  if(!pipeline.isActive) return;
 
-  if(!sql) {
-    errno = EINVAL;
-    return FALSE;
-  }
+  if(batch.isOpen) sqlCommitBatch();
+  sqlDrainPipeline();
 
-  success = sqlExec(sql, &reply);
-  if(success) PQclear(reply);
-  return success;
+  if(PQexitPipelineMode(sql_db) != 1) fprintf(stderr, "WARNING! Cannot exit pipeline mode: %s", PQerrorMessage(sql_db));
+
+  dprintf("Exited pipeline mode.\n");
+  pipeline.isActive = FALSE;
 }
 
 
-static void sqlDisconnect() {
-  dprintf("Disconnecting.\n");
-  pthread_mutex_lock(&mutex);
-  if(sql_db) {
-    PQfinish(sql_db);
-    sql_db = NULL;
+/**
+ * Keeps track of a statement that was sent in pipeline mode for the row currently being sent, so its
+ * result can be matched to the row later.
+ *
+ * \param prepared    The table whose INSERT statement is prepared by the statement, or NULL if the
+ *                    statement does not prepare an INSERT.
+ */
+static void addPipelineStatement(TableDescriptor *prepared) {
+  PipelineStatement *s;
+
+  if(pipeline.nStatements >= pipeline.statementCapacity) {
+    pipeline.statementCapacity = pipeline.statementCapacity ? (pipeline.statementCapacity << 1) : MIN_CMD_SIZE;
+    pipeline.statements = (PipelineStatement *) realloc(pipeline.statements, pipeline.statementCapacity * sizeof(PipelineStatement));
+    x_check_alloc(pipeline.statements);
   }
-  pthread_mutex_unlock(&mutex);
+
+  s = &pipeline.statements[pipeline.nStatements++];
+  s->row = pipeline.nRows - 1;
+  s->prepared = prepared;
 }
 
 
 /**
- * Connects to the SQL server.
+ * Sends the statements for inserting a row of data (and its metadata, if changed) in pipeline mode,
+ * without waiting for the results. The variable is kept until the results are processed.
  *
- * \param userName  Database user name (cannot be NULL)
- * \param dbName    Database name or NULL
- * \return      SUCCESS_RETURN (0) if the connected, or else ERROR_RETURN (-1).
+ * \param u     Pointer to the variable
+ * \param t     The table descriptor for the variable
+ *
+ * \sa sqlDrainPipeline()
  */
-static int sqlConnect(const char *userName, const char *auth, const char *dbName) {
-  int pos;
+static void sqlPipeRow(Variable *u, TableDescriptor *t) {
+  PipelineRow *r;
 
-  if(!userName) {
-    errno = EINVAL;
-    return ERROR_RETURN;
+  if(pipeline.nRows >= pipeline.rowCapacity) {
+    pipeline.rowCapacity = pipeline.rowCapacity ? (pipeline.rowCapacity << 1) : MIN_CMD_SIZE;
+    pipeline.rows = (PipelineRow *) realloc(pipeline.rows, pipeline.rowCapacity * sizeof(PipelineRow));
+    x_check_alloc(pipeline.rows);
   }
 
-  ensureCommandCapacity(200);
+  r = &pipeline.rows[pipeline.nRows++];
+  r->var = u;
+  r->table = t;
+  r->hasMeta = FALSE;
+  r->failed = FALSE;
 
-  pos = sprintf(cmd, "host=%s user=%s", getSQLServerAddress(), userName);
+  if(sqlInsertData(u, t) != SUCCESS_RETURN) r->failed = TRUE;
+  else if(isMetaUpdate(u, t)) {
+    if(sqlAddMeta(u, t) != SUCCESS_RETURN) r->failed = TRUE;
+    else r->hasMeta = TRUE;
+  }
+}
 
-  if(dbName) pos += sprintf(&cmd[pos], " dbname=%s", dbName);
 
-  // Add password if needed
-  if(auth) sprintf(&cmd[pos], " password=%s", auth);
+/**
+ * Ends the current pipeline segment with a sync point. The statements sent since the previous sync
+ * point are executed in a single (implicit) transaction. Once the configured number of rows are in
+ * flight, it waits for the results of all pending segments.
+ *
+ * \param isBatch   Whether the rows in the segment form a batch. If a batch fails, its rows are
+ *                  retried without the rows that caused the failure.
+ * \return          TRUE (1) if successful, or else FALSE (0).
+ */
+static int sqlPipelineSync(boolean isBatch) {
+  PipelineSegment *s;
+  int success;
 
-  dprintf("connect %s\n", cmd);
-  sql_db = PQconnectdb(cmd);
+  if(pipeline.nSegments > 0) {
+    s = &pipeline.segments[pipeline.nSegments - 1];
+    if(s->endRow == pipeline.nRows && s->endStatement == pipeline.nStatements) return TRUE;
+  }
+  else if(!pipeline.nRows) return TRUE;
 
-  // Check to see that the backend connection was successfully made
-  if (PQstatus(sql_db) != CONNECTION_OK) {
-    fprintf(stderr, "WARNING! connect to '%s' failed: %s\n", cmd, PQerrorMessage(sql_db));
-    PQfinish(sql_db);
-    return ERROR_RETURN;
+  success = (PQpipelineSync(sql_db) == 1);
+  if(!success) fprintf(stderr, "WARNING! Pipeline sync failed: %s", PQerrorMessage(sql_db));
+
+  if(pipeline.nSegments >= pipeline.segmentCapacity) {
+    pipeline.segmentCapacity = pipeline.segmentCapacity ? (pipeline.segmentCapacity << 1) : DEFAULT_STRING_LEN;
+    pipeline.segments = (PipelineSegment *) realloc(pipeline.segments, pipeline.segmentCapacity * sizeof(PipelineSegment));
+    x_check_alloc(pipeline.segments);
   }
-  printf("Connected to SQL server\n");
 
-  atexit(sqlDisconnect);
+  s = &pipeline.segments[pipeline.nSegments++];
+  s->endRow = pipeline.nRows;
+  s->endStatement = pipeline.nStatements;
+  s->isBatch = isBatch;
 
-  return SUCCESS_RETURN;
+  // Make sure the results are collected in a timely manner, even if no more data arrives.
+  if(pipeline.nSegments == 1) setDeadline(getBatchTime(), &pipeline.deadline);
+
+  if(pipeline.nRows >= getPipelineDepth()) sqlDrainPipeline();
+
+  return success;
 }
 
 
 /**
- * Connects to the SQL server. If not successful, it will keep trying to connect the specified
- * number of times, at intervals defined by CONNECT_RETRY_SECONDS.
- *
- * \param       Number of retry attempts.
+ * Adds a variable to the list of variables to retry, e.g. because it was part of a failed batch,
+ * without being the cause of the failure.
  *
- * \return      SUCCESS_RETURN (0) if the connection has been established, or ERROR_RETURN (-1)
- *              if could not connect even after the requested number of retries.
+ * \param u     Pointer to the variable
  *
- */
-static int sqlConnectRetry(int attempts) {
-  int i;
-  // Connect to the database (and keep retrying...)
-  for(i = 1; i < attempts; i++) {
-    if(sqlConnect(getSQLUserName(), getSQLAuth(), getSQLDatabaseName()) == SUCCESS_RETURN) return SUCCESS_RETURN;
-    fprintf(stderr, "Will retry connecting to SQL server in %d seconds (%d of %d)...\n", CONNECT_RETRY_SECONDS, i, attempts);
-    sleep(CONNECT_RETRY_SECONDS);
-  }
-
-  fprintf(stderr, "ERROR! SQL connection failed after %d attemps. Exiting.\n", i);
-  errno = ENOTCONN;
-  return ERROR_RETURN;
+ * \sa pullRetry()
+ */
+static void addRetry(Variable *u) {
+  u->isRetried = TRUE;
+  u->next = NULL;
+  if(pipeline.retryLast) pipeline.retryLast->next = u;
+  else pipeline.retryFirst = u;
+  pipeline.retryLast = u;
 }
 
 
 /**
- *  Create a new variable in the database.  Returns new table id on
- *  success, zero on error.  is_dsm should be true if the variable is
- *  from DSM (will cause a unix timestamp column to be added)
+ * Takes the next variable from the list of variables to retry, if any.
  *
- *  \param      Pointer to the variable for which to create a new entity in the database.
+ * \return    The next variable to retry, or NULL if there are none.
  *
- *  \return     SUCCESS_RETURN (0) if the variable was successfully added in the databsase
- *              or ERROR_RETURN (-1) otherwise.
+ * \sa addRetry()
  */
-static int sqlInsertVariable(const Variable *u) {
-  PGresult *reply;
-  int tid;
+static Variable *pullRetry() {
+  Variable *u = pipeline.retryFirst;
 
-  if(!u) {
-    errno = EINVAL;
-    return ERROR_RETURN;
-  }
+  if(!u) return NULL;
 
-  // do it atomically
-  if(!sqlBegin()) return ERROR_RETURN;
+  pipeline.retryFirst = u->next;
+  if(!pipeline.retryFirst) pipeline.retryLast = NULL;
 
-  fprintf(stderr, "!ADD! %s\n", u->id);
+  u->next = NULL;
+  return u;
+}
 
-  ensureCommandCapacity(100 + strlen(u->id));
 
-  // Create a new title in the DB for the variable-name, assigning it a tid
-  sprintf(cmd, "INSERT INTO titles VALUES('%s', DEFAULT) RETURNING tid;", u->id);
-  if(!sqlExec(cmd, &reply)) goto cleanup; // @suppress("Goto statement used")
+/**
+ * Reads the results up to and including the sync point that ends a pipeline segment, after the results
+ * of the statements in the segment have been read. Any other result before the sync point (e.g. an error
+ * from the implicit commit) means that the segment was not committed.
+ *
+ * \return    TRUE (1) if the segment was committed, or else FALSE (0).
+ */
+static boolean sqlReadPipelineSync() {
+  boolean success = TRUE;
+  int nEmpty = 0;
 
-  if(1 != sscanf(PQgetvalue(reply, 0, 0), "%d", &tid)) goto cleanup; // @suppress("Goto statement used")
+  for(;;) {
+    PGresult *res = PQgetResult(sql_db);
+    ExecStatusType status;
 
-  PQclear(reply);
+    if(!res) {
+      // A NULL ends the results of each failed query. Two in a row means there is no sync point coming.
+      if(++nEmpty > 1 || PQstatus(sql_db) != CONNECTION_OK) break;
+      continue;
+    }
 
-  // Create a table containing columns for each variable entry
-  if(sqlCreateTable(u, tid) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
+    nEmpty = 0;
+    status = PQresultStatus(res);
 
-  if(isUseHyperTables()) if(sqlConvertToHyperTable(tid) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
+    if(status == PGRES_PIPELINE_SYNC) {
+      PQclear(res);
+      return success;
+    }
 
-  // Create an index for the table for faster data access
-  ensureCommandCapacity(100 + 2 * SQL_TABLE_NAME_LEN);
-  sprintf(cmd, "CREATE UNIQUE INDEX " TABLE_NAME_PATTERN "_index_time ON " TABLE_NAME_PATTERN " (time);", tid, tid);
+    fprintf(stderr, "WARNING! pipeline commit failed: %s", PQresultErrorMessage(res));
+    PQclear(res);
+    success = FALSE;
+  }
 
-  if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+  fprintf(stderr, "WARNING! Missing pipeline sync: %s", PQerrorMessage(sql_db));
+  return FALSE;
+}
 
-  if(sqlCreateMetaTable(tid) != SUCCESS_RETURN)  goto cleanup; // @suppress("Goto statement used")
 
-  // Finish the atomic block
-  if(!sqlCommit()) tid = ERROR_RETURN;
+/**
+ * Processes the results for all rows sent in pipeline mode, reporting errors for the variables whose
+ * rows failed to insert. Failed rows are discarded. Rows in a failed batch that were not themselves the
+ * cause of the failure are queued for another try. If a segment failed without any row to blame (e.g.
+ * because its commit failed), its rows are queued for another try once, and reported lost if they fail
+ * again. The variables are destroyed once their results are processed (unless queued again).
+ *
+ */
+static void sqlDrainPipeline() {
+  int i, k = 0, from = 0;
 
-  return tid;
+  for(i = 0; i < pipeline.nSegments; i++) {
+    const PipelineSegment *s = &pipeline.segments[i];
+    PGresult *res;
+    boolean aborted = FALSE;
+    int j, nFailed = 0, nRetry = 0, nLost = 0;
 
-  // -------------------------------------------------------------------------------
-  cleanup:
+    for(; k < s->endStatement; k++) {
+      const PipelineStatement *st = &pipeline.statements[k];
+      ExecStatusType status;
 
-  sqlRollback();
+      res = PQgetResult(sql_db);
+      status = PQresultStatus(res);
 
-  return ERROR_RETURN;
-}
+      if(status == PGRES_PIPELINE_ABORTED) aborted = TRUE;
+      else if(status != PGRES_COMMAND_OK) {
+        const char *msg = res ? PQresultErrorMessage(res) : PQerrorMessage(sql_db);
 
+        aborted = TRUE;
 
-static int sqlAddColumns(TableDescriptor *t, const Variable *u) {
-  char tabName[SQL_TABLE_NAME_LEN];
-  char colName[SQL_COL_NAME_LEN];
-  char oldFmt[SQL_COL_NAME_LEN], newFmt[SQL_COL_NAME_LEN];
+        if(st->row >= 0) {
+          PipelineRow *r = &pipeline.rows[st->row];
 
-  if(!t || !u) {
-    errno = EINVAL;
-    return ERROR_RETURN;
-  }
+          fprintf(stderr, "WARNING! %s SQL error: %s", r->var->id, msg);
 
-  int i, nCols = getSampleCount(u);
+          if(!r->failed) nFailed++;
+          r->failed = TRUE;
+        }
+        else fprintf(stderr, "WARNING! pipeline SQL error: %s", msg);
+      }
 
-  if(nCols <= t->cols) return SUCCESS_RETURN;
+      // The prepared statement does not exist unless PREPARE succeeded.
+      if(st->prepared && status != PGRES_COMMAND_OK) if(st->prepared->isPrepared) {
+        st->prepared->isPrepared = FALSE;
+        nPrepared--;
+      }
 
-  fprintf(stderr, "!CHANGE! Add %d columns to %s\n", nCols - t->cols, t->id);
+      if(!res) continue;
 
-  sprintf(tabName, TABLE_NAME_PATTERN, t->index);
+      PQclear(res);
+      while((res = PQgetResult(sql_db)) != NULL) PQclear(res);
+    }
 
-  ensureCommandCapacity(200 + sizeof(tabName) + 2 * sizeof(colName));
+    // The implicit commit at the sync point may fail too.
+    if(!sqlReadPipelineSync()) aborted = TRUE;
 
-  // do it atomically
-  if(!sqlBegin()) return ERROR_RETURN;
+    for(j = from; j < s->endRow; j++) {
+      PipelineRow *r = &pipeline.rows[j];
 
-  // Check if column names need extra digits compared to what we had before
-  if(printColumnFormat(t->cols, oldFmt) < printColumnFormat(nCols, newFmt)) for(i = 0; i < t->cols; i++) {
-    char oldName[SQL_COL_NAME_LEN];
+      // Nothing in a failed segment was committed, including the metadata.
+      if(aborted && r->hasMeta) r->table->hasMeta = FALSE;
 
-    sprintf(oldName, oldFmt, i);  // existing column name
-    sprintf(colName, newFmt, i);  // new column name with extra digit
+      // Rows that did not cause the failure are retried. If no row was to blame (e.g. the commit failed),
+      // each row is retried once only.
+      if(aborted && !r->failed && (nFailed > 0 ? s->isBatch : !r->var->isRetried)) {
+        addRetry(r->var);
+        nRetry++;
+      }
+      else {
+        if(aborted && !r->failed) nLost++;
+        destroyVariable(r->var);
+      }
+    }
 
-    // Change the old column name to add the extra digit
-    sprintf(cmd, "ALTER TABLE %s RENAME COLUMN %s TO %s;", tabName, oldName, colName);
-    if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+    if(aborted) fprintf(stderr, "WARNING! Pipeline segment of %d rows failed. Will retry %d rows, %d rows lost.\n",
+            s->endRow - from, nRetry, nLost);
+
+    from = s->endRow;
   }
 
-  while(t->cols < nCols) {
-    sprintf(colName, newFmt, t->cols);  // added column name
+  pipeline.nRows = 0;
+  pipeline.nStatements = 0;
+  pipeline.nSegments = 0;
+}
 
-    // Add a column to the table
-    sprintf(cmd, "ALTER TABLE %s ADD COLUMN %s %s;", tabName, colName, t->sqlType);
-    if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
 
-    t->cols++;
+/**
+ * Sends the data from a variable to the database in pipeline mode, creating a new table if necessary
+ * for new variables. Outside of a batch, each row is sent in its own transaction. The variable is
+ * destroyed once its result has been processed.
+ *
+ * \param u     Pointer to the variable
+ * \return      SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ *
+ * \sa sqlDrainPipeline()
+ */
+static int sqlPipeValues(Variable *u) {
+  TableDescriptor *t = sqlPrepareTable(u);
+
+  if(!t) {
+    destroyVariable(u);
+    return ERROR_RETURN;
   }
 
-  // Finish atomic block
-  if(!sqlCommit()) return ERROR_RETURN;
+  // Schema changes and lookups take the connection out of pipeline mode, ending the open batch also.
+  if(isBatching() && !batch.isOpen) sqlBeginBatch(u->grabTime);
 
-  return SUCCESS_RETURN;
+  if(!sqlEnterPipeline()) {
+    int status = sqlInsertRow(u, t);
+    destroyVariable(u);
+    return status;
+  }
 
-  // -------------------------------------------------------------------------------
-  cleanup:
+  sqlPipeRow(u, t);
 
-  sqlRollback();
+  if(!batch.isOpen) if(!sqlPipelineSync(FALSE)) return ERROR_RETURN;
 
-  return ERROR_RETURN;
+  return SUCCESS_RETURN;
 }
 
 
-static int sqlChangeType(TableDescriptor *t, const char *newType) {
-  char tabName[SQL_TABLE_NAME_LEN];
-  char colName[SQL_COL_NAME_LEN];
-  char fmt[SQL_COL_NAME_LEN];
+/**
+ * Streams rows of data for the same table into the database via a binary COPY. It does not insert
+ * metadata for the rows.
+ *
+ * \param rows    Array of pending rows, all of which must belong to the same table.
+ * \param n       Number of rows in the array
+ * \return        SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ */
+static int sqlCopyRows(const PendingRow *rows, int n) {
+  static const char header[] = { 'P', 'G', 'C', 'O', 'P', 'Y', '\n', '\377', '\r', '\n', '\0', 0, 0, 0, 0, 0, 0, 0, 0 };
 
-  int i;
+  const TableDescriptor *t = rows[0].table;
+  XType colType = getBinaryColumnType(t->sqlType);
+  char copyCmd[100 + SQL_TABLE_NAME_LEN];
+  PGresult *res;
+  char *next;
+  long size = sizeof(header) + sizeof(int16_t);
+  int i, success;
 
-  fprintf(stderr, "!CHANGE! %s type to %s\n", t->id, newType);
+  if(colType == X_UNKNOWN) return ERROR_RETURN;
 
-  sprintf(tabName, TABLE_NAME_PATTERN, t->index);
+  for(i = 0; i < n; i++) size += getBinaryRowSize(rows[i].var, t);
+  ensureCommandCapacity((int) size);
 
-  printColumnFormat(t->cols, fmt);
+  next = cmd;
+  memcpy(next, header, sizeof(header));
+  next += sizeof(header);
 
-  ensureCommandCapacity(100 + sizeof(tabName) + 2 * sizeof(colName));
+  for(i = 0; i < n; i++) {
+    next = appendBinaryRow(rows[i].var, t, colType, next);
+    if(!next) return ERROR_RETURN;
+  }
 
-  // do it atomically
-  if(!sqlBegin()) return ERROR_RETURN;
+  next = putInt16(-1, next);  // file trailer
 
-  for(i = 0; i < t->cols; i++) {
-    sprintf(colName, fmt, i);
+  sprintf(copyCmd, "COPY " TABLE_NAME_PATTERN " FROM STDIN (FORMAT binary);", t->index);
+  dprintf("SQL: %s [%d rows]\n", copyCmd, n);
 
-    // Change the column type -- the syntax is SQL flavor dependent
-    sprintf(cmd, "ALTER TABLE %s ALTER COLUMN %s TYPE %s;", tabName, colName, newType);
-    if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+  res = PQexec(sql_db, copyCmd);
+  success = (PQresultStatus(res) == PGRES_COPY_IN);
+  PQclear(res);
+
+  if(!success) {
+    fprintf(stderr, "WARNING! %s SQL error: %s", copyCmd, PQerrorMessage(sql_db));
+    return ERROR_RETURN;
   }
 
-  // Finish the atomic block
-  if(!sqlCommit()) return ERROR_RETURN;
+  if(PQputCopyData(sql_db, cmd, (int) (next - cmd)) == 1) success = (PQputCopyEnd(sql_db, NULL) == 1);
+  else PQputCopyEnd(sql_db, "failed to send data");
 
-  strncpy(t->sqlType, newType, sizeof(t->sqlType) - 1);
+  while((res = PQgetResult(sql_db)) != NULL) {
+    if(PQresultStatus(res) != PGRES_COMMAND_OK) success = FALSE;
+    PQclear(res);
+  }
 
-  return SUCCESS_RETURN;
+  if(!success) {
+    fprintf(stderr, "WARNING! %s SQL error: %s", copyCmd, PQerrorMessage(sql_db));
+    return ERROR_RETURN;
+  }
 
-  // -------------------------------------------------------------------------------
-  cleanup:
+  return SUCCESS_RETURN;
+}
 
-  sqlRollback();
 
-  return ERROR_RETURN;
+/**
+ * Saves or restores the metadata state of a table descriptor.
+ *
+ * \param from    The descriptor from which to copy the metadata state
+ * \param to      The descriptor to which to copy the metadata state
+ */
+static void copyMetaState(const TableDescriptor *from, TableDescriptor *to) {
+  to->hasMeta = from->hasMeta;
+  to->metaVersion = from->metaVersion;
+  to->sampling = from->sampling;
+  to->ndim = from->ndim;
+  memcpy(to->sizes, from->sizes, sizeof(to->sizes));
+  memcpy(to->unit, from->unit, sizeof(to->unit));
 }
 
 
 /**
- * Pushes the data from a variable into the database, creating a new table if necessary for new
- * variables.
+ * Inserts pending rows for the same table within the current batch. If there are enough rows, they are
+ * streamed via a single binary COPY (after inserting any changed metadata) under one savepoint. If the
+ * COPY fails, or if there are only a few rows, then the rows are inserted one by one, with each
+ * row isolated by its own savepoint.
  *
- * \param u     Pointer to the variable
- * \return      SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ * \param rows    Array of pending rows, all of which must belong to the same table.
+ * \param n       Number of rows in the array
+ * \return        The number of rows successfully inserted.
  */
-static int sqlAddValues(const Variable *u) {
-  const XField *f = &u->field;
-  TableDescriptor *t;
-  int len;
-  char *next = cmd;
-  char sqlType[SQL_TYPE_LEN];
+static int sqlFlushTableRows(const PendingRow *rows, int n) {
+  TableDescriptor *t = rows[0].table;
+  int i, inserted = 0;
 
-  if(!u) {
-    errno = EINVAL;
-    return ERROR_RETURN;
-  }
+  if(n >= getCopyMinRows() && getBinaryColumnType(t->sqlType) != X_UNKNOWN) {
+    TableDescriptor saved;
 
-  t = getTableDescriptor(u);
-  if(!t) {
-    fprintf(stderr, "ERROR! No SQL table -- this is just great.\n");
-    errno = EAGAIN;
-    return ERROR_RETURN;
+    copyMetaState(t, &saved);
+
+    if(sqlExecSimple("SAVEPOINT " ROW_SAVEPOINT ";")) {
+      for(i = 0; i < n; i++) if(isMetaUpdate(rows[i].var, t)) if(sqlAddMeta(rows[i].var, t) != SUCCESS_RETURN) break;
+
+      if(i == n) if(sqlCopyRows(rows, n) == SUCCESS_RETURN) {
+        if(sqlExecSimple("RELEASE SAVEPOINT " ROW_SAVEPOINT ";")) return n;
+      }
+
+      dprintf("! COPY failed for %s. Will insert rows one by one.\n", t->id);
+      sqlExecSimple("ROLLBACK TO SAVEPOINT " ROW_SAVEPOINT "; RELEASE SAVEPOINT " ROW_SAVEPOINT ";");
+      copyMetaState(&saved, t);
+    }
   }
 
-  dprintf("Found cached translation entry, TID = %d\n", t->index);
+  for(i = 0; i < n; i++) if(sqlInsertRow(rows[i].var, t) == SUCCESS_RETURN) inserted++;
 
-  if(f->type == X_STRING) {
-    len = getEnclosingStringLength(&u->field, u->sampling);
+  return inserted;
+}
 
-    if(strcmp(t->sqlType, SQL_TEXT) != 0) {
-      int got = 0;
-      sscanf(t->sqlType, "VARCHAR(%d)", &got);
 
-      if(len <= got) {
-        getStringType(getEnclosingStringLength(&u->field, u->sampling), sqlType);
-        if(sqlChangeType(t, sqlType) < 0) return ERROR_RETURN;
-      }
-    }
+/**
+ * Orders pending rows by table, while keeping rows for the same table in the order they were queued.
+ *
+ * \param a   Pointer to the first pending row
+ * \param b   Pointer to the second pending row
+ * \return    A negative, zero, or positive value if a comes before, same as, or after b.
+ */
+static int cmpPendingRows(const void *a, const void *b) {
+  const PendingRow *A = (const PendingRow *) a;
+  const PendingRow *B = (const PendingRow *) b;
 
-    len += 2; // + quotes around string values....
-  }
-  else if(printSQLType(f->type, sqlType) < 0) {
-    fprintf(stderr, "WARNING! add values: unsupported xchange type '%c' - skipping\n", f->type);
-    return ERROR_RETURN;
-  }
-  else {
-    if(cmpSQLType(sqlType, t->sqlType) > 0) if(sqlChangeType(t, sqlType) < 0) return ERROR_RETURN;
+  if(A->table->index != B->table->index) return A->table->index < B->table->index ? -1 : 1;
+  return A->seq < B->seq ? -1 : (A->seq > B->seq ? 1 : 0);
+}
 
-    len = getStringSize(f->type); // maximum size for each entry
-    if(len < 0) {
-      fprintf(stderr, "WARNING! Unknown string size of data type '%c' - skipping\n", f->type);
-      return ERROR_RETURN;
-    }
-  }
 
-  if(getSampleCount(u) > t->cols) if(sqlAddColumns(t, u) < 0) return ERROR_RETURN;
+/**
+ * Inserts all rows pending in the current batch, grouped by table, and destroys the variables once
+ * they are inserted (or failed to insert).
+ *
+ */
+static void sqlFlushPending() {
+  int i, from = 0, rows = batch.rows;
+  long bytes = batch.bytes;
 
-  len += sizeof(SQL_SEP); // + separator
+  if(!batch.nPending) return;
 
-  ensureCommandCapacity(200 + SQL_TABLE_NAME_LEN + getSampleCount(u) * len);
+  qsort(batch.pending, batch.nPending, sizeof(PendingRow), cmpPendingRows);
 
-  /* Now insert the data */
-  next += sprintf(next, "INSERT INTO " TABLE_NAME_PATTERN " VALUES(", t->index);
-  next += strftime(next, 100, SQL_DATE_FORMAT, gmtime(&u->grabTime));
-  next += sprintf(next, SQL_SEP "'%d'", (int) (u->grabTime - u->updateTime));
-  next = appendValues(u, next);
-  sprintf(next, ");");
+  for(i = 1; i <= batch.nPending; i++) if(i == batch.nPending || batch.pending[i].table != batch.pending[from].table) {
+    sqlFlushTableRows(&batch.pending[from], i - from);
+    from = i;
+  }
 
-  // Add values in an atomic block...
-  if(!sqlBegin()) return ERROR_RETURN;
+  for(i = 0; i < batch.nPending; i++) destroyVariable(batch.pending[i].var);
 
-  if(!sqlExecSimple(cmd)) goto cleanup; // @suppress("Goto statement used")
+  batch.nPending = 0;
 
-  if(isMetaUpdate(u, t)) if(sqlAddMeta(u, t) != SUCCESS_RETURN) goto cleanup; // @suppress("Goto statement used")
+  // Rows inserted one by one are already accounted for.
+  batch.rows = rows;
+  batch.bytes = bytes;
+}
 
-  if(!sqlCommit()) return ERROR_RETURN;
 
-  return SUCCESS_RETURN;
+/**
+ * Adds the data from a variable to the current batch, creating a new table if necessary for new
+ * variables. The data is inserted when the batch is committed, grouped by table. The variable is
+ * destroyed after it has been processed.
+ *
+ * \param u     Pointer to the variable
+ * \return      SUCCESS_RETURN (0) if successful, or else ERROR_RETURN (-1).
+ *
+ * \sa sqlCommitBatch()
+ */
+static int sqlQueueValues(Variable *u) {
+  TableDescriptor *t = sqlPrepareTable(u);
 
-  // -------------------------------------------------------------------------------
-  cleanup:
+  if(!t) {
+    destroyVariable(u);
+    return ERROR_RETURN;
+  }
 
-  sqlRollback();
+  // Schema changes commit the open batch, so we may have to start a new one.
+  if(!batch.isOpen) if(!sqlBeginBatch(u->grabTime)) {
+    destroyVariable(u);
+    return ERROR_RETURN;
+  }
 
-  return ERROR_RETURN;
+  if(batch.nPending >= batch.pendingCapacity) {
+    batch.pendingCapacity = batch.pendingCapacity ? (batch.pendingCapacity << 1) : MIN_CMD_SIZE;
+    batch.pending = (PendingRow *) realloc(batch.pending, batch.pendingCapacity * sizeof(PendingRow));
+    x_check_alloc(batch.pending);
+  }
+
+  batch.pending[batch.nPending].var = u;
+  batch.pending[batch.nPending].table = t;
+  batch.pending[batch.nPending].seq = batch.nPending;
+  batch.nPending++;
+
+  batch.rows++;
+  batch.bytes += getBinaryRowSize(u, t);
+
+  return SUCCESS_RETURN;
 }
 
 
-static boolean sqlDeleteVar(const char *id) {
-  int tid, n = 0;
+/**
+ * Deletes the data and metadata tables of a variable from the SQL DB, and removes the variable from the
+ * master table and from the local cache.
+ *
+ * \param id      The SMA-X variable ID.
+ * \param tid     The table index of the variable in the master table.
+ *
+ * \return        TRUE (1) if anything was deleted, or else FALSE (0).
+ */
+static boolean sqlDeleteVar(const char *id, int tid) {
+  char *next;
+  int n = 0;
 
   if(!id) return FALSE;
 
-  ensureCommandCapacity(100 + SQL_TABLE_NAME_LEN + sizeof(VARNAME_ID) + strlen(id));
+  ensureCommandCapacity(100 + sizeof(MASTER_TABLE) + sizeof(VARNAME_ID) + 2 * strlen(id));
+
+  // The schema cache must not validate the deleted tables.
+  sqlNoteSchemaChange();
 
   // Delete variable table
-  sprintf(cmd, "DROP TABLE %s;", id);
+  sprintf(cmd, "DROP TABLE " TABLE_NAME_PATTERN ";", tid);
   if(sqlExecSimple(cmd)) n++;
 
   // Delete metadata
-  if(sscanf(id, TABLE_NAME_PATTERN, &tid) < 1) fprintf(stderr, "WARNING! Invalid " VARNAME_ID " = '%s'.\n", id);
-  else {
-    sprintf(cmd, "DROP TABLE " META_NAME_PATTERN ";", tid);
-    if(sqlExecSimple(cmd)) n++;
-  }
+  sprintf(cmd, "DROP TABLE " META_NAME_PATTERN ";", tid);
+  if(sqlExecSimple(cmd)) n++;
 
   // Remove variable from titles
-  sprintf(cmd, "DELETE FROM " MASTER_TABLE " WHERE " VARNAME_ID " = %s;", id);
+  next = cmd + sprintf(cmd, "DELETE FROM " MASTER_TABLE " WHERE " VARNAME_ID " = ");
+  next = printSQLString(id, strlen(id), next);
+  strcpy(next, ";");
   if(sqlExecSimple(cmd)) n++;
 
+  // And from the local cache
+  if(lookup) forgetTableDescriptor(id);
+
   return n > 0;
 }
 
@@ -1570,8 +4950,8 @@ int deleteVars(const char *pattern) {
     return -1;
   }
 
-  // Get all existing titles, and cache them
-  success = sqlExec("SELECT name FROM " MASTER_TABLE ";", &tables);
+  // Get all existing titles, with their table indices
+  success = sqlExec("SELECT " VARNAME_ID ", tid FROM " MASTER_TABLE ";", &tables);
 
   if (!success) {
     fprintf(stderr, "ERROR! initialize: " MASTER_TABLE " query failed: %s\n", PQerrorMessage(sql_db));
@@ -1585,13 +4965,21 @@ int deleteVars(const char *pattern) {
 
   for (i = 0; i < nTitles; i++) {
     char *id = PQgetvalue(tables, i, 0);
+    int tid;
 
     if(!id) {
       fprintf(stderr, "WARNING! NULL id in SQL entry.\n");
       continue;
     }
 
-    if(fnmatch(pattern, id, 0)) if(sqlDeleteVar(id)) n++;
+    if(fnmatch(pattern, id, 0) != 0) continue;
+
+    if(sscanf(PQgetvalue(tables, i, 1), "%d", &tid) < 1) {
+      fprintf(stderr, "WARNING! Invalid tid for " VARNAME_ID " = '%s'.\n", id);
+      continue;
+    }
+
+    if(sqlDeleteVar(id, tid)) n++;
   }
 
   PQclear(tables);
@@ -18,12 +18,16 @@
 #include <time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <fnmatch.h>
 
 #if USE_SYSTEMD
 #  include <systemd/sd-daemon.h>
 #endif
 
 #include "smax-postgres.h"
+#include "hash-map.h"
+#include "arena.h"
+#include "intern.h"
 #include "redisx.h"
 #include "smax.h"
 
@@ -35,14 +39,56 @@
 #define CONNECT_ATTEMPTS        20          ///< Total number of reconnection attempts when initializing.
 #define REDIS_SCAN_COUNT        100         ///< Work-load count to use for Redis SCAN-type commands.
 
-#define UPDATE_TIMEOUT          10000       ///< (ms) Timeout value for gathering queued SMA-X variables
+#define UPDATE_TIMEOUT          10000       ///< (ms) Socket timeout for pulling SMA-X variables
+#define DIRTY_SET_CAPACITY      1024        ///< Initial capacity of the set of variables with notified changes
+#define LUA_SCAN_COUNT          1000        ///< Number of timestamps the Lua script checks per call
+#define UNITS_CAPACITY          4096        ///< Initial capacity of the cache of physical units
+#define ARENA_BLOCK_SIZE        (256 * 1024) ///< (bytes) Size of the memory blocks of the per-update arenas
+#define STATES_CAPACITY         65536       ///< Initial capacity of the table of per-variable collector states
+#define TIMESTAMP_LEN           32          ///< Maximum length of the raw SMA-X timestamps kept for variables
+#define TABLES_CAPACITY         1024        ///< Initial capacity of the map of SMA-X tables in an update
+#define PULL_CHUNK_SIZE         1000        ///< Maximum number of variables to pull per round-trip of pipelined requests
+
+/// Lua script that returns the next HSCAN cursor, followed by the field / timestamp pairs of a chunk of a
+/// hash table, which match a pattern, and whose timestamps are no earlier than a cutoff time.
+/// KEYS[1]: hash table, ARGV[1]: cursor, ARGV[2]: cutoff time, ARGV[3]: field pattern, ARGV[4]: count
+#define TIMESTAMP_SCAN_SCRIPT \
+  "local scan = redis.call('HSCAN', KEYS[1], ARGV[1], 'MATCH', ARGV[3], 'COUNT', ARGV[4])\n" \
+  "local cutoff = tonumber(ARGV[2])\n" \
+  "local entries = scan[2]\n" \
+  "local result = { scan[1] }\n" \
+  "for i = 1, #entries, 2 do\n" \
+  "  local t = tonumber(entries[i + 1])\n" \
+  "  if t and t >= cutoff then\n" \
+  "    result[#result + 1] = entries[i]\n" \
+  "    result[#result + 1] = entries[i + 1]\n" \
+  "  end\n" \
+  "end\n" \
+  "return result\n"
+
+/**
+ * The persistent collector state of an SMA-X variable, which is kept between updates, so that the per-variable
+ * work that does not change from one update to the next is done only once.
+ */
+typedef struct {
+  const InternedId *id;           ///< The interned ID of the variable
+  char *table;                    ///< The SMA-X hash table containing the variable (split from the ID)
+  const char *key;                ///< The field name of the variable in its table, or NULL if the ID is invalid.
+  const logger_properties *props; ///< The logging properties of the variable
+  char timestamp[TIMESTAMP_LEN];  ///< The raw SMA-X timestamp last seen by a scan ("" if unknown).
+} VarState;
+
 
 /**
  * An SMA-X variable update link, including metadata (for timestamp information).
  */
 typedef struct Update {
   Variable *var;        ///< The variable data that will be queued for inserting into engdb
+  VarState *state;      ///< The persistent collector state of the variable
+  const char *table;    ///< The SMA-X hash table containing the variable (from the variable's state)
+  const logger_properties *props; ///< The logging properties of the variable (from the variable's state)
   XMeta meta;           ///< container in which to pull SMA-X metadata for this variable.
+  boolean isUnitPulled; ///< Whether the physical unit is pulled from SMA-X along with the data (not cached).
   struct Update *next;  ///< Link to the next update in a list.
 } Update;
 
@@ -53,16 +99,60 @@ typedef struct Update {
 typedef struct {
   char *pattern;        ///< The keyword pattern of the Redis hash tables containing data for this group
   double lastUpdate;    ///< (s) Server timestamp when data was last grabbed for this group.
+  boolean isResync;     ///< {dirtyMutex} Whether update notifications may have been missed for this group.
+  time_t unitsRefreshed; ///< (s) UNIX time when the physical units were last refreshed for this group.
+  char *name;           ///< Name of the group (for reporting)
+  int updateInterval;   ///< (s) Interval of incremental updates, or -1 for snapshots only.
+  int snapshotInterval; ///< (s) Interval of snapshots, or -1 if no periodic snapshots.
+  int priority;         ///< Groups of higher priority are grabbed first when due at the same time.
+  time_t nextGrab;      ///< (s) UNIX time of the next scheduled grab for this group.
 } VarGroup;
 
 
-static VarGroup allVars = { "*", 0.0 };            ///< All SMA-X variables
+static VarGroup **varGroups;      ///< NULL-terminated array of variable groups, in order of decreasing priority
+
 
-static VarGroup *varGroups[] = { &allVars, NULL };
+/**
+ * A grabber thread, which pulls the data of its share of the changed variables from SMA-X, using its own Redis
+ * connection.
+ */
+typedef struct {
+  Redis *redis;         ///< The grabber's own connection to the Redis server of SMA-X
+  Update *list;         ///< {poolMutex} Variables to pull in the current update, or NULL if idle.
+  time_t grabTime;      ///< (s) UNIX time when data was to be grabbed in the current update.
+  int submitted;        ///< {poolMutex} Number of variables submitted in the last update.
+  int status;           ///< {poolMutex} X_SUCCESS (0) or else the error from the last update.
+  pthread_t tid;        ///< The grabber thread
+} GrabWorker;
+
+static GrabWorker *workers;       ///< Pool of grabber threads
+static int nWorkers;              ///< Number of grabber threads in the pool
+static int busyWorkers;           ///< {poolMutex} Number of grabbers still pulling data for the current update
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER; ///< mutex for dispatching work to the grabbers
+static pthread_cond_t workCond = PTHREAD_COND_INITIALIZER;    ///< signals new work for the grabbers
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;    ///< signals that a grabber completed its work
 
 static pthread_t grabberPID;
 
+static HashMap *dirty;                                          ///< Variables with notified changes
+static pthread_mutex_t dirtyMutex = PTHREAD_MUTEX_INITIALIZER;  ///< mutex for accessing notified changes
+
+static char *scanScriptSHA;                                     ///< SHA1 of the loaded timestamp scan script, or NULL
+
+static VarState **states;         ///< Per-variable collector states by interned ID index. Accessed by the grabber thread only
+                                  ///< (and by the grab workers, for their own variables, while it waits for them).
+static int nStates;               ///< Capacity of the per-variable collector states
+
+static HashMap *units;                                          ///< Cached physical units by variable ID ("" if none).
+static pthread_mutex_t unitsMutex = PTHREAD_MUTEX_INITIALIZER;  ///< mutex for accessing the cached units
+
 static void *GrabberThread(void *arg);
+static int StartChangeCapture();
+static int LoadScanScript();
+static void InitGroups();
+static void CacheUnit(const char *id, const char *unit);
+static int StartWorkers();
 
 /**
  * Initializes the SMA-X collector. It connects to SMA-X and starts a grabber
@@ -102,6 +192,18 @@ int initCollector() {
   if(warned) fprintf(stderr, "INFO! Connected to SMA-X.\n");
   dprintf("initSMAX(): Connected to SMA-X.\n");
 
+  InitGroups();
+
+  if(getChangeCapture() == CAPTURE_NOTIFY) if(StartChangeCapture() != X_SUCCESS) {
+    fprintf(stderr, "WARNING! Could not subscribe to SMA-X update notifications. Will scan for changes instead.\n");
+  }
+
+  if(getChangeCapture() == CAPTURE_LUA) if(LoadScanScript() != X_SUCCESS) {
+    fprintf(stderr, "WARNING! Could not load Lua script for selecting changes. Will scan for changes instead.\n");
+  }
+
+  if(StartWorkers() != X_SUCCESS) return ERROR_RETURN;
+
   if(pthread_create(&grabberPID, NULL, GrabberThread, NULL) < 0) {
     perror("ERROR! initSMAXGrabber()");
     return ERROR_RETURN;
@@ -122,14 +224,33 @@ void destroyVariable(Variable *u) {
   if(!u) return;
 
   f = &u->field;
-  if(f->name) free(f->name);
   if(f->value) free(f->value);
-  if(u->id) free(u->id);
+  if(u->unit) free(u->unit);
+
+  if(u->arena) {
+    // The variable and its field name are freed along with the arena, once all its variables are gone.
+    arenaRelease(u->arena);
+    return;
+  }
+
+  // The ID is interned, and is never freed.
+  if(f->name) free(f->name);
 
   free(u);
 }
 
 
+/**
+ * Converts the serialized SMA-X values of a variable to binary, if they have not been converted yet.
+ *
+ * \param u     Pointer to the variable.
+ */
+void deserializeVariable(Variable *u) {
+  if(!u) return;
+  if(u->field.isSerialized) smax2xField(&u->field);
+}
+
+
 /**
  * Returns the decimal time between to precision timestamps.
  *
@@ -148,15 +269,15 @@ static double GetDiffTime(const struct timespec *start, const struct timespec *e
 
 
 /**
- * Destroys an update structure, freeing up all its resources.
+ * Destroys an update structure, freeing up all its resources. The structure itself is in the arena of the
+ * update cycle, and is freed along with it.
  *
  * @param u     Pointer to the update structure to destroy.
  */
 static void DestroyUpdate(Update *u) {
   if(!u) return;
   if(u->var) destroyVariable(u->var);
-  free(u);
-  return;
+  u->var = NULL;
 }
 
 
@@ -178,6 +299,30 @@ static void DestroyEntries(RedisEntry *entries, int n) {
 }
 
 
+/**
+ * Checks if serialized SMA-X values of the given type are passed to the SQL writer as text, without
+ * converting them to binary.
+ *
+ * @param type    The SMA-X storage type of the values
+ * @return        TRUE (1) if values of the type are passed through as text, or else FALSE (0).
+ */
+static boolean isPassThrough(XType type) {
+  if(!isTextPassThrough()) return FALSE;
+
+  switch(type) {
+    case X_BYTE:
+    case X_SHORT:
+    case X_INT:
+    case X_LONG:
+    case X_FLOAT:
+    case X_DOUBLE:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+
 /**
  * Submits an individual variable for inserting into the time-series database.
  *
@@ -208,12 +353,15 @@ static boolean SubmitUpdate(Update *u) {
   m = &u->meta;
   if(m->storeType == X_STRUCT) return FALSE;
 
-  p = getLogProperties(v->id);
+  p = u->props ? u->props : getLogProperties(v->id);
   if(p) {
     v->sampling = p->sampling;
     force = p->force;
   }
 
+  v->force = force;
+  if(p) v->coalesce = p->coalesce;
+
   f->isSerialized = TRUE;
   f->type = m->storeType;
   f->ndim = m->storeDim;
@@ -240,8 +388,8 @@ static boolean SubmitUpdate(Update *u) {
 
   dprintf("UPDATE %s: force %d, sampling = %d, size = %d, time = %ld\n", v->id, force, p->sampling, getSampleCount(v) * xElementSizeOf(v->field.type), v->grabTime);
 
-  // Convert from serialized to binary
-  smax2xField(f);
+  // Convert from serialized to binary, unless the SQL writer takes the values as text.
+  if(!isPassThrough(f->type)) smax2xField(f);
 
   insertQueue(u->var);
 
@@ -257,10 +405,11 @@ static boolean SubmitUpdate(Update *u) {
  * and will be pushed to the time-series database as soon as possible.
  *
  * @param list          The list of variables to update
+ * @param end           The element of the list, before which to stop (exclusive), or NULL to submit the entire list.
  * @param grabTime      Time when data was grabbed (or queued).
  * @return  the number of variables submitted.
  */
-static int SubmitList(Update *list, const time_t grabTime) {
+static int SubmitList(Update *list, const Update *end, const time_t grabTime) {
   Update *u;
   int n = 0;
 
@@ -269,17 +418,17 @@ static int SubmitList(Update *list, const time_t grabTime) {
     return -1;
   }
 
-  for(u = list; u != NULL; u = u->next) {
+  for(u = list; u != end; u = u->next) {
     Variable *v = u->var;
 
     v->grabTime = grabTime;
     v->updateTime = u->meta.timestamp.tv_sec;
 
+    if(u->isUnitPulled) CacheUnit(v->id, v->unit);
+
     if(SubmitUpdate(u)) n++;
   }
 
-  dprintf("Submitted updates for %d variables.\n", n);
-
   return n;
 }
 
@@ -295,311 +444,1367 @@ static void DestroyList(Update *list) {
 
 
 /**
- * Queues an SMA-X variable for an asynchronous time-series database update
+ * Returns the persistent collector state of an SMA-X variable, creating it if necessary.
+ *
+ * @param id      The full ID of the SMA-X variable.
+ * @return        The collector state of the variable. Its key is NULL if the ID is not a valid table:key ID.
+ */
+static VarState *GetState(const char *id) {
+  const InternedId *iid = internId(id);
+  VarState *st;
+  char *key = NULL;
+
+  if(iid->index >= nStates) {
+    int n = nStates ? nStates : STATES_CAPACITY;
+
+    while(n <= iid->index) n <<= 1;
+
+    states = (VarState **) realloc(states, n * sizeof(VarState *));
+    if(!states) {
+      perror("GetState(): grow states");
+      exit(ERROR_EXIT);
+    }
+
+    memset(&states[nStates], 0, (n - nStates) * sizeof(VarState *));
+    nStates = n;
+  }
+
+  st = states[iid->index];
+  if(st) return st;
+
+  st = (VarState *) calloc(1, sizeof(VarState));
+  if(!st) {
+    perror("GetState(): alloc state");
+    exit(ERROR_EXIT);
+  }
+
+  st->table = strdup(id);
+  if(xSplitID(st->table, &key) == X_SUCCESS) st->key = key;
+  else fprintf(stderr, "WARNING! not a table:key id: %s\n", id);
+
+  st->id = iid;
+  st->props = getLogProperties(id);
+
+  states[iid->index] = st;
+  return st;
+}
+
+
+/**
+ * Remembers the raw SMA-X timestamp last seen for a variable.
+ *
+ * @param st          The collector state of the variable
+ * @param timestamp   The raw SMA-X timestamp string.
+ */
+static void SetTimestamp(VarState *st, const char *timestamp) {
+  size_t n = strlen(timestamp);
+
+  // Timestamps that do not fit are never matched, and so the variable is always checked.
+  if(n >= sizeof(st->timestamp)) n = 0;
+
+  memcpy(st->timestamp, timestamp, n);
+  st->timestamp[n] = '\0';
+}
+
+
+/**
+ * Forgets the raw SMA-X timestamp last seen for a variable, e.g. because its data could not be pulled, so the
+ * next scan does not skip it as unchanged.
+ *
+ * @param st          The collector state of the variable
+ */
+static void ForgetTimestamp(VarState *st) {
+  st->timestamp[0] = '\0';
+}
+
+
+/**
+ * Creates an update for an SMA-X variable, whose data is to be pulled by one of the grabbers. The physical unit of
+ * the variable is taken from the cache, or else it is pulled from SMA-X along with the data.
  *
+ * @param arena         The arena of the update cycle, in which to allocate the update and the variable.
  * @param id            The full ID of the SMA-X variable.
- * @param units         Alphabetically sorted table of physical units, or NULL.
- * @param nu            Number of physical units in table.
+ * @param st            The collector state of the variable, with a valid key.
+ * @param grabTime      (s) UNIX time when data was to be grabbed.
+ * @param isUnitsFresh  Whether the units of the group were just refreshed, so that variables that are not in the
+ *                      cache have no physical unit.
  * @return              X_SUCCESS (0) if the variable is a valid leaf variable (not structure!)
  *                      and was queued for update, or else an error code (<0).
  */
-static Update *QueueForUpdate(const char *id, const RedisEntry *units, int nu, const time_t grabTime) {
-  char *table, *key = NULL;
-  int status = X_SUCCESS;
+static Update *QueueForUpdate(Arena *arena, const char *id, VarState *st, const time_t grabTime, boolean isUnitsFresh) {
+  const char *unit;
   Update *u;
   Variable *v;
 
-  if(!id) {
+  if(!id || !st) {
     errno = EINVAL;
     return NULL;
   }
 
-  u = (Update *) calloc(1, sizeof(*u));
-  if(!u) {
-    // Out of memory
-    perror("QueueForUpdate(): alloc update");
-    exit(ERROR_EXIT);
-  }
-
-  u->var = (Variable *) calloc(1, sizeof(*u->var));
-  if(!u->var) {
-    // Out of memory
-    perror("QueueForUpdate(): alloc variable");
-    exit(ERROR_EXIT);
-  }
+  u = (Update *) arenaAlloc(arena, sizeof(*u));
+  u->var = (Variable *) arenaAlloc(arena, sizeof(*u->var));
 
   v = u->var;
-  v->id = strdup(id);
+  v->arena = arena;
+  arenaRetain(arena);
+
+  v->interned = st->id;
+  v->id = (char *) st->id->name;
   v->grabTime = grabTime;
 
-  if(units) {
-    RedisEntry *unit = bsearch(id, units, nu, sizeof(RedisEntry), (__compar_fn_t) strcmp);
-    if(unit) {
-      // Move reference to variable.
-      v->unit = unit->value;
-      unit->value = NULL;
-    }
+  pthread_mutex_lock(&unitsMutex);
+  unit = units ? (const char *) hashMapGet(units, id) : NULL;
+  if(unit) {
+    if(*unit) v->unit = strdup(unit);
   }
+  else if(!isUnitsFresh) u->isUnitPulled = TRUE;
+  pthread_mutex_unlock(&unitsMutex);
 
-  table = strdup(id);
+  if(!unit && isUnitsFresh) CacheUnit(id, NULL);
 
-  if(xSplitID(table, &key) != X_SUCCESS) {
-    fprintf(stderr, "WARNING! not a table:key id: %s\n", v->id);
-    status = X_NAME_INVALID;
-  }
+  u->state = st;
+  u->table = st->table;
+  u->props = st->props;
+  v->field.name = arenaStrdup(arena, st->key);
 
-  v->field.name = xStringCopyOf(key);
-  if(!status) status = smaxQueue(table, key, X_RAW, 1, &v->field.value, &u->meta);
-  free(table);
+  return u;
+}
 
-  if(status) {
-    dprintf("! SMA-X: smaxQueue(): %s\n", smaxErrorDescription(status));
-    DestroyUpdate(u);
-    return NULL;
-  }
 
-  return u;
+/**
+ * Stores the physical unit of a variable in the cache of units.
+ *
+ * @param id      The full ID of the SMA-X variable.
+ * @param unit    The physical unit, or NULL if the variable has no unit.
+ */
+static void CacheUnit(const char *id, const char *unit) {
+  void *old = NULL;
+
+  pthread_mutex_lock(&unitsMutex);
+
+  if(!units) units = hashMapCreate(UNITS_CAPACITY);
+  if(units) if(hashMapPut(units, id, strdup(unit ? unit : ""), &old) < 0) perror("WARNING! CacheUnit()");
+
+  pthread_mutex_unlock(&unitsMutex);
+
+  if(old) free(old);
 }
 
 
 /**
- * Updates the time-series data only for the select variables that have changed since (and including) the
- * specified cutoff time.
+ * Refreshes the cached physical units for a group of variables from SMA-X. Cached units for variables outside
+ * of the group are retained, while those of the group are replaced by the units currently in SMA-X.
  *
- * @param pattern       the SMA-X table name pattern of the group of variables to check
- * @param from          (s) Decimal SMA-X server time after which to select updates.
+ * @param group         The variable group
+ * @param grabTime      (s) UNIX time when data was to be grabbed.
  * @return              X_SUCCESS (0) if successful, or else an error code (<0)
  */
-static int UpdateChanged(const char *pattern, double from, const time_t grabTime) {
-  int i, n, nu = 0, status;
-  RedisEntry *entries;
-  RedisEntry *units;
+static int RefreshUnits(VarGroup *group, const time_t grabTime) {
   struct timespec start, end;
-  Update *list = NULL;
-  XSyncPoint *s;
-
-  if(!pattern) {
-    errno = EINVAL;
-    return -1;
-  }
+  HashMap *old;
+  RedisEntry *entries;
+  const char *id;
+  void *unit;
+  int i, n, pos = 0;
 
   clock_gettime(CLOCK_REALTIME, &start);
 
-  dprintf("Checking for changes in '%s' (dt = %.3f s)\n", pattern, from - (start.tv_sec + 1e-9 * start.tv_nsec));
-
-  entries = redisxScanTable(smaxGetRedis(), "<timestamps>", pattern, &n);
+  entries = redisxScanTable(smaxGetRedis(), "<units>", group->pattern, &n);
   if(n < 0) {
-    dprintf("! SMA-X: redisxScanTable(): %s\n", smaxErrorDescription(n));
+    dprintf("! SMA-X: redisxScanTable(<units>): %s\n", smaxErrorDescription(n));
     DestroyEntries(entries, n);
     return n;
   }
 
-  if(n == 0) {
-    dprintf("! No matching timestamps for '%s'\n", pattern);
-    if(entries) free(entries);
-    return 0;
-  }
-
-  units = redisxScanTable(smaxGetRedis(), "<units>", pattern, &nu);
-
-  dprintf("Got %d timestamps for '%s' to check...\n", n, pattern);
-
-  for(i=0; i<n; i++) {
-    const RedisEntry *e = &entries[i];
-    double t;
-
-    if(*e->key == '_') continue;
-    if(*e->key == '<') continue;
-
-    errno = 0;
-    t = strtod(e->value, NULL);
-    if(errno) {
-      dprintf("! Bad timestamp: [%s]\n", e->value);
-      continue;
-    }
-
-    if(t >= from) if(isLogging(e->key, t)) {
-      Update *u = QueueForUpdate(e->key, units, nu, grabTime);
-      if(!u) continue;
+  pthread_mutex_lock(&unitsMutex);
 
-      u->next = list;
-      list = u;
-    }
+  old = units;
+  units = hashMapCreate(n + (old ? hashMapSize(old) : 0) + UNITS_CAPACITY);
+  if(!units) {
+    perror("RefreshUnits(): create cache");
+    exit(ERROR_EXIT);
   }
 
-  DestroyEntries(entries, n);
-  DestroyEntries(units, nu);
-
-  if(!list) {
-    dprintf("! No changes found.\n");
-    return 0;
+  // Retain the cached units of variables outside of the group.
+  while((pos = hashMapNext(old, pos, &id, &unit)) >= 0) if(fnmatch(group->pattern, id, 0) != 0) {
+    hashMapPut(units, id, unit, NULL);
+    hashMapPut(old, id, NULL, NULL);
   }
+  hashMapDestroy(old, free);
 
-  s = smaxCreateSyncPoint();
-  if(!s) {
-    perror("UpdateChanged(): create sync point.\n");
-    exit(ERROR_EXIT);
-  }
+  pthread_mutex_unlock(&unitsMutex);
 
-  status = smaxSync(s, UPDATE_TIMEOUT);
+  for(i = 0; i < n; i++) CacheUnit(entries[i].key, entries[i].value);
 
-  if(!status) n = SubmitList(list, grabTime);
-  else dprintf("! SMA-X: smaxSync() failed: %s\n", smaxErrorDescription(status));
+  DestroyEntries(entries, n);
 
-  smaxDestroySyncPoint(s);
-  DestroyList(list);
+  group->unitsRefreshed = grabTime;
 
   clock_gettime(CLOCK_REALTIME, &end);
-  printf(" -- Update for '%s' (%d): %.3f seconds (%s)\n", pattern, n, GetDiffTime(&start, &end), smaxErrorDescription(status));
+  dprintf("Refreshed %d units for '%s': %.3f seconds\n", n, group->pattern, GetDiffTime(&start, &end));
 
-  return status;
+  return X_SUCCESS;
 }
 
 
 /**
- * Snapshorts all SMA-X variables with the matching keyword pattern
+ * Loads the Lua script, which selects the changed timestamps on the Redis server, so that incremental
+ * updates do not have to transfer all SMA-X timestamps.
  *
- * @param pattern       the Redis keyword pattern selecting what data is mined from SMA-X
- * @param grabTime      (s) UNIX time when data was to be grabbed.
- * @param useGrabTime   Whether to use the grabbing time as the timestamp.
- * @return              X_SUCCESS (0) if the update was successful, or else an appropriate error (<0)
+ * @return    X_SUCCESS (0) if successful, or else an error code (<0).
  */
-static int Snapshot(const char *pattern, time_t grabTime) {
-  int status;
+static int LoadScanScript() {
+  char *sha1 = NULL;
+  int status = redisxLoadScript(smaxGetRedis(), TIMESTAMP_SCAN_SCRIPT, &sha1);
 
-  if(!pattern) {
-    errno = EINVAL;
-    return -1;
+  if(status) {
+    if(sha1) free(sha1);
+    return status;
   }
 
-# if USE_SYSTEMD
-  setSDState("SNAPSHOT");
-# endif
-
-  status = UpdateChanged(pattern, 0.0, grabTime);
+  if(scanScriptSHA) free(scanScriptSHA);
+  scanScriptSHA = sha1;
 
-# if USE_SYSTEMD
-  setSDState(IDLE_STATE);
-# endif
+  dprintf("Loaded timestamp scan script: %s\n", sha1);
 
-  return status;
+  return X_SUCCESS;
 }
 
 
 /**
- * Sleeps to the next round multiple of the number of seconds specified.
+ * Returns the SMA-X timestamps that match a pattern, and which are no earlier than a cutoff time, using the
+ * Lua script on the Redis server. The script walks the timestamps table in chunks, so it does not block
+ * the Redis server for long, and returns only the matching timestamps.
+ *
+ * @param pattern     The variable ID pattern
+ * @param from        (s) Decimal SMA-X server time, from which to select timestamps.
+ * @param[out] n      Where to return the number of timestamps selected, or else an error code (<0).
+ * @return            An array of variable IDs and their timestamps (the same as redisxScanTable() returns),
+ *                    or NULL if there are none, or if there was an error.
  *
- * @param seconds       (s) The maximum sleep time
- * @return              the integer UNIX time of the targeted wakeup.
+ * @sa LoadScanScript()
  */
-static time_t SleepToRound(int seconds) {
-  struct timespec now, dt, rem = {0};
-  time_t target;
+static RedisEntry *ScanChanged(const char *pattern, double from, int *n) {
+  RedisEntry *entries = NULL;
+  char cursor[64] = "0", cutoff[40], count[20];
+  int capacity = 0, status = X_SUCCESS;
+  boolean isReloaded = FALSE;
 
-  clock_gettime(CLOCK_REALTIME, &now);
+  *n = 0;
 
-  dt.tv_sec = seconds - (now.tv_sec % seconds);
-  if(now.tv_nsec) {
-    dt.tv_sec--;
-    dt.tv_nsec = 1000000000 - now.tv_nsec;
-  }
-  else dt.tv_nsec = 0;
+  sprintf(cutoff, "%.6f", from);
+  sprintf(count, "%d", LUA_SCAN_COUNT);
 
-  target = now.tv_sec + dt.tv_sec;
+  while(TRUE) {
+    char *args[] = { "EVALSHA", scanScriptSHA, "1", "<timestamps>", cursor, cutoff, (char *) pattern, count };
+    RESP *reply, **items;
+    int i;
 
-  dprintf("sleeping for %ld.%09ld s\n", dt.tv_sec, dt.tv_nsec);
+    reply = redisxArrayRequest(smaxGetRedis(), args, NULL, 8, &status);
 
-  while(nanosleep(&dt, &rem)) {
-    perror("WARNING! nanosleep");
-    if(errno != EINTR) exit(SYSERR_RTN);
-    dt = rem;
+    if(!status) if(reply) if(reply->type == RESP_ERROR && !isReloaded) if(strstr((char *) reply->value, "NOSCRIPT")) {
+      // The Redis server has been restarted, and no longer has our script.
+      redisxDestroyRESP(reply);
+      isReloaded = TRUE;
+      status = LoadScanScript();
+      if(status) break;
+      continue;
+    }
+
+    if(!status) if(!reply || reply->type != RESP_ARRAY || reply->n < 1) status = X_PARSE_ERROR;
+    if(status) {
+      redisxDestroyRESP(reply);
+      break;
+    }
+
+    items = (RESP **) reply->value;
+
+    if(items[0]->type != RESP_BULK_STRING || !items[0]->value || items[0]->n >= (int) sizeof(cursor)) {
+      redisxDestroyRESP(reply);
+      status = X_PARSE_ERROR;
+      break;
+    }
+
+    memcpy(cursor, items[0]->value, items[0]->n);
+    cursor[items[0]->n] = '\0';
+
+    if(*n + reply->n / 2 > capacity) {
+      capacity = (*n + reply->n / 2) << 1;
+      entries = (RedisEntry *) realloc(entries, capacity * sizeof(RedisEntry));
+      if(!entries) {
+        perror("ScanChanged(): alloc entries");
+        exit(ERROR_EXIT);
+      }
+    }
+
+    for(i = 1; i + 1 < reply->n; i += 2) {
+      RedisEntry *e = &entries[(*n)++];
+
+      e->key = (char *) items[i]->value;
+      e->value = (char *) items[i + 1]->value;
+      e->length = items[i + 1]->n;
+
+      // Take ownership of the strings
+      items[i]->value = NULL;
+      items[i + 1]->value = NULL;
+    }
+
+    redisxDestroyRESP(reply);
+
+    // A cursor of 0 means the scan is complete.
+    if(strcmp(cursor, "0") == 0) break;
   }
 
-  return target;
+  if(status) {
+    DestroyEntries(entries, *n);
+    *n = status;
+    return NULL;
+  }
+
+  return entries;
 }
 
 
 /**
- * Returns the SMA-X server time as decimal seconds since 1970.
+ * Returns the end of the batch of variables starting at the specified element of a list, which is pulled from
+ * SMA-X with a single request per hash table. A batch consists of consecutive variables in the same SMA-X table,
+ * up to PULL_CHUNK_SIZE of them.
  *
- * @return  (s) The decimal SMA-X server time (UNIX time), as queried by TIME on Redis
+ * @param u         The first variable in the batch
+ * @param[out] n    Pointer to where to return the number of variables in the batch.
+ * @return          The first variable after the batch (exclusive), or NULL if the batch extends to the end of
+ *                  the list.
  */
-static double GetServerTime() {
-  struct timespec ts = {};
-  double t;
-
-  smaxGetServerTime(&ts);
-  t = ts.tv_sec + 1e-9 * ts.tv_nsec;
+static Update *GetBatchEnd(Update *u, int *n) {
+  const char *table = u->table;
 
-  dprintf("SMA-X Time: %.6f\n", t);
-  return t;
+  for(*n = 0; u != NULL && *n < PULL_CHUNK_SIZE && strcmp(u->table, table) == 0; u = u->next) (*n)++;
+  return u;
 }
 
 
 /**
- * Grabs data from a group of SMA-X variables and queues them for insertion into the time-series database.
+ * Sends an HMGET request for a field of each variable in a batch.
  *
- * @param group             The variable group to update
- * @param grabTime          (s) UNIX time when data was to be grabbed.
- * @param isSnapshot        Whether we want a complete snapshot. If FALSE, the function may still do a snapshot
- *                          if there has not been a successful snapshot taken already. Otherwise it will just
- *                          perform an incremental update of the variable that have changed since last time.
- * @return X_SUCCESS (0) or else en error code (<0)
+ * @param cl          The locked Redis client
+ * @param table       The Redis hash table to query, or NULL to query the SMA-X table of the variables.
+ * @param from        The first variable in the batch
+ * @param end         The first variable after the batch (exclusive)
+ * @param unitsOnly   Whether to include only the variables whose physical units are pulled.
+ * @return            X_SUCCESS (0) if successful, or else an error code (<0).
  */
-static int Grab(VarGroup *group, const time_t grabTime, boolean isSnapshot) {
-  double t = GetServerTime();
-  int status;
+static int SendFields(RedisClient *cl, const char *table, const Update *from, const Update *end, boolean unitsOnly) {
+  char *args[PULL_CHUNK_SIZE + 2];
+  const Update *u;
+  int n = 0;
 
-  if(!group) {
-    errno = EINVAL;
-    return -1;
-  }
+  args[n++] = "HMGET";
+  args[n++] = (char *) (table ? table : from->table);
 
-  if(group->lastUpdate <= 0 || isSnapshot) {
-    status = Snapshot(group->pattern, grabTime);
-    if(status) printf("WARNING! Snapshot for '%s' failed: %s\n", group->pattern, smaxErrorDescription(status));
+  for(u = from; u != end; u = u->next) {
+    if(unitsOnly && !u->isUnitPulled) continue;
+    args[n++] = table ? u->var->id : u->var->field.name;
   }
-  else {
-# if USE_SYSTEMD
-  setSDState("UPDATE");
-# endif
 
-  status = UpdateChanged(group->pattern, group->lastUpdate, grabTime);
+  return redisxSendArrayRequestAsync(cl, args, NULL, n);
+}
 
-# if USE_SYSTEMD
-  setSDState(IDLE_STATE);
-# endif
 
-    if(status) printf("WARNING! Incremental update for '%s' failed: %s\n", group->pattern, smaxErrorDescription(status));
-  }
+/**
+ * Sends the pipelined requests for the data and metadata of a batch of variables in the same SMA-X table, and
+ * for the physical units of those whose units are not cached. It amounts to 4 or 5 requests for the entire batch,
+ * rather than for each variable.
+ *
+ * @param cl        The locked Redis client
+ * @param from      The first variable in the batch
+ * @param end       The first variable after the batch (exclusive)
+ * @param nUnits    The number of variables in the batch, whose physical units are pulled.
+ * @return          X_SUCCESS (0) if successful, or else an error code (<0).
+ *
+ * @sa ReadBatch()
+ */
+static int SendBatch(RedisClient *cl, const Update *from, const Update *end, int nUnits) {
+  int status;
 
-  if(!status) group->lastUpdate = t;
+  status = SendFields(cl, NULL, from, end, FALSE);
+  if(!status) status = SendFields(cl, "<types>", from, end, FALSE);
+  if(!status) status = SendFields(cl, "<dims>", from, end, FALSE);
+  if(!status) status = SendFields(cl, "<timestamps>", from, end, FALSE);
+  if(!status && nUnits) status = SendFields(cl, "<units>", from, end, TRUE);
 
   return status;
 }
 
 
 /**
- * Service thead that continuously collects data from SMA-X and queues them for insertion ino the time-series database.
- * It does a differential update every UPDATE_INTERVAL or a full snapshot every SNAPSHOT_INTERVAL.
+ * Returns the number of variables in a batch whose physical units are pulled from SMA-X (i.e. not cached).
  *
- * @param arg       Unused.
+ * @param from      The first variable in the batch
+ * @param end       The first variable after the batch (exclusive)
+ * @return          The number of variables whose units are pulled.
  */
-static void *GrabberThread(void *arg) {
-  (void) arg; // unused
+static int CountPulledUnits(const Update *from, const Update *end) {
+  int n = 0;
+  for(; from != end; from = from->next) if(from->isUnitPulled) n++;
+  return n;
+}
 
-  pthread_detach(pthread_self());
+
+/**
+ * Reads the reply to a pipelined HMGET request.
+ *
+ * @param cl              The locked Redis client
+ * @param n               The expected number of values
+ * @param[in,out] status  Pointer to the current status, to which an error (<0) is returned if the reply could not
+ *                        be read. Nothing is read if it indicates an error already.
+ * @return                The array reply, or NULL if no array of the expected size was received.
+ */
+static RESP *ReadArray(RedisClient *cl, int n, int *status) {
+  RESP *r;
+  int err = X_SUCCESS;
+
+  if(*status) return NULL;
+
+  r = redisxReadReplyAsync(cl, &err);
+  if(!r) {
+    *status = err ? err : X_NO_SERVICE;
+    return NULL;
+  }
+
+  if(redisxCheckRESP(r, RESP_ARRAY, n) != X_SUCCESS) {
+    redisxDestroyRESP(r);
+    return NULL;
+  }
+
+  return r;
+}
+
+
+/**
+ * Takes a string value from an array reply. The string is removed from the reply, and passed to the caller.
+ *
+ * @param array     The array reply, or NULL.
+ * @param i         The index of the component
+ * @return          The string value of the component (which the caller should free after use), or NULL if the
+ *                  component is not a string (e.g. because the field does not exist).
+ */
+static char *TakeString(RESP *array, int i) {
+  RESP *e;
+  char *str;
+
+  if(!array) return NULL;
+
+  e = ((RESP **) array->value)[i];
+  if(!e || e->type != RESP_BULK_STRING || e->n < 0) return NULL;
+
+  str = (char *) e->value;
+  e->value = NULL;
+  return str;
+}
+
+
+/**
+ * Sets the SMA-X metadata of a variable from the pulled strings, which are freed after use.
+ *
+ * @param m           The metadata to set
+ * @param type        The SMA-X type string of the variable, or NULL.
+ * @param dims        The SMA-X dimension string of the variable, or NULL.
+ * @param timestamp   The SMA-X timestamp string of the variable, or NULL.
+ */
+static void SetMeta(XMeta *m, char *type, char *dims, char *timestamp) {
+  m->storeType = type ? smaxTypeForString(type) : X_RAW;
+
+  if(dims) m->storeDim = xParseDims(dims, m->storeSizes);
+  else {
+    m->storeDim = 1;
+    m->storeSizes[0] = 1;
+  }
+
+  if(timestamp) smaxParseTime(timestamp, &m->timestamp.tv_sec, &m->timestamp.tv_nsec);
+
+  if(type) free(type);
+  if(dims) free(dims);
+  if(timestamp) free(timestamp);
+}
+
+
+/**
+ * Reads the replies to the pipelined requests sent by SendBatch() for a batch of variables, and populates the
+ * variable data and metadata accordingly.
+ *
+ * @param cl        The locked Redis client
+ * @param from      The first variable in the batch
+ * @param end       The first variable after the batch (exclusive)
+ * @param n         The number of variables in the batch
+ * @param nUnits    The number of variables in the batch, whose physical units are pulled.
+ * @return          X_SUCCESS (0) if successful, or else an error code (<0).
+ *
+ * @sa SendBatch()
+ */
+static int ReadBatch(RedisClient *cl, Update *from, const Update *end, int n, int nUnits) {
+  RESP *values, *types, *dims, *timestamps, *unitValues = NULL;
+  Update *u;
+  int i, k, status = X_SUCCESS;
+
+  values = ReadArray(cl, n, &status);
+  types = ReadArray(cl, n, &status);
+  dims = ReadArray(cl, n, &status);
+  timestamps = ReadArray(cl, n, &status);
+  if(nUnits) unitValues = ReadArray(cl, nUnits, &status);
+
+  if(!status) for(u = from, i = 0, k = 0; u != end; u = u->next, i++) {
+    Variable *v = u->var;
+    char *timestamp = TakeString(timestamps, i);
+
+    // The data is submitted as pulled, so a later scan should skip the variable unless it changes again.
+    if(timestamp) SetTimestamp(u->state, timestamp);
+
+    v->field.value = TakeString(values, i);
+    SetMeta(&u->meta, TakeString(types, i), TakeString(dims, i), timestamp);
+
+    if(u->isUnitPulled) {
+      v->unit = TakeString(unitValues, k++);
+      if(v->unit && !*v->unit) {
+        free(v->unit);
+        v->unit = NULL;
+      }
+    }
+  }
+
+  redisxDestroyRESP(values);
+  redisxDestroyRESP(types);
+  redisxDestroyRESP(dims);
+  redisxDestroyRESP(timestamps);
+  redisxDestroyRESP(unitValues);
+
+  return status;
+}
+
+
+/**
+ * Sends the pipelined requests for the next chunk of batches, with up to about PULL_CHUNK_SIZE variables in total.
+ *
+ * @param cl            The locked Redis client
+ * @param[in,out] next  Pointer to the first variable to send requests for. It is advanced to the first variable
+ *                      after the chunk (or NULL if the end of the list was reached).
+ * @return              X_SUCCESS (0) if successful, or else an error code (<0).
+ */
+static int SendChunk(RedisClient *cl, Update **next) {
+  Update *u = *next;
+  int k = 0, status = X_SUCCESS;
+
+  while(u != NULL && k < PULL_CHUNK_SIZE && !status) {
+    int n;
+    Update *end = GetBatchEnd(u, &n);
+
+    status = SendBatch(cl, u, end, CountPulledUnits(u, end));
+    k += n;
+    u = end;
+  }
+
+  *next = u;
+  return status;
+}
+
+
+/**
+ * Pulls the data for a list of variables from SMA-X, with pipelined requests on the specified Redis
+ * connection, and submits the variables for insertion into the time-series database as their data arrives.
+ * Variables in the same SMA-X table, which should be adjacent in the list, are pulled together, with a single
+ * HMGET request for their values, and one for each type of metadata. The requests are sent in chunks of up to
+ * about PULL_CHUNK_SIZE variables. The requests for the next chunk are sent before reading the replies for the
+ * current one, so there is always a chunk in flight while the current one is being submitted. In case of an
+ * error, the variables that were already read are still submitted, and only the outstanding ones are lost (they
+ * keep their data, i.e. the var field of their update is not NULL).
+ *
+ * @param redis           The Redis connection to use
+ * @param list            The list of variables to pull, grouped by table.
+ * @param grabTime        (s) UNIX time when data was to be grabbed.
+ * @param[out] submitted  Pointer to where to return the number of variables submitted.
+ * @return                X_SUCCESS (0) if successful, or else an error code (<0).
+ */
+static int PullList(Redis *redis, Update *list, const time_t grabTime, int *submitted) {
+  RedisClient *cl = redisxGetClient(redis, REDISX_INTERACTIVE_CHANNEL);
+  Update *next = list;
+  int status;
+
+  *submitted = 0;
+
+  status = redisxLockConnected(cl);
+  if(status) return status;
+
+  status = SendChunk(cl, &next);
+
+  while(list && !status) {
+    Update *u = list, *end = next;
+
+    // Keep the next chunk in flight while we process this one.
+    if(next) status = SendChunk(cl, &next);
+
+    while(u != end && !status) {
+      int n;
+      Update *batchEnd = GetBatchEnd(u, &n);
+
+      status = ReadBatch(cl, u, batchEnd, n, CountPulledUnits(u, batchEnd));
+      if(!status) u = batchEnd;
+    }
+
+    if(u != list) *submitted += SubmitList(list, u, grabTime);
+    list = end;
+  }
+
+  redisxUnlockClient(cl);
+
+  return status;
+}
+
+
+/**
+ * Grabber thread, which pulls the data of the variables assigned to it from SMA-X, on its own Redis connection,
+ * and submits them for insertion into the time-series database as their data arrives.
+ *
+ * @param arg       Pointer to the GrabWorker of this thread.
+ */
+static void *GrabWorkerThread(void *arg) {
+  GrabWorker *w = (GrabWorker *) arg;
+
+  pthread_detach(pthread_self());
+
+  for(;;) {
+    Update *list;
+    int n = 0, status;
+
+    pthread_mutex_lock(&poolMutex);
+    while(!w->list) pthread_cond_wait(&workCond, &poolMutex);
+    list = w->list;
+    pthread_mutex_unlock(&poolMutex);
+
+    status = redisxIsConnected(w->redis) ? X_SUCCESS : redisxConnect(w->redis, FALSE);
+    if(!status) status = PullList(w->redis, list, w->grabTime, &n);
+
+    if(status) {
+      Update *u;
+
+      dprintf("! SMA-X: pull failed: %s\n", smaxErrorDescription(status));
+      // Replies may be out of step with the requests, so start afresh next time.
+      redisxDisconnect(w->redis);
+
+      // Variables that were not submitted must not be skipped as unchanged next time. The ones that were
+      // submitted keep their timestamps, so they are not pulled and inserted again.
+      for(u = list; u != NULL; u = u->next) if(u->var) ForgetTimestamp(u->state);
+    }
+
+    DestroyList(list);
+
+    pthread_mutex_lock(&poolMutex);
+    w->list = NULL;
+    w->submitted = n;
+    w->status = status;
+    busyWorkers--;
+    pthread_cond_signal(&doneCond);
+    pthread_mutex_unlock(&poolMutex);
+  }
+
+  return NULL; // NOT REACHED
+}
+
+
+/**
+ * Starts the pool of grabber threads, each with its own connection to the Redis server of SMA-X.
+ *
+ * @return    X_SUCCESS (0) if successful, or else an error code (<0).
+ */
+static int StartWorkers() {
+  int i;
+
+  nWorkers = getGrabThreads();
+
+  workers = (GrabWorker *) calloc(nWorkers, sizeof(GrabWorker));
+  if(!workers) {
+    perror("StartWorkers(): alloc workers");
+    exit(ERROR_EXIT);
+  }
+
+  for(i = 0; i < nWorkers; i++) {
+    GrabWorker *w = &workers[i];
+
+    w->redis = redisxInit(getSMAXServerAddress());
+    if(!w->redis) {
+      fprintf(stderr, "ERROR! Could not initialize Redis connection for grabber %d.\n", i);
+      return X_FAILURE;
+    }
+
+    redisxSetSocketTimeout(w->redis, UPDATE_TIMEOUT);
+
+    if(pthread_create(&w->tid, NULL, GrabWorkerThread, w) < 0) {
+      perror("ERROR! StartWorkers()");
+      return X_FAILURE;
+    }
+  }
+
+  dprintf("Started %d grabber thread(s).\n", nWorkers);
+
+  return X_SUCCESS;
+}
+
+
+/**
+ * Pulls the data for a list of variables from SMA-X, and submits the variables for insertion into the time-series
+ * database. The variables are grouped by SMA-X table, so that the variables of each table can be pulled together,
+ * and the tables are distributed among the grabbers by a hash of their names, and pulled in parallel. It returns
+ * after all grabbers have completed their work.
+ *
+ * @param pattern       the SMA-X table name pattern of the group of variables (for reporting)
+ * @param list          The list of variables to pull from SMA-X, or NULL.
+ * @param grabTime      (s) UNIX time when data was to be grabbed.
+ * @param start         The time when the update started (for reporting)
+ * @return              X_SUCCESS (0) if successful, or else an error code (<0)
+ */
+static int SubmitQueued(const char *pattern, Update *list, const time_t grabTime, const struct timespec *start) {
+  struct timespec end;
+  HashMap *tables;
+  const char *table;
+  void *chain;
+  int i, n = 0, pos = 0, status = X_SUCCESS;
+
+  if(!list) {
+    dprintf("! No changes found.\n");
+    return 0;
+  }
+
+  tables = hashMapCreate(TABLES_CAPACITY);
+  if(!tables) {
+    perror("SubmitQueued(): create table map");
+    exit(ERROR_EXIT);
+  }
+
+  // Chain the variables of each table together.
+  while(list) {
+    Update *u = list;
+    list = u->next;
+    u->next = (Update *) hashMapGet(tables, u->table);
+    hashMapPut(tables, u->table, u, NULL);
+  }
+
+  pthread_mutex_lock(&poolMutex);
+
+  // Append each table's chain to the list of the grabber for that table.
+  while((pos = hashMapNext(tables, pos, &table, &chain)) >= 0) {
+    GrabWorker *w = &workers[hashString(table) % nWorkers];
+    Update *last = (Update *) chain;
+
+    while(last->next) last = last->next;
+
+    last->next = w->list;
+    if(!w->list) busyWorkers++;
+    w->list = (Update *) chain;
+  }
+
+  for(i = 0; i < nWorkers; i++) workers[i].grabTime = grabTime;
+
+  pthread_cond_broadcast(&workCond);
+
+  while(busyWorkers > 0) pthread_cond_wait(&doneCond, &poolMutex);
+
+  for(i = 0; i < nWorkers; i++) {
+    n += workers[i].submitted;
+    if(!status) status = workers[i].status;
+    workers[i].submitted = 0;
+    workers[i].status = X_SUCCESS;
+  }
+
+  pthread_mutex_unlock(&poolMutex);
+
+  hashMapDestroy(tables, NULL);
+
+  clock_gettime(CLOCK_REALTIME, &end);
+  printf(" -- Update for '%s' (%d): %.3f seconds (%s)\n", pattern, n, GetDiffTime(start, &end), smaxErrorDescription(status));
+
+  return status;
+}
+
+
+/**
+ * Updates the time-series data only for the select variables that have changed since (and including) the
+ * specified cutoff time.
+ *
+ * @param pattern       the SMA-X table name pattern of the group of variables to check
+ * @param from          (s) Decimal SMA-X server time after which to select updates.
+ * @param grabTime      (s) UNIX time when data was to be grabbed.
+ * @param isUnitsFresh  Whether the cached units of the group were just refreshed.
+ * @return              X_SUCCESS (0) if successful, or else an error code (<0)
+ */
+static int UpdateChanged(const char *pattern, double from, const time_t grabTime, boolean isUnitsFresh) {
+  int i, n, status;
+  RedisEntry *entries;
+  struct timespec start;
+  Update *list = NULL;
+  Arena *arena;
+  const boolean isServerSide = (scanScriptSHA && from > 0.0);
+
+  if(!pattern) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &start);
+
+  dprintf("Checking for changes in '%s' (dt = %.3f s)\n", pattern, from - (start.tv_sec + 1e-9 * start.tv_nsec));
+
+  // With the Lua script, only the changed timestamps are sent to us
+  if(isServerSide) entries = ScanChanged(pattern, from, &n);
+  else entries = redisxScanTable(smaxGetRedis(), "<timestamps>", pattern, &n);
+
+  if(n < 0) {
+    dprintf("! SMA-X: %s(): %s\n", isServerSide ? "ScanChanged" : "redisxScanTable", smaxErrorDescription(n));
+    DestroyEntries(entries, n);
+    return n;
+  }
+
+  if(n == 0) {
+    dprintf("! No matching timestamps for '%s'\n", pattern);
+    if(entries) free(entries);
+    return 0;
+  }
+
+  dprintf("Got %d timestamps for '%s' to check...\n", n, pattern);
+
+  arena = arenaCreate(ARENA_BLOCK_SIZE);
+
+  for(i=0; i<n; i++) {
+    const RedisEntry *e = &entries[i];
+    VarState *st;
+    double t;
+
+    if(*e->key == '_') continue;
+    if(*e->key == '<') continue;
+
+    st = GetState(e->key);
+    if(!st->key) continue;
+
+    // Skip variables whose timestamp has not changed since the last scan, without parsing it.
+    if(from > 0.0 && strcmp(st->timestamp, e->value) == 0) continue;
+
+    errno = 0;
+    t = strtod(e->value, NULL);
+    if(errno) {
+      dprintf("! Bad timestamp: [%s]\n", e->value);
+      continue;
+    }
+
+    SetTimestamp(st, e->value);
+
+    if(t >= from) if(isLoggingWith(st->props, t, grabTime)) {
+      Update *u = QueueForUpdate(arena, e->key, st, grabTime, isUnitsFresh);
+      if(!u) continue;
+
+      u->next = list;
+      list = u;
+    }
+  }
+
+  DestroyEntries(entries, n);
+
+  status = SubmitQueued(pattern, list, grabTime, &start);
+
+  // Variables still queued keep the arena alive until the SQL writers are done with them.
+  arenaRelease(arena);
+
+  return status;
+}
+
+
+/**
+ * SMA-X update notification callback, which adds the updated variable to the set of changed variables.
+ *
+ * @param pattern   The subscription pattern that matched (unused).
+ * @param channel   The notification channel, which contains the ID of the updated variable.
+ * @param msg       The notification message (unused).
+ * @param length    The length of the notification message (unused).
+ */
+static void ProcessUpdate(const char *pattern, const char *channel, const char *msg, long length) {
+  const char *id;
+  int i;
+
+  (void) pattern;
+  (void) msg;
+  (void) length;
+
+  if(strncmp(channel, SMAX_UPDATES, SMAX_UPDATES_LENGTH) != 0) return;
+
+  id = channel + SMAX_UPDATES_LENGTH;
+  if(*id == '_' || *id == '<') return;
+
+  // Ignore variables that are not in any of the groups, so they do not accumulate in the set.
+  for(i = 0; varGroups[i] != NULL; i++) if(fnmatch(varGroups[i]->pattern, id, 0) == 0) break;
+  if(!varGroups[i]) return;
+
+  pthread_mutex_lock(&dirtyMutex);
+  hashMapPut(dirty, id, NULL, NULL);
+  pthread_mutex_unlock(&dirtyMutex);
+}
+
+
+/**
+ * SMA-X connect hook, which marks all groups for resynchronization by scanning, since update notifications
+ * may have been lost while disconnected.
+ *
+ */
+static void ResyncChanges() {
+  int i;
+
+  pthread_mutex_lock(&dirtyMutex);
+  for(i = 0; varGroups[i] != NULL; i++) varGroups[i]->isResync = TRUE;
+  pthread_mutex_unlock(&dirtyMutex);
+}
+
+
+/**
+ * Subscribes to SMA-X update notifications for all groups of variables, which are collected into the set
+ * of changed variables between updates.
+ *
+ * @return    X_SUCCESS (0) if successful, or else an error code (<0).
+ */
+static int StartChangeCapture() {
+  int i, status;
+
+  dirty = hashMapCreate(DIRTY_SET_CAPACITY);
+
+  smaxAddConnectHook(ResyncChanges);
+
+  status = smaxAddSubscriber(NULL, ProcessUpdate);
+  if(status) goto cleanup; // @suppress("Goto statement used")
+
+  for(i = 0; varGroups[i] != NULL; i++) {
+    status = smaxSubscribe(NULL, varGroups[i]->pattern);
+    if(status) {
+      smaxRemoveSubscribers(ProcessUpdate);
+      goto cleanup; // @suppress("Goto statement used")
+    }
+  }
+
+  return X_SUCCESS;
+
+  // ----------------------------------------------------------------------------------------
+  cleanup:
+
+  // Fall back to scanning for changes
+  hashMapDestroy(dirty, NULL);
+  dirty = NULL;
+
+  return status;
+}
+
+
+/**
+ * Takes the variables with notified changes that belong to a group from the set of changed variables.
+ *
+ * @param group     The variable group
+ * @return          A new set of the changed variables in the group.
+ */
+static HashMap *TakeChanges(VarGroup *group) {
+  HashMap *all, *changed = hashMapCreate(DIRTY_SET_CAPACITY);
+  const char *id;
+  int pos = 0;
+
+  pthread_mutex_lock(&dirtyMutex);
+  all = dirty;
+  dirty = hashMapCreate(hashMapSize(all));
+
+  // Keep changes to variables in other groups for later.
+  while((pos = hashMapNext(all, pos, &id, NULL)) >= 0)
+    hashMapPut(fnmatch(group->pattern, id, 0) == 0 ? changed : dirty, id, NULL, NULL);
+
+  pthread_mutex_unlock(&dirtyMutex);
+
+  hashMapDestroy(all, NULL);
+
+  return changed;
+}
+
+
+/**
+ * Checks and clears the flag indicating that update notifications may have been missed for a group,
+ * so its changes must be found by scanning.
+ *
+ * @param group     The variable group
+ * @return          TRUE (1) if the group needs to be resynchronized by scanning, or else FALSE (0).
+ */
+static boolean TakeResync(VarGroup *group) {
+  boolean isResync;
+
+  pthread_mutex_lock(&dirtyMutex);
+  isResync = group->isResync;
+  group->isResync = FALSE;
+  pthread_mutex_unlock(&dirtyMutex);
+
+  return isResync;
+}
+
+
+/**
+ * Updates the time-series data for the variables in a group, for which SMA-X sent update notifications
+ * since the last update. Unlike UpdateChanged(), it does not need to scan through all SMA-X timestamps.
+ *
+ * @param group         The variable group
+ * @param now           (s) Decimal SMA-X server time.
+ * @param grabTime      (s) UNIX time when data was to be grabbed.
+ * @return              X_SUCCESS (0) if successful, or else an error code (<0)
+ *
+ * @sa UpdateChanged()
+ */
+static int UpdateNotified(VarGroup *group, double now, const time_t grabTime) {
+  struct timespec start;
+  HashMap *changed;
+  Update *list = NULL;
+  Arena *arena;
+  const char *id;
+  int pos = 0, status;
+
+  clock_gettime(CLOCK_REALTIME, &start);
+
+  changed = TakeChanges(group);
+
+  dprintf("Got %d notified changes for '%s'...\n", hashMapSize(changed), group->pattern);
+
+  arena = arenaCreate(ARENA_BLOCK_SIZE);
+
+  while((pos = hashMapNext(changed, pos, &id, NULL)) >= 0) {
+    VarState *st = GetState(id);
+    Update *u;
+
+    if(!st->key) continue;
+    if(!isLoggingWith(st->props, now, grabTime)) continue;
+
+    u = QueueForUpdate(arena, id, st, grabTime, FALSE);
+    if(!u) continue;
+
+    u->next = list;
+    list = u;
+  }
+
+  hashMapDestroy(changed, NULL);
+
+  status = SubmitQueued(group->pattern, list, grabTime, &start);
+  arenaRelease(arena);
+
+  return status;
+}
+
+
+/**
+ * Snapshorts all SMA-X variables with the matching keyword pattern
+ *
+ * @param pattern       the Redis keyword pattern selecting what data is mined from SMA-X
+ * @param grabTime      (s) UNIX time when data was to be grabbed.
+ * @param isUnitsFresh  Whether the cached units of the group were just refreshed.
+ * @return              X_SUCCESS (0) if the update was successful, or else an appropriate error (<0)
+ */
+static int Snapshot(const char *pattern, time_t grabTime, boolean isUnitsFresh) {
+  int status;
+
+  if(!pattern) {
+    errno = EINVAL;
+    return -1;
+  }
+
+# if USE_SYSTEMD
+  setSDState("SNAPSHOT");
+# endif
+
+  status = UpdateChanged(pattern, 0.0, grabTime, isUnitsFresh);
+
+# if USE_SYSTEMD
+  setSDState(IDLE_STATE);
+# endif
+
+  return status;
+}
+
+
+/**
+ * Sleeps until the specified UNIX time. It returns immediately if that time has already passed.
+ *
+ * @param target        (s) The integer UNIX time of the targeted wakeup.
+ */
+static void SleepUntil(time_t target) {
+  struct timespec now, dt, rem = {0};
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  if(now.tv_sec >= target) return;
+
+  dt.tv_sec = target - now.tv_sec;
+  if(now.tv_nsec) {
+    dt.tv_sec--;
+    dt.tv_nsec = 1000000000 - now.tv_nsec;
+  }
+  else dt.tv_nsec = 0;
+
+  dprintf("sleeping for %ld.%09ld s\n", dt.tv_sec, dt.tv_nsec);
+
+  while(nanosleep(&dt, &rem)) {
+    perror("WARNING! nanosleep");
+    if(errno != EINTR) exit(SYSERR_RTN);
+    dt = rem;
+  }
+}
+
+
+/**
+ * Returns the time of the next scheduled grab for a group of variables, which is the next round multiple of the
+ * group's update interval (or snapshot interval, if the group has snapshots only) after the specified time.
+ *
+ * @param group         The variable group
+ * @param now           (s) UNIX time after which to schedule the next grab.
+ * @return              (s) the integer UNIX time of the next grab.
+ */
+static time_t GetNextGrab(const VarGroup *group, time_t now) {
+  int period = group->updateInterval > 0 ? group->updateInterval : group->snapshotInterval;
+  return now - (now % period) + period;
+}
+
+
+/**
+ * Checks if a scheduled grab of a group of variables should be a full snapshot. Snapshots are taken at the grab
+ * closest to every round multiple of the group's snapshot interval.
+ *
+ * @param group         The variable group
+ * @param target        (s) The UNIX time of the scheduled grab.
+ * @return              TRUE (1) if the grab should be a snapshot, or else FALSE (0).
+ */
+static boolean isSnapshotDue(const VarGroup *group, time_t target) {
+  if(group->updateInterval <= 0) return TRUE;
+  if(group->snapshotInterval <= 0) return FALSE;
+  return (target % group->snapshotInterval < group->updateInterval);
+}
+
+
+/**
+ * Creates a new group of SMA-X variables, which are grabbed on their own schedule.
+ *
+ * @param name              Name of the group (for reporting)
+ * @param pattern           Pattern of the SMA-X variable IDs in the group
+ * @param updateInterval    (s) Interval of incremental updates, or -1 for snapshots only.
+ * @param snapshotInterval  (s) Interval of snapshots, or -1 if no periodic snapshots.
+ * @param priority          Groups of higher priority are grabbed first when due at the same time.
+ * @return                  the new variable group.
+ */
+static VarGroup *CreateGroup(const char *name, const char *pattern, int updateInterval, int snapshotInterval, int priority) {
+  VarGroup *g = (VarGroup *) calloc(1, sizeof(VarGroup));
+  if(!g) {
+    perror("CreateGroup(): alloc group");
+    exit(ERROR_EXIT);
+  }
+
+  g->name = strdup(name);
+  g->pattern = strdup(pattern);
+  g->updateInterval = updateInterval;
+  g->snapshotInterval = snapshotInterval;
+  g->priority = priority;
+  g->isResync = TRUE;
+  g->nextGrab = GetNextGrab(g, time(NULL));
+
+  printf("Group '%s' (%s): update %d s, snapshot %d s, priority %d\n", name, pattern, updateInterval, snapshotInterval, priority);
+
+  return g;
+}
+
+
+/**
+ * Compares variable groups by decreasing priority (for qsort).
+ *
+ * @param a   Pointer to the first group pointer
+ * @param b   Pointer to the second group pointer
+ * @return    &lt;0 if the first group has higher priority, &gt;0 if lower, or else 0.
+ */
+static int CompareGroups(const void *a, const void *b) {
+  const VarGroup *A = *(VarGroup * const *) a;
+  const VarGroup *B = *(VarGroup * const *) b;
+
+  if(A->priority > B->priority) return -1;
+  if(A->priority < B->priority) return 1;
+  return 0;
+}
+
+
+/**
+ * Creates the variable groups from the configuration. If no groups were configured, a single group of all
+ * variables is grabbed at the global update and snapshot intervals.
+ *
+ */
+static void InitGroups() {
+  const group_config *c;
+  int n = 0;
+
+  for(c = getGroups(); c != NULL; c = c->next) n++;
+
+  varGroups = (VarGroup **) calloc(n + 2, sizeof(VarGroup *));
+  if(!varGroups) {
+    perror("InitGroups(): alloc groups");
+    exit(ERROR_EXIT);
+  }
+
+  if(n == 0) {
+    varGroups[0] = CreateGroup("all", "*", getUpdateInterval(), getSnapshotInterval(), 0);
+    return;
+  }
+
+  for(n = 0, c = getGroups(); c != NULL; c = c->next)
+    varGroups[n++] = CreateGroup(c->name, c->pattern, c->updateInterval, c->snapshotInterval, c->priority);
+
+  qsort(varGroups, n, sizeof(VarGroup *), CompareGroups);
+}
+
+
+/**
+ * Returns the SMA-X server time as decimal seconds since 1970.
+ *
+ * @return  (s) The decimal SMA-X server time (UNIX time), as queried by TIME on Redis
+ */
+static double GetServerTime() {
+  struct timespec ts = {};
+  double t;
+
+  smaxGetServerTime(&ts);
+  t = ts.tv_sec + 1e-9 * ts.tv_nsec;
+
+  dprintf("SMA-X Time: %.6f\n", t);
+  return t;
+}
+
+
+/**
+ * Grabs data from a group of SMA-X variables and queues them for insertion into the time-series database.
+ *
+ * @param group             The variable group to update
+ * @param grabTime          (s) UNIX time when data was to be grabbed.
+ * @param isSnapshot        Whether we want a complete snapshot. If FALSE, the function may still do a snapshot
+ *                          if there has not been a successful snapshot taken already. Otherwise it will just
+ *                          perform an incremental update of the variable that have changed since last time.
+ * @return X_SUCCESS (0) or else en error code (<0)
+ */
+static int Grab(VarGroup *group, const time_t grabTime, boolean isSnapshot) {
+  double t = GetServerTime();
+  boolean isScan = TRUE, isUnitsFresh = FALSE;
+  int status;
+
+  if(!group) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(group->lastUpdate <= 0 || isSnapshot || (getUnitsRefreshInterval() > 0 && grabTime - group->unitsRefreshed >= getUnitsRefreshInterval())) {
+    status = RefreshUnits(group, grabTime);
+    if(status) printf("WARNING! Units refresh for '%s' failed: %s\n", group->pattern, smaxErrorDescription(status));
+    else isUnitsFresh = TRUE;
+  }
+
+  if(dirty) {
+    // Notified changes are complete, unless notifications may have been missed since the last update.
+    isScan = TakeResync(group);
+
+    // Scanning finds all changes, including the ones notified so far.
+    if(isScan || isSnapshot || group->lastUpdate <= 0) hashMapDestroy(TakeChanges(group), NULL);
+  }
+
+  if(group->lastUpdate <= 0 || isSnapshot) {
+    status = Snapshot(group->pattern, grabTime, isUnitsFresh);
+    if(status) printf("WARNING! Snapshot for '%s' failed: %s\n", group->pattern, smaxErrorDescription(status));
+  }
+  else {
+# if USE_SYSTEMD
+  setSDState("UPDATE");
+# endif
+
+  if(!isScan) status = UpdateNotified(group, t, grabTime);
+  else status = UpdateChanged(group->pattern, group->lastUpdate, grabTime, isUnitsFresh);
+
+# if USE_SYSTEMD
+  setSDState(IDLE_STATE);
+# endif
+
+    if(status) printf("WARNING! Incremental update for '%s' failed: %s\n", group->pattern, smaxErrorDescription(status));
+  }
+
+  if(!status) group->lastUpdate = t;
+  else if(dirty) {
+    // The changes we took are lost, so find them by scanning next time. Variables that were submitted already
+    // are skipped, since their timestamps are unchanged, while the grabbers forgot the timestamps of the rest.
+    pthread_mutex_lock(&dirtyMutex);
+    group->isResync = TRUE;
+    pthread_mutex_unlock(&dirtyMutex);
+  }
+
+  return status;
+}
+
+
+/**
+ * Publishes the logger statistics, such as the depth of the queue of data waiting to be inserted into
+ * the database, in the configured SMA-X table, if any.
+ *
+ */
+static void ShareStats() {
+  const char *table = getStatsTable();
+  queue_stats stats;
+  arena_stats arenas;
+
+  if(!table) return;
+
+  getQueueStats(&stats);
+
+  smaxShareInt(table, "queue_rows", stats.rows);
+  smaxShareInt(table, "queue_bytes", stats.bytes);
+  smaxShareInt(table, "dropped_rows", stats.dropped);
+  smaxShareInt(table, "spilled_rows", stats.spilled);
+  smaxShareInt(table, "spill_file_rows", stats.spillRows);
+  smaxShareInt(table, "coalesced_rows", stats.coalesced);
+
+  getArenaStats(&arenas);
+
+  smaxShareInt(table, "arenas", arenas.arenas);
+  smaxShareInt(table, "arena_bytes", arenas.bytes);
+  smaxShareInt(table, "arena_allocs", arenas.allocs);
+
+  if(stats.dropped || stats.spillRows) dprintf("Queue: %ld rows, %ld bytes, %ld dropped, %ld in spill file.\n", stats.rows, stats.bytes, stats.dropped, stats.spillRows);
+}
+
+
+/**
+ * Service thead that continuously collects data from SMA-X and queues them for insertion ino the time-series database.
+ * Each variable group is grabbed on its own schedule, with a differential update every update interval of the group,
+ * or a full snapshot every snapshot interval of the group. Groups that are due at the same time are grabbed in order
+ * of decreasing priority.
+ *
+ * @param arg       Unused.
+ */
+static void *GrabberThread(void *arg) {
+  (void) arg; // unused
+
+  pthread_detach(pthread_self());
 
   if(REDIS_SCAN_COUNT > 0) redisxSetScanCount(smaxGetRedis(), REDIS_SCAN_COUNT);
 
   for(;;) {
-    time_t target = SleepToRound(getUpdateInterval());
-    boolean isSnapshot = FALSE;
+    time_t target = varGroups[0]->nextGrab;
     int i;
 
-    if(getSnapshotInterval() > 0) isSnapshot = (target % getSnapshotInterval() < getUpdateInterval());
+    for(i=1; varGroups[i] != NULL; i++) if(varGroups[i]->nextGrab < target) target = varGroups[i]->nextGrab;
+
+    SleepUntil(target);
+
+    for(i=0; varGroups[i] != NULL; i++) {
+      VarGroup *g = varGroups[i];
+      if(g->nextGrab > target) continue;
+
+      Grab(g, target, isSnapshotDue(g, target));
+
+      // Skip scheduled grabs that we missed while grabbing.
+      g->nextGrab = GetNextGrab(g, time(NULL));
+    }
 
-    for(i=0; varGroups[i] != NULL; i++) Grab(varGroups[i], target, isSnapshot);
+    ShareStats();
   }
 
   return NULL; // NOT REACHED
@@ -97,13 +97,14 @@ int main(int argc, const char *argv[]) {
   atexit(exit_notify);
 # endif
 
+  // Parse the configuration first, since the collector starts queuing data right away.
+  if(configFile) if(parseConfig(configFile) != 0) return 1;
+
   if(initCollector() != SUCCESS_RETURN) {
     fprintf(stderr, "ERROR! Could not start SMA-X Collector. Exiting\n");
     exit(ERROR_EXIT);
   }
 
-  if(configFile) if(parseConfig(configFile) != 0) return 1;
-
   signal(SIGINT, SignalHandler);
   signal(SIGTERM, SignalHandler);
   signal(SIGQUIT, SignalHandler);
@@ -0,0 +1,451 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  Fast formatting of numerical values as SQL text. Floating-point values are printed with a short
+ *  decimal representation that round-trips exactly (parses back to the same binary value), using the
+ *  Grisu2 algorithm by Florian Loitsch ("Printing Floating-Point Numbers Quickly and Accurately with
+ *  Integers", PLDI 2010). Grisu2 is not always optimal: in rare cases it prints one more digit than
+ *  necessary (e.g. 1e23 as 9.999999999999999e22), which is still exact.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "smax-postgres.h"
+
+#define DOUBLE_MANTISSA_BITS    52        ///< Explicitly stored mantissa bits in an IEEE-754 double
+#define DOUBLE_EXPONENT_BIAS    1075      ///< Exponent bias of an IEEE-754 double, including the mantissa bits
+#define FLOAT_MANTISSA_BITS     23        ///< Explicitly stored mantissa bits in an IEEE-754 float
+#define FLOAT_EXPONENT_BIAS     150       ///< Exponent bias of an IEEE-754 float, including the mantissa bits
+
+#define GRISU_ALPHA             (-60)     ///< Minimum binary exponent of the scaled value
+#define GRISU_GAMMA             (-32)     ///< Maximum binary exponent of the scaled value
+
+#define CACHED_POWERS_MIN_EXP   (-300)    ///< Decimal exponent of the first cached power of 10
+#define CACHED_POWERS_STEP      8         ///< Decimal exponent step between cached powers of 10
+
+#define MIN_FIXED_EXP           (-4)      ///< Smallest decimal exponent printed without exponential notation
+#define MAX_DOUBLE_FIXED_EXP    15        ///< Largest decimal exponent printed without exponential notation for doubles
+#define MAX_FLOAT_FIXED_EXP     6         ///< Largest decimal exponent printed without exponential notation for floats
+
+/**
+ * A floating-point value, represented by a 64-bit integer significand and a binary exponent, i.e.
+ * f * 2<sup>e</sup>.
+ */
+typedef struct {
+  uint64_t f;                   ///< Significand
+  int e;                        ///< Binary exponent
+} DiyFp;
+
+/**
+ * A cached power of 10, i.e. f * 2<sup>e</sup> ~= 10<sup>k</sup>.
+ */
+typedef struct {
+  uint64_t f;                   ///< Normalized significand
+  int e;                        ///< Binary exponent
+  int k;                        ///< Decimal exponent
+} CachedPower;
+
+/// Normalized powers of 10, from 10^-300 to 10^324, in steps of 10^8.
+static const CachedPower cachedPowers[] = {
+  { 0xAB70FE17C79AC6CA, -1060, -300 }, { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+  { 0xBE5691EF416BD60C, -1007, -284 }, { 0x8DD01FAD907FFC3C,  -980, -276 },
+  { 0xD3515C2831559A83,  -954, -268 }, { 0x9D71AC8FADA6C9B5,  -927, -260 },
+  { 0xEA9C227723EE8BCB,  -901, -252 }, { 0xAECC49914078536D,  -874, -244 },
+  { 0x823C12795DB6CE57,  -847, -236 }, { 0xC21094364DFB5637,  -821, -228 },
+  { 0x9096EA6F3848984F,  -794, -220 }, { 0xD77485CB25823AC7,  -768, -212 },
+  { 0xA086CFCD97BF97F4,  -741, -204 }, { 0xEF340A98172AACE5,  -715, -196 },
+  { 0xB23867FB2A35B28E,  -688, -188 }, { 0x84C8D4DFD2C63F3B,  -661, -180 },
+  { 0xC5DD44271AD3CDBA,  -635, -172 }, { 0x936B9FCEBB25C996,  -608, -164 },
+  { 0xDBAC6C247D62A584,  -582, -156 }, { 0xA3AB66580D5FDAF6,  -555, -148 },
+  { 0xF3E2F893DEC3F126,  -529, -140 }, { 0xB5B5ADA8AAFF80B8,  -502, -132 },
+  { 0x87625F056C7C4A8B,  -475, -124 }, { 0xC9BCFF6034C13053,  -449, -116 },
+  { 0x964E858C91BA2655,  -422, -108 }, { 0xDFF9772470297EBD,  -396, -100 },
+  { 0xA6DFBD9FB8E5B88F,  -369,  -92 }, { 0xF8A95FCF88747D94,  -343,  -84 },
+  { 0xB94470938FA89BCF,  -316,  -76 }, { 0x8A08F0F8BF0F156B,  -289,  -68 },
+  { 0xCDB02555653131B6,  -263,  -60 }, { 0x993FE2C6D07B7FAC,  -236,  -52 },
+  { 0xE45C10C42A2B3B06,  -210,  -44 }, { 0xAA242499697392D3,  -183,  -36 },
+  { 0xFD87B5F28300CA0E,  -157,  -28 }, { 0xBCE5086492111AEB,  -130,  -20 },
+  { 0x8CBCCC096F5088CC,  -103,  -12 }, { 0xD1B71758E219652C,   -77,   -4 },
+  { 0x9C40000000000000,   -50,    4 }, { 0xE8D4A51000000000,   -24,   12 },
+  { 0xAD78EBC5AC620000,     3,   20 }, { 0x813F3978F8940984,    30,   28 },
+  { 0xC097CE7BC90715B3,    56,   36 }, { 0x8F7E32CE7BEA5C70,    83,   44 },
+  { 0xD5D238A4ABE98068,   109,   52 }, { 0x9F4F2726179A2245,   136,   60 },
+  { 0xED63A231D4C4FB27,   162,   68 }, { 0xB0DE65388CC8ADA8,   189,   76 },
+  { 0x83C7088E1AAB65DB,   216,   84 }, { 0xC45D1DF942711D9A,   242,   92 },
+  { 0x924D692CA61BE758,   269,  100 }, { 0xDA01EE641A708DEA,   295,  108 },
+  { 0xA26DA3999AEF774A,   322,  116 }, { 0xF209787BB47D6B85,   348,  124 },
+  { 0xB454E4A179DD1877,   375,  132 }, { 0x865B86925B9BC5C2,   402,  140 },
+  { 0xC83553C5C8965D3D,   428,  148 }, { 0x952AB45CFA97A0B3,   455,  156 },
+  { 0xDE469FBD99A05FE3,   481,  164 }, { 0xA59BC234DB398C25,   508,  172 },
+  { 0xF6C69A72A3989F5C,   534,  180 }, { 0xB7DCBF5354E9BECE,   561,  188 },
+  { 0x88FCF317F22241E2,   588,  196 }, { 0xCC20CE9BD35C78A5,   614,  204 },
+  { 0x98165AF37B2153DF,   641,  212 }, { 0xE2A0B5DC971F303A,   667,  220 },
+  { 0xA8D9D1535CE3B396,   694,  228 }, { 0xFB9B7CD9A4A7443C,   720,  236 },
+  { 0xBB764C4CA7A44410,   747,  244 }, { 0x8BAB8EEFB6409C1A,   774,  252 },
+  { 0xD01FEF10A657842C,   800,  260 }, { 0x9B10A4E5E9913129,   827,  268 },
+  { 0xE7109BFBA19C0C9D,   853,  276 }, { 0xAC2820D9623BF429,   880,  284 },
+  { 0x80444B5E7AA7CF85,   907,  292 }, { 0xBF21E44003ACDD2D,   933,  300 },
+  { 0x8E679C2F5E44FF8F,   960,  308 }, { 0xD433179D9C8CB841,   986,  316 },
+  { 0x9E19DB92B4E31BA9,  1013,  324 },
+};
+
+
+/**
+ * Multiplies two floating-point values, rounding the product to 64 bits.
+ *
+ * @param x   The first value
+ * @param y   The second value
+ * @return    The rounded product of the two values.
+ */
+static DiyFp multiply(DiyFp x, DiyFp y) {
+  const uint64_t xl = x.f & 0xffffffff, xh = x.f >> 32;
+  const uint64_t yl = y.f & 0xffffffff, yh = y.f >> 32;
+  const uint64_t ll = xl * yl, lh = xl * yh, hl = xh * yl, hh = xh * yh;
+
+  // Middle 32 bits, with rounding (2^31) of the discarded lower 64 bits.
+  const uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff) + ((uint64_t) 1 << 31);
+
+  DiyFp p = { hh + (lh >> 32) + (hl >> 32) + (mid >> 32), x.e + y.e + 64 };
+  return p;
+}
+
+
+/**
+ * Shifts the significand of a floating-point value to use all 64 bits.
+ *
+ * @param x   The (non-zero) value
+ * @return    The same value, with the most significant bit of the significand set.
+ */
+static DiyFp normalize(DiyFp x) {
+  const int shift = __builtin_clzll(x.f);
+  x.f <<= shift;
+  x.e -= shift;
+  return x;
+}
+
+
+/**
+ * Calculates the normalized floating-point value, and its normalized upper and lower boundaries,
+ * i.e. the points halfway to its neighbors, in the given binary precision. Any number between the
+ * boundaries rounds to the same binary value.
+ *
+ * @param bits            The IEEE-754 bit pattern of the (positive, finite, non-zero) value
+ * @param mantissaBits    The number of explicitly stored mantissa bits, e.g. 52 for double
+ * @param bias            The exponent bias, including the mantissa bits, e.g. 1075 for double
+ * @param[out] lower      The lower boundary, with the same binary exponent as the upper boundary
+ * @param[out] upper      The normalized upper boundary
+ * @return                The normalized value.
+ */
+static DiyFp getBoundaries(uint64_t bits, int mantissaBits, int bias, DiyFp *lower, DiyFp *upper) {
+  const uint64_t hidden = (uint64_t) 1 << mantissaBits;
+  const uint64_t F = bits & (hidden - 1);
+  const int E = (int) (bits >> mantissaBits);
+  DiyFp v, m;
+
+  if(E == 0) {
+    // Subnormal
+    v.f = F;
+    v.e = 1 - bias;
+  }
+  else {
+    v.f = F + hidden;
+    v.e = E - bias;
+  }
+
+  upper->f = (v.f << 1) + 1;
+  upper->e = v.e - 1;
+  *upper = normalize(*upper);
+
+  // If the value is a power of 2, the lower neighbor is closer.
+  if(F == 0 && E > 1) {
+    m.f = (v.f << 2) - 1;
+    m.e = v.e - 2;
+  }
+  else {
+    m.f = (v.f << 1) - 1;
+    m.e = v.e - 1;
+  }
+
+  lower->f = m.f << (m.e - upper->e);
+  lower->e = upper->e;
+
+  return normalize(v);
+}
+
+
+/**
+ * Returns the number of decimal digits of a 32-bit integer, and the largest power of 10 that
+ * does not exceed it.
+ *
+ * @param n             The (non-zero) integer
+ * @param[out] pow10    The largest power of 10 that is less than or equal to n
+ * @return              The number of decimal digits in n.
+ */
+static int getDigitCount(uint32_t n, uint32_t *pow10) {
+  static const uint32_t powers10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+  int k = 1;
+
+  while(k < 10 && n >= powers10[k]) k++;
+
+  *pow10 = powers10[k - 1];
+  return k;
+}
+
+
+/**
+ * Nudges the last generated digit towards the exact value, as long as the result stays within the
+ * rounding interval.
+ *
+ * @param buf     The generated digits
+ * @param len     The number of digits generated
+ * @param dist    Distance from the upper boundary to the exact value
+ * @param delta   Width of the rounding interval
+ * @param rest    Distance from the upper boundary to the generated digits
+ * @param tenK    The value of a unit in the last generated digit
+ */
+static void roundDigits(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK) {
+  while(rest < dist && delta - rest >= tenK && (rest + tenK < dist || dist - rest > rest + tenK - dist)) {
+    buf[len - 1]--;
+    rest += tenK;
+  }
+}
+
+
+/**
+ * Generates short decimal digits for a value within its rounding interval. The digits are usually, but
+ * not always, the shortest possible.
+ *
+ * @param v           The normalized value
+ * @param lower       The lower boundary of the value
+ * @param upper       The upper boundary of the value
+ * @param[out] buf    Buffer for the decimal digits (at least 17 bytes)
+ * @param[out] exp10  The decimal exponent of the last digit
+ * @return            The number of digits generated.
+ */
+static int grisu2(DiyFp v, DiyFp lower, DiyFp upper, char *buf, int *exp10) {
+  const CachedPower *c;
+  DiyFp ck, w, one;
+  uint64_t delta, dist, p2;
+  uint32_t p1, pow10;
+  int f, k, n, len = 0, m = 0;
+
+  // Find a cached power of 10 that brings the upper boundary into [alpha, gamma]
+  f = GRISU_ALPHA - upper.e - 1;
+  k = (f * 78913) / (1 << 18) + (f > 0);
+  c = &cachedPowers[(-CACHED_POWERS_MIN_EXP + k + (CACHED_POWERS_STEP - 1)) / CACHED_POWERS_STEP];
+
+  ck.f = c->f;
+  ck.e = c->e;
+
+  w = multiply(v, ck);
+  lower = multiply(lower, ck);
+  upper = multiply(upper, ck);
+
+  // Stay safely inside the rounding interval, given the rounding errors of the multiplications.
+  lower.f++;
+  upper.f--;
+
+  *exp10 = -c->k;
+
+  delta = upper.f - lower.f;
+  dist = upper.f - w.f;
+
+  one.e = upper.e;
+  one.f = (uint64_t) 1 << -one.e;
+
+  // Integral and fractional parts of the scaled upper boundary
+  p1 = (uint32_t) (upper.f >> -one.e);
+  p2 = upper.f & (one.f - 1);
+
+  for(n = getDigitCount(p1, &pow10); n > 0; ) {
+    uint64_t rest;
+
+    buf[len++] = (char) ('0' + p1 / pow10);
+    p1 %= pow10;
+    n--;
+
+    rest = ((uint64_t) p1 << -one.e) + p2;
+    if(rest <= delta) {
+      *exp10 += n;
+      roundDigits(buf, len, dist, delta, rest, (uint64_t) pow10 << -one.e);
+      return len;
+    }
+
+    pow10 /= 10;
+  }
+
+  do {
+    p2 *= 10;
+    buf[len++] = (char) ('0' + (p2 >> -one.e));
+    p2 &= one.f - 1;
+    m++;
+
+    delta *= 10;
+    dist *= 10;
+  } while(p2 > delta);
+
+  *exp10 -= m;
+  roundDigits(buf, len, dist, delta, p2, one.f);
+
+  return len;
+}
+
+
+/**
+ * Prints the decimal digits of a value, placing the decimal point or an exponent as appropriate.
+ *
+ * @param digits    The decimal digits
+ * @param len       The number of decimal digits
+ * @param exp10     The decimal exponent of the last digit
+ * @param maxFixed  The largest decimal exponent to print without exponential notation
+ * @param dst       The buffer in which to print the value
+ * @return          Pointer to the position after the printed value in the destination buffer.
+ */
+static char *printDigits(const char *digits, int len, int exp10, int maxFixed, char *dst) {
+  const int point = len + exp10;     // Position of the decimal point relative to the first digit
+
+  if(point > MIN_FIXED_EXP && point <= maxFixed + 1) {
+    if(point <= 0) {
+      // 0.000ddd
+      *(dst++) = '0';
+      *(dst++) = '.';
+      memset(dst, '0', -point);
+      dst += -point;
+      memcpy(dst, digits, len);
+      return dst + len;
+    }
+
+    if(point >= len) {
+      // ddd000
+      memcpy(dst, digits, len);
+      dst += len;
+      memset(dst, '0', point - len);
+      return dst + point - len;
+    }
+
+    // ddd.ddd
+    memcpy(dst, digits, point);
+    dst += point;
+    *(dst++) = '.';
+    memcpy(dst, digits + point, len - point);
+    return dst + len - point;
+  }
+
+  // d.ddde[+-]nn
+  *(dst++) = digits[0];
+  if(len > 1) {
+    *(dst++) = '.';
+    memcpy(dst, digits + 1, len - 1);
+    dst += len - 1;
+  }
+
+  *(dst++) = 'e';
+  return printLong(point - 1, dst);
+}
+
+
+/**
+ * Prints a double-precision value as decimal text, with a short representation that round-trips exactly,
+ * i.e. parses back to the exact same value. For finite values only: the caller should handle infinite
+ * values and NaN.
+ *
+ * @param value   A finite double-precision value
+ * @param dst     The buffer in which to print the value (at least 25 bytes).
+ * @return        Pointer to the position after the printed value in the destination buffer (which is
+ *                also terminated).
+ *
+ * @sa printFloat()
+ */
+char *printDouble(double value, char *dst) {
+  DiyFp v, lower, upper;
+  uint64_t bits;
+  char digits[20];
+  int len, exp10;
+
+  memcpy(&bits, &value, sizeof(bits));
+
+  if(bits >> 63) *(dst++) = '-';
+  bits &= ~((uint64_t) 1 << 63);
+
+  if(!bits) {
+    *(dst++) = '0';
+    *dst = '\0';
+    return dst;
+  }
+
+  v = getBoundaries(bits, DOUBLE_MANTISSA_BITS, DOUBLE_EXPONENT_BIAS, &lower, &upper);
+  len = grisu2(v, lower, upper, digits, &exp10);
+
+  dst = printDigits(digits, len, exp10, MAX_DOUBLE_FIXED_EXP, dst);
+  *dst = '\0';
+  return dst;
+}
+
+
+/**
+ * Prints a single-precision value as decimal text, with a short representation that round-trips exactly,
+ * i.e. parses back to the exact same single-precision value. For finite values only: the caller should
+ * handle infinite values and NaN.
+ *
+ * @param value   A finite single-precision value
+ * @param dst     The buffer in which to print the value (at least 16 bytes).
+ * @return        Pointer to the position after the printed value in the destination buffer (which is
+ *                also terminated).
+ *
+ * @sa printDouble()
+ */
+char *printFloat(float value, char *dst) {
+  DiyFp v, lower, upper;
+  uint32_t bits;
+  char digits[20];
+  int len, exp10;
+
+  memcpy(&bits, &value, sizeof(bits));
+
+  if(bits >> 31) *(dst++) = '-';
+  bits &= ~((uint32_t) 1 << 31);
+
+  if(!bits) {
+    *(dst++) = '0';
+    *dst = '\0';
+    return dst;
+  }
+
+  v = getBoundaries(bits, FLOAT_MANTISSA_BITS, FLOAT_EXPONENT_BIAS, &lower, &upper);
+  len = grisu2(v, lower, upper, digits, &exp10);
+
+  dst = printDigits(digits, len, exp10, MAX_FLOAT_FIXED_EXP, dst);
+  *dst = '\0';
+  return dst;
+}
+
+
+/**
+ * Prints an integer value as decimal text.
+ *
+ * @param value   The integer value
+ * @param dst     The buffer in which to print the value (at least 21 bytes).
+ * @return        Pointer to the position after the printed value in the destination buffer (which is
+ *                also terminated).
+ */
+char *printLong(int64_t value, char *dst) {
+  char digits[20];
+  uint64_t u = value < 0 ? -(uint64_t) value : (uint64_t) value;
+  int n = 0;
+
+  if(value < 0) *(dst++) = '-';
+
+  do {
+    digits[n++] = (char) ('0' + u % 10);
+    u /= 10;
+  } while(u);
+
+  while(n > 0) *(dst++) = digits[--n];
+
+  *dst = '\0';
+  return dst;
+}
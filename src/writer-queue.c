@@ -0,0 +1,143 @@
+/**
+ * @file
+ *
+ * @date Created  on Oct 17, 2026
+ * @author agent
+ *
+ *  A lock-free, multi-producer, single-consumer queue of variables, for feeding an SQL writer. Producers
+ *  never block each other, and the consumer takes all variables queued since its last visit in a single
+ *  atomic swap. A semaphore wakes the consumer only when variables are pushed to an empty queue.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define __XCHANGE_INTERNAL_API__                          ///< Use internal definitions
+#include "smax-postgres.h"
+#include "writer-queue.h"
+
+
+/**
+ * Initializes an empty queue.
+ *
+ * @param q   The queue
+ */
+void initWriterQueue(WriterQueue *q) {
+  atomic_init(&q->incoming, NULL);
+  q->taken = NULL;
+
+  // The semaphore counts wake-ups for the consumer.
+  sem_init(&q->qAvailable, 0, 0);
+}
+
+
+/**
+ * Pushes a variable onto a queue, via an atomic compare-and-swap. The consumer is woken only if the
+ * queue was empty. It may be called from any thread.
+ *
+ * @param q   The queue
+ * @param u   Pointer to the variable
+ */
+void pushWriterQueue(WriterQueue *q, Variable *u) {
+  Variable *head = atomic_load_explicit(&q->incoming, memory_order_relaxed);
+
+  do u->next = head;
+  while(!atomic_compare_exchange_weak_explicit(&q->incoming, &head, u, memory_order_release, memory_order_relaxed));
+
+  if(!head) sem_post(&q->qAvailable);
+}
+
+
+/**
+ * Reverses the order of variables in a linked list.
+ *
+ * @param list    The first variable in the list
+ * @return        The first variable in the reversed list.
+ */
+static Variable *reverseList(Variable *list) {
+  Variable *reversed = NULL;
+
+  while(list) {
+    Variable *next = list->next;
+    list->next = reversed;
+    reversed = list;
+    list = next;
+  }
+
+  return reversed;
+}
+
+
+/**
+ * Takes the next variable from a queue, without waiting. When the consumer runs out of variables it has
+ * taken already, it takes the entire backlog from the queue in one atomic swap. It may be called from the
+ * consumer thread only.
+ *
+ * @param q   The queue
+ * @return    The next variable from the queue, or NULL if the queue is empty.
+ *
+ * @sa waitWriterQueue()
+ */
+Variable *takeWriterQueue(WriterQueue *q) {
+  Variable *u;
+
+  if(!q->taken) {
+    Variable *list = atomic_exchange_explicit(&q->incoming, NULL, memory_order_acquire);
+    if(!list) return NULL;
+
+    // The stack has the most recent variable on top, so reverse it to restore the queue order.
+    q->taken = reverseList(list);
+
+    // Absorb stale wake-ups. We always check the stack before waiting, so nothing is missed.
+    while(sem_trywait(&q->qAvailable) == 0);
+  }
+
+  u = q->taken;
+  q->taken = u->next;
+
+  u->next = NULL;
+  return u;
+}
+
+
+/**
+ * Waits until variables are pushed to an empty queue, or until the consumer is woken otherwise. It may
+ * be called from the consumer thread only, after takeWriterQueue() returned NULL.
+ *
+ * @param q           The queue
+ * @param deadline    Absolute (CLOCK_REALTIME) time until which to wait, or NULL to wait indefinitely.
+ * @return            SUCCESS_RETURN (0) if woken, or else ERROR_RETURN (-1; errno will indicate the type
+ *                    of error, e.g. ETIMEDOUT if the deadline has passed).
+ *
+ * @sa wakeWriterQueue()
+ */
+int waitWriterQueue(WriterQueue *q, const struct timespec *deadline) {
+  if(deadline) {
+    if(sem_timedwait(&q->qAvailable, deadline) != 0) if(errno != EINTR) return ERROR_RETURN;
+  }
+  else sem_wait(&q->qAvailable);
+
+  return SUCCESS_RETURN;
+}
+
+
+/**
+ * Wakes the consumer of a queue, if it is waiting, e.g. so it can notice that it should stop.
+ *
+ * @param q   The queue
+ */
+void wakeWriterQueue(WriterQueue *q) {
+  sem_post(&q->qAvailable);
+}
+
+
+/**
+ * Checks if there is nothing in a queue, either waiting to be taken, or taken but not yet handed out.
+ *
+ * @param q   The queue
+ * @return    TRUE (1) if the queue is empty, or else FALSE (0).
+ */
+boolean isWriterQueueEmpty(WriterQueue *q) {
+  return !q->taken && !atomic_load(&q->incoming);
+}